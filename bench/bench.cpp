@@ -0,0 +1,497 @@
+// Measures parsing, writing, traversal and member lookup on generated corpora and on any
+// files given on the command line, and prints the results as JSON.
+//
+//   youngJSON_bench [--quick] [--out results.json] [file.json ...]
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#ifdef YOUNGJSON_BENCH_NLOHMANN
+#include <nlohmann/json.hpp>
+#endif
+#ifdef YOUNGJSON_BENCH_RAPIDJSON
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+#endif
+
+#include "../src/include/jsonparser.h"
+
+using namespace std;
+using namespace youngJSON;
+
+// every allocation of the process is counted, JsonArena blocks included
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+static atomic<size_t> gAllocations(0);
+static atomic<size_t> gAllocatedBytes(0);
+
+void* operator new(size_t size) {
+    gAllocations.fetch_add(1, memory_order_relaxed);
+    gAllocatedBytes.fetch_add(size, memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+static size_t peakRssKb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss) / 1024;
+#else
+    return static_cast<size_t>(usage.ru_maxrss);
+#endif
+#endif
+}
+
+// deterministic pseudo-random numbers, so that every run reads the same corpora
+class Random {
+public:
+    explicit Random(uint64_t seed) : mState(seed) {
+    }
+
+    uint64_t next() {
+        mState = mState * 6364136223846793005ull + 1442695040888963407ull;
+        return mState >> 33;
+    }
+
+    int range(int n) {
+        return static_cast<int>(next() % static_cast<uint64_t>(n));
+    }
+
+    string word(int minLength, int maxLength) {
+        string res;
+        int length = minLength + range(maxLength - minLength + 1);
+        for (int i = 0; i < length; i++)
+            res += static_cast<char>('a' + range(26));
+        return res;
+    }
+
+    string text(int words) {
+        static const char* extras[] = { " \\\"quoted\\\"", " caf\\u00e9", " \\ud83d\\ude00", " line\\nbreak", " http:\\/\\/t.co\\/x" };
+        string res;
+        for (int i = 0; i < words; i++) {
+            if (i > 0)
+                res += ' ';
+            res += word(2, 9);
+            if (range(8) == 0)
+                res += extras[range(5)];
+        }
+        return res;
+    }
+
+private:
+    uint64_t mState;
+};
+
+struct Corpus {
+    string name;
+    string text;
+};
+
+// statuses with nested users and entities, like a search API response
+static string makeTwitter(int count) {
+    Random random(1);
+    string s = "{\"statuses\": [";
+    for (int i = 0; i < count; i++) {
+        if (i > 0)
+            s += ',';
+        string id = to_string(500000000000000000ull + random.next());
+        s += "{\"created_at\": \"Sun Aug 31 00:29:15 +0000 2014\", \"id\": " + id + ", \"id_str\": \"" + id + "\"";
+        s += ", \"text\": \"" + random.text(4 + random.range(16)) + "\", \"truncated\": false";
+        s += ", \"entities\": {\"hashtags\": [";
+        for (int h = random.range(3); h > 0; h--)
+            s += "{\"text\": \"" + random.word(3, 10) + "\", \"indices\": [" + to_string(random.range(100)) + ", " + to_string(random.range(140)) + "]}" + (h > 1 ? "," : "");
+        s += "], \"urls\": [], \"user_mentions\": []}";
+        s += ", \"user\": {\"id\": " + to_string(random.next()) + ", \"name\": \"" + random.word(4, 12) + "\", \"screen_name\": \"" + random.word(4, 12) + "\"";
+        s += ", \"location\": \"" + random.text(2) + "\", \"description\": \"" + random.text(10) + "\", \"url\": null";
+        s += ", \"followers_count\": " + to_string(random.range(100000)) + ", \"friends_count\": " + to_string(random.range(5000));
+        s += ", \"verified\": " + string(random.range(10) == 0 ? "true" : "false") + ", \"lang\": \"en\"}";
+        s += ", \"retweet_count\": " + to_string(random.range(1000)) + ", \"favorite_count\": " + to_string(random.range(1000));
+        s += ", \"favorited\": false, \"retweeted\": false, \"lang\": \"en\"}";
+    }
+    s += "], \"search_metadata\": {\"completed_in\": 0.087, \"max_id\": 505874924095815700, \"count\": " + to_string(count) + "}}";
+    return s;
+}
+
+// events keyed by id and performances with prices, like a ticketing catalogue
+static string makeCitm(int count) {
+    Random random(2);
+    string s = "{\"events\": {";
+    for (int i = 0; i < count; i++) {
+        string id = to_string(138586341 + i * 7);
+        s += string(i > 0 ? "," : "") + "\"" + id + "\": {\"description\": null, \"id\": " + id + ", \"logo\": \"/images/UE0AAAAACEKo6QAAAAZDSVRN\"";
+        s += ", \"name\": \"" + random.text(3) + "\", \"subTopicIds\": [337184269, 337184283], \"subjectCode\": null, \"topicIds\": [324846099, 107888604]}";
+    }
+    s += "}, \"performances\": [";
+    for (int i = 0; i < count; i++) {
+        s += string(i > 0 ? "," : "") + "{\"eventId\": " + to_string(138586341 + i * 7) + ", \"id\": " + to_string(339887544 + i) + ", \"prices\": [";
+        for (int p = 0; p < 4; p++)
+            s += string(p > 0 ? "," : "") + "{\"amount\": " + to_string(9000 + random.range(90000)) + ", \"audienceSubCategoryId\": 337100890, \"seatCategoryId\": " + to_string(338937295 + p) + "}";
+        s += "], \"seatCategories\": [";
+        for (int c = 0; c < 3; c++) {
+            s += string(c > 0 ? "," : "") + "{\"areas\": [";
+            for (int a = 0; a < 5; a++)
+                s += string(a > 0 ? "," : "") + "{\"areaId\": " + to_string(205705993 + a) + ", \"blockIds\": []}";
+            s += "], \"seatCategoryId\": " + to_string(338937295 + c) + "}";
+        }
+        s += "], \"start\": 1372701600000, \"venueCode\": \"PLEYEL_PLEYEL\"}";
+    }
+    s += "]}";
+    return s;
+}
+
+// polygons of coordinate pairs, like a GeoJSON border
+static string makeCanada(int count) {
+    Random random(3);
+    string s = "{\"type\": \"FeatureCollection\", \"features\": [{\"type\": \"Feature\", \"properties\": {\"name\": \"Canada\"}, "
+               "\"geometry\": {\"type\": \"Polygon\", \"coordinates\": [";
+    for (int ring = 0; ring < 10; ring++) {
+        s += string(ring > 0 ? "," : "") + "[";
+        for (int i = 0; i < count / 10; i++) {
+            double x = -141.0 + static_cast<double>(random.next() % 8000000) / 100000.0;
+            double y = 41.0 + static_cast<double>(random.next() % 4000000) / 100000.0;
+            s += string(i > 0 ? "," : "") + "[" + ValueNumber(x).toString() + "," + ValueNumber(y).toString() + "]";
+        }
+        s += "]";
+    }
+    s += "]}}]}";
+    return s;
+}
+
+static string makeDeep(int depth) {
+    string s;
+    for (int i = 0; i < depth; i++)
+        s += i % 2 == 0 ? "{\"a\": [1, " : "{\"b\": ";
+    s += "null";
+    for (int i = depth - 1; i >= 0; i--)
+        s += i % 2 == 0 ? "]}" : "}";
+    return s;
+}
+
+static string makeWide(int count) {
+    string s = "{";
+    for (int i = 0; i < count; i++)
+        s += string(i > 0 ? "," : "") + "\"member" + to_string(i) + "\": " + to_string(i);
+    return s + "}";
+}
+
+static string makeStrings(int count) {
+    Random random(4);
+    string s = "[";
+    for (int i = 0; i < count; i++)
+        s += string(i > 0 ? "," : "") + "\"" + random.text(5 + random.range(60)) + "\"";
+    return s + "]";
+}
+
+static string makeNumbers(int count) {
+    Random random(5);
+    string s = "[";
+    for (int i = 0; i < count; i++) {
+        s += i > 0 ? "," : "";
+        switch (random.range(3)) {
+        case 0:
+            s += to_string(static_cast<long long>(random.next()) - (1ll << 30));
+            break;
+        case 1:
+            s += ValueNumber(static_cast<double>(random.next()) / 997.0).toString();
+            break;
+        default:
+            s += to_string(random.range(1000) / 10.0);
+            break;
+        }
+    }
+    return s + "]";
+}
+
+static size_t countNodes(const JsonValue& value) {
+    size_t n = 1;
+    if (value.isObject()) {
+        static_cast<const ValueObject&>(value).forEach([&](string_view, const JsonValue& child) {
+            n += countNodes(child);
+        });
+    } else if (value.isArray()) {
+        for (int i = 0; i < value.size(); i++)
+            n += countNodes(value.get(i));
+    }
+    return n;
+}
+
+// reads every scalar so that the walk can't be optimized away
+static double walk(const JsonValue& value) {
+    if (value.isObject()) {
+        double sum = 0;
+        static_cast<const ValueObject&>(value).forEach([&](string_view name, const JsonValue& child) {
+            sum += static_cast<double>(name.length()) + walk(child);
+        });
+        return sum;
+    }
+    if (value.isArray()) {
+        double sum = 0;
+        for (int i = 0; i < value.size(); i++)
+            sum += walk(value.get(i));
+        return sum;
+    }
+    if (value.isNumber())
+        return value.toDouble();
+    return static_cast<double>(value.toStringView().length()) + (value.isTrue() ? 1 : 0);
+}
+
+struct Lookup {
+    const ValueObject*  object;
+    string              name;
+};
+
+static void collectLookups(const JsonValue& value, vector<Lookup>& res) {
+    if (value.isObject()) {
+        auto& obj = static_cast<const ValueObject&>(value);
+        obj.forEach([&](string_view name, const JsonValue& child) {
+            res.push_back(Lookup{ &obj, string(name) });
+            collectLookups(child, res);
+        });
+    } else if (value.isArray()) {
+        for (int i = 0; i < value.size(); i++)
+            collectLookups(value.get(i), res);
+    }
+}
+
+struct Measurement {
+    double seconds;         // per iteration, best of the runs
+    double allocations;     // per iteration
+    double allocatedBytes;  // per iteration
+};
+
+class Bench {
+public:
+    explicit Bench(bool quick) : mMinSeconds(quick ? 0.01 : 0.5), mMinRuns(quick ? 1 : 5) {
+    }
+
+    Measurement run(const function<void()>& fn) const {
+        fn();   // warm up
+
+        size_t allocations = gAllocations.load();
+        size_t bytes = gAllocatedBytes.load();
+        double best = 1e30, total = 0;
+        int runs = 0;
+        while (runs < mMinRuns || total < mMinSeconds) {
+            auto start = chrono::steady_clock::now();
+            fn();
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            best = seconds < best ? seconds : best;
+            total += seconds;
+            runs++;
+        }
+        return Measurement{ best, static_cast<double>(gAllocations.load() - allocations) / runs,
+                            static_cast<double>(gAllocatedBytes.load() - bytes) / runs };
+    }
+
+private:
+    double  mMinSeconds;
+    int     mMinRuns;
+};
+
+static void addResult(ValueArray& results, const string& name, const Measurement& m, size_t bytes, size_t items) {
+    auto result = make_shared<ValueObject>();
+    result->add("benchmark", ValueString(name));
+    result->add("seconds", ValueNumber(m.seconds));
+    result->add("mbPerSecond", ValueNumber(static_cast<double>(bytes) / m.seconds / 1e6));
+    result->add("nsPerNode", ValueNumber(m.seconds * 1e9 / static_cast<double>(items)));
+    result->add("allocations", ValueNumber(m.allocations));
+    result->add("allocatedBytes", ValueNumber(m.allocatedBytes));
+    results.add(result);
+}
+
+static shared_ptr<ValueObject> measure(const Corpus& corpus, const Bench& bench) {
+    const string& src = corpus.text;
+    JsonReader reader;
+    JsonDocument doc;
+    reader.read(src, doc);
+    const size_t nodes = countNodes(doc.root());
+
+    auto results = make_shared<ValueArray>();
+    volatile double sink = 0;
+
+    addResult(*results, "parse/dom", bench.run([&] {
+        sink = sink + reader.read(src)->size();
+    }), src.size(), nodes);
+    addResult(*results, "parse/document", bench.run([&] {
+        reader.read(src, doc);
+    }), src.size(), nodes);
+    CompactDocument compact;
+    addResult(*results, "parse/compact", bench.run([&] {
+        reader.read(src, compact);
+    }), src.size(), nodes);
+    TapeDocument tape;
+    addResult(*results, "parse/tape", bench.run([&] {
+        reader.read(src, tape);
+    }), src.size(), nodes);
+
+    reader.read(src, doc);
+    const size_t compactSize = doc.root().toCompactString().size();
+    const size_t indentedSize = doc.root().toString().size();
+    addResult(*results, "write/compact", bench.run([&] {
+        sink = sink + doc.root().toCompactString().size();
+    }), compactSize, nodes);
+    addResult(*results, "write/indented", bench.run([&] {
+        sink = sink + doc.root().toString().size();
+    }), indentedSize, nodes);
+
+    addResult(*results, "traverse/document", bench.run([&] {
+        sink = sink + walk(doc.root());
+    }), src.size(), nodes);
+
+    vector<Lookup> lookups;
+    collectLookups(doc.root(), lookups);
+    if (!lookups.empty()) {
+        addResult(*results, "lookup/document", bench.run([&] {
+            size_t found = 0;
+            for (auto& it : lookups)
+                found += it.object->find(it.name) != nullptr;
+            sink = sink + static_cast<double>(found);
+        }), src.size(), lookups.size());
+    }
+
+#ifdef YOUNGJSON_BENCH_NLOHMANN
+    addResult(*results, "parse/nlohmann", bench.run([&] {
+        sink = sink + static_cast<double>(nlohmann::json::parse(src).size());
+    }), src.size(), nodes);
+    auto json = nlohmann::json::parse(src);
+    addResult(*results, "write/nlohmann", bench.run([&] {
+        sink = sink + static_cast<double>(json.dump().size());
+    }), compactSize, nodes);
+#endif
+#ifdef YOUNGJSON_BENCH_RAPIDJSON
+    addResult(*results, "parse/rapidjson", bench.run([&] {
+        rapidjson::Document d;
+        d.Parse(src.c_str(), src.size());
+        sink = sink + static_cast<double>(d.HasParseError());
+    }), src.size(), nodes);
+    rapidjson::Document rapid;
+    rapid.Parse(src.c_str(), src.size());
+    addResult(*results, "write/rapidjson", bench.run([&] {
+        rapidjson::StringBuffer buffer;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+        rapid.Accept(writer);
+        sink = sink + static_cast<double>(buffer.GetSize());
+    }), compactSize, nodes);
+#endif
+
+    auto res = make_shared<ValueObject>();
+    res->add("name", ValueString(corpus.name));
+    res->add("bytes", ValueNumber(src.size()));
+    res->add("nodes", ValueNumber(nodes));
+    res->add("results", results);
+    return res;
+}
+
+int main(int argc, char* argv[]) {
+    bool quick = false;
+    string out;
+    vector<Corpus> corpora;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--quick") {
+            quick = true;
+        } else if (arg == "--out" && i + 1 < argc) {
+            out = argv[++i];
+        } else if (!arg.empty() && arg[0] == '-') {
+            cerr << "usage: " << argv[0] << " [--quick] [--out results.json] [file.json ...]" << endl;
+            return 2;
+        } else {
+            ifstream in(arg, ios::binary);
+            if (!in) {
+                cerr << "can't open " << arg << endl;
+                return 1;
+            }
+            ostringstream text;
+            text << in.rdbuf();
+            corpora.push_back(Corpus{ arg, text.str() });
+        }
+    }
+
+    if (corpora.empty()) {
+        int scale = quick ? 1 : 10;
+        corpora.push_back(Corpus{ "twitter", makeTwitter(100 * scale) });
+        corpora.push_back(Corpus{ "citm", makeCitm(50 * scale) });
+        corpora.push_back(Corpus{ "canada", makeCanada(5000 * scale) });
+        corpora.push_back(Corpus{ "deep", makeDeep(1000) });
+        corpora.push_back(Corpus{ "wide", makeWide(10000 * scale) });
+        corpora.push_back(Corpus{ "strings", makeStrings(1000 * scale) });
+        corpora.push_back(Corpus{ "numbers", makeNumbers(10000 * scale) });
+    }
+
+    Bench bench(quick);
+    ValueObject report;
+    auto list = make_shared<ValueArray>();
+    try {
+        // The peak of the process only grows, so a corpus reports how much it raised it.
+        // Run a corpus alone for its own peak.
+        for (auto& corpus : corpora) {
+            size_t before = peakRssKb();
+            auto res = measure(corpus, bench);
+            res->add("peakRssGrowthKb", ValueNumber(peakRssKb() - before));
+            list->add(res);
+        }
+    } catch (exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    report.add("library", ValueString("youngJSON"));
+    if (quick)
+        report.add("quick", ValueTrue());
+    else
+        report.add("quick", ValueFalse());
+    report.add("corpora", list);
+    report.add("peakRssKb", ValueNumber(peakRssKb()));
+
+    string res = report.toString();
+    if (out.empty()) {
+        cout << res << endl;
+    } else {
+        ofstream os(out, ios::binary);
+        os << res << '\n';
+        if (!os) {
+            cerr << "can't write " << out << endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace youngJSON {
+
+// bump allocator : memory is only released all at once
+class JsonArena : public std::pmr::memory_resource {
+public:
+    static const size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+    static const size_t MAX_BLOCK_SIZE = 16 * 1024 * 1024;
+
+    explicit JsonArena(size_t blockSize = DEFAULT_BLOCK_SIZE)
+        : mHead(nullptr), mCur(nullptr), mEnd(nullptr),
+          mInitBlockSize(blockSize), mNextBlockSize(blockSize),
+          mBlockCount(0), mReservedBytes(0), mUsedBytes(0) {
+    }
+
+    ~JsonArena() {
+        release();
+    }
+
+    JsonArena(const JsonArena&) = delete;
+    JsonArena& operator =(const JsonArena&) = delete;
+
+    void* alloc(size_t size, size_t align = alignof(std::max_align_t)) {
+        char* p = alignUp(mCur, align);
+        if (p + size > mEnd || !mCur)
+            p = allocSlow(size, align);
+        mCur = p + size;
+        mUsedBytes += size;
+        return p;
+    }
+
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+        return new (alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    T* allocArray(size_t n) {
+        return static_cast<T*>(alloc(sizeof(T) * n, alignof(T)));
+    }
+
+    const char* copyString(const char* s, size_t length) {
+        char* p = static_cast<char*>(alloc(length + 1, 1));
+        memcpy(p, s, length);
+        p[length] = 0;
+        return p;
+    }
+
+    // keeps a heap-owned object alive until the arena is released
+    void retain(std::shared_ptr<const void> p) {
+        mRetained.push_back(std::move(p));
+    }
+
+    // frees every block except the last one, which is kept for reuse
+    void reset() {
+        mRetained.clear();
+        if (!mHead)
+            return;
+
+        Block* b = mHead->next;
+        while (b) {
+            Block* next = b->next;
+            ::operator delete(b);
+            b = next;
+        }
+        mHead->next = nullptr;
+        mCur = reinterpret_cast<char*>(mHead + 1);
+        mEnd = reinterpret_cast<char*>(mHead) + mHead->size;
+        mBlockCount = 1;
+        mReservedBytes = mHead->size;
+        mUsedBytes = 0;
+    }
+
+    void release() {
+        mRetained.clear();
+        while (mHead) {
+            Block* next = mHead->next;
+            ::operator delete(mHead);
+            mHead = next;
+        }
+        mCur = mEnd = nullptr;
+        mNextBlockSize = mInitBlockSize;
+        mBlockCount = 0;
+        mReservedBytes = 0;
+        mUsedBytes = 0;
+    }
+
+    size_t blockCount() const {
+        return mBlockCount;
+    }
+
+    size_t reservedBytes() const {
+        return mReservedBytes;
+    }
+
+    size_t usedBytes() const {
+        return mUsedBytes;
+    }
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        return alloc(bytes, alignment);
+    }
+
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+private:
+    struct Block {
+        Block*  next;
+        size_t  size;
+    };
+
+    static char* alignUp(char* p, size_t align) {
+        return reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(p) + align - 1) & ~(uintptr_t)(align - 1));
+    }
+
+    char* allocSlow(size_t size, size_t align) {
+        size_t need = size + align + sizeof(Block);
+        size_t blockSize = mNextBlockSize;
+        if (blockSize < need)
+            blockSize = need;
+        if (mNextBlockSize < MAX_BLOCK_SIZE)
+            mNextBlockSize *= 2;
+
+        // from operator new, so that a replaced one sees the blocks too
+        Block* b = static_cast<Block*>(::operator new(blockSize));
+        b->next = mHead;
+        b->size = blockSize;
+        mHead = b;
+
+        mCur = reinterpret_cast<char*>(b + 1);
+        mEnd = reinterpret_cast<char*>(b) + blockSize;
+        mBlockCount++;
+        mReservedBytes += blockSize;
+
+        return alignUp(mCur, align);
+    }
+
+private:
+    Block*  mHead;
+    char*   mCur;
+    char*   mEnd;
+
+    size_t  mInitBlockSize;
+    size_t  mNextBlockSize;
+
+    size_t  mBlockCount;
+    size_t  mReservedBytes;
+    size_t  mUsedBytes;
+
+    std::vector<std::shared_ptr<const void>> mRetained;
+};
+
+}
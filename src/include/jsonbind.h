@@ -0,0 +1,598 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "jsonparser.h"
+#include "jsonwriter.h"
+
+// Declares the members of a struct that fromJson and toJson read and write, at most 32:
+//     struct Point { int x; int y; std::optional<std::string> label; };
+//     YOUNGJSON_BIND(Point, x, y, label)
+// Use it at namespace scope, in the namespace of the struct.
+#define YOUNGJSON_BIND(Type, ...) \
+    constexpr auto youngJSONFields(const Type*) { \
+        using BoundType = Type; \
+        return youngJSON::bind::Fields(YOUNGJSON_FOR_EACH(YOUNGJSON_BIND_MEMBER, __VA_ARGS__)); \
+    }
+
+#define YOUNGJSON_BIND_MEMBER(name) youngJSON::bind::Member(#name, &BoundType::name)
+
+#define YOUNGJSON_EXPAND(x) x
+#define YOUNGJSON_FE_1(f, x) f(x)
+#define YOUNGJSON_FE_2(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_1(f, __VA_ARGS__))
+#define YOUNGJSON_FE_3(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_2(f, __VA_ARGS__))
+#define YOUNGJSON_FE_4(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_3(f, __VA_ARGS__))
+#define YOUNGJSON_FE_5(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_4(f, __VA_ARGS__))
+#define YOUNGJSON_FE_6(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_5(f, __VA_ARGS__))
+#define YOUNGJSON_FE_7(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_6(f, __VA_ARGS__))
+#define YOUNGJSON_FE_8(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_7(f, __VA_ARGS__))
+#define YOUNGJSON_FE_9(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_8(f, __VA_ARGS__))
+#define YOUNGJSON_FE_10(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_9(f, __VA_ARGS__))
+#define YOUNGJSON_FE_11(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_10(f, __VA_ARGS__))
+#define YOUNGJSON_FE_12(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_11(f, __VA_ARGS__))
+#define YOUNGJSON_FE_13(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_12(f, __VA_ARGS__))
+#define YOUNGJSON_FE_14(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_13(f, __VA_ARGS__))
+#define YOUNGJSON_FE_15(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_14(f, __VA_ARGS__))
+#define YOUNGJSON_FE_16(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_15(f, __VA_ARGS__))
+#define YOUNGJSON_FE_17(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_16(f, __VA_ARGS__))
+#define YOUNGJSON_FE_18(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_17(f, __VA_ARGS__))
+#define YOUNGJSON_FE_19(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_18(f, __VA_ARGS__))
+#define YOUNGJSON_FE_20(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_19(f, __VA_ARGS__))
+#define YOUNGJSON_FE_21(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_20(f, __VA_ARGS__))
+#define YOUNGJSON_FE_22(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_21(f, __VA_ARGS__))
+#define YOUNGJSON_FE_23(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_22(f, __VA_ARGS__))
+#define YOUNGJSON_FE_24(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_23(f, __VA_ARGS__))
+#define YOUNGJSON_FE_25(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_24(f, __VA_ARGS__))
+#define YOUNGJSON_FE_26(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_25(f, __VA_ARGS__))
+#define YOUNGJSON_FE_27(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_26(f, __VA_ARGS__))
+#define YOUNGJSON_FE_28(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_27(f, __VA_ARGS__))
+#define YOUNGJSON_FE_29(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_28(f, __VA_ARGS__))
+#define YOUNGJSON_FE_30(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_29(f, __VA_ARGS__))
+#define YOUNGJSON_FE_31(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_30(f, __VA_ARGS__))
+#define YOUNGJSON_FE_32(f, x, ...) f(x), YOUNGJSON_EXPAND(YOUNGJSON_FE_31(f, __VA_ARGS__))
+#define YOUNGJSON_FE_PICK( \
+    _1, _2, _3, _4, _5, _6, _7, _8, \
+    _9, _10, _11, _12, _13, _14, _15, _16, \
+    _17, _18, _19, _20, _21, _22, _23, _24, \
+    _25, _26, _27, _28, _29, _30, _31, _32, NAME, ...) NAME
+#define YOUNGJSON_FOR_EACH(f, ...) YOUNGJSON_EXPAND(YOUNGJSON_FE_PICK(__VA_ARGS__, \
+    YOUNGJSON_FE_32, YOUNGJSON_FE_31, YOUNGJSON_FE_30, YOUNGJSON_FE_29, \
+    YOUNGJSON_FE_28, YOUNGJSON_FE_27, YOUNGJSON_FE_26, YOUNGJSON_FE_25, \
+    YOUNGJSON_FE_24, YOUNGJSON_FE_23, YOUNGJSON_FE_22, YOUNGJSON_FE_21, \
+    YOUNGJSON_FE_20, YOUNGJSON_FE_19, YOUNGJSON_FE_18, YOUNGJSON_FE_17, \
+    YOUNGJSON_FE_16, YOUNGJSON_FE_15, YOUNGJSON_FE_14, YOUNGJSON_FE_13, \
+    YOUNGJSON_FE_12, YOUNGJSON_FE_11, YOUNGJSON_FE_10, YOUNGJSON_FE_9, \
+    YOUNGJSON_FE_8, YOUNGJSON_FE_7, YOUNGJSON_FE_6, YOUNGJSON_FE_5, \
+    YOUNGJSON_FE_4, YOUNGJSON_FE_3, YOUNGJSON_FE_2, YOUNGJSON_FE_1)(f, __VA_ARGS__))
+
+namespace youngJSON {
+
+namespace bind {
+
+constexpr uint32_t hashMember(std::string_view name, uint32_t seed) {
+    uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+    for (char ch : name) {
+        h ^= static_cast<unsigned char>(ch);
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+}
+
+template <typename Class, typename T>
+struct Member {
+    std::string_view    name;
+    T Class::*          pointer;
+
+    constexpr Member(std::string_view n, T Class::* p) : name(n), pointer(p) {
+    }
+};
+
+// Member names with a perfect hash found at compile time: a name is looked up with one
+// hash and one comparison.
+template <typename... Members>
+class Fields {
+public:
+    static constexpr size_t SIZE = sizeof...(Members);
+    static constexpr size_t CAPACITY = SIZE <= 4 ? 32 : SIZE <= 8 ? 64 : SIZE <= 16 ? 128 : 256;
+
+    static_assert(SIZE < 255, "too many members");
+
+    constexpr Fields(Members... members) : members(members...), names{ members.name... },
+                                           mTable{}, mSeed(0), mMask(0), mPerfect(false) {
+        for (size_t size = 8; size <= CAPACITY && !mPerfect; size *= 2) {
+            for (uint32_t seed = 0; seed < 256 && !mPerfect; seed++) {
+                if (tryTable(size, seed)) {
+                    mSeed = seed;
+                    mMask = static_cast<uint32_t>(size - 1);
+                    mPerfect = true;
+                }
+            }
+        }
+    }
+
+    // returns the index of the member, or SIZE
+    size_t find(std::string_view name) const {
+        if (mPerfect) {
+            uint8_t slot = mTable[hashMember(name, mSeed) & mMask];
+            return slot != 0 && names[slot - 1] == name ? slot - 1 : SIZE;
+        }
+        for (size_t i = 0; i < SIZE; i++) {
+            if (names[i] == name)
+                return i;
+        }
+        return SIZE;
+    }
+
+    std::tuple<Members...>                  members;
+    std::array<std::string_view, SIZE>      names;
+
+private:
+    constexpr bool tryTable(size_t size, uint32_t seed) {
+        for (size_t i = 0; i < CAPACITY; i++)
+            mTable[i] = 0;
+        for (size_t i = 0; i < SIZE; i++) {
+            uint8_t& slot = mTable[hashMember(names[i], seed) & (size - 1)];
+            if (slot != 0)
+                return false;
+            slot = static_cast<uint8_t>(i + 1);
+        }
+        return true;
+    }
+
+private:
+    std::array<uint8_t, CAPACITY>   mTable;     // index + 1, or 0
+    uint32_t                        mSeed;
+    uint32_t                        mMask;
+    bool                            mPerfect;
+};
+
+
+struct ValueOps;
+
+// where the next value is decoded
+struct Slot {
+    void*               target;
+    const ValueOps*     ops;
+};
+
+// an object or array being decoded; next returns the slot of a member or the next element
+struct Container {
+    void*   target;
+    Slot    (*next)(void* target, std::string_view name);
+    bool    isArray;
+};
+
+struct ValueOps {
+    void        (*null)(void* target);
+    void        (*boolean)(void* target, bool value);
+    void        (*number)(void* target, const JsonNumber& value);
+    void        (*string)(void* target, std::string_view value);
+    Container   (*startObject)(void* target);
+    Container   (*startArray)(void* target);
+};
+
+[[noreturn]] inline void unexpectedType() {
+    throw invalid_format_error("unexpected type");
+}
+
+// Codec<T> decodes events into a T and writes a T; a type without a codec can't be bound
+template <typename T, typename = void>
+struct Codec;
+
+struct Reject {
+    template <typename T>
+    static void null(T&) {
+        unexpectedType();
+    }
+
+    template <typename T>
+    static void boolean(T&, bool) {
+        unexpectedType();
+    }
+
+    template <typename T>
+    static void number(T&, const JsonNumber&) {
+        unexpectedType();
+    }
+
+    template <typename T>
+    static void string(T&, std::string_view) {
+        unexpectedType();
+    }
+
+    template <typename T>
+    static Container startObject(T&) {
+        unexpectedType();
+    }
+
+    template <typename T>
+    static Container startArray(T&) {
+        unexpectedType();
+    }
+};
+
+template <typename T>
+struct Ops {
+    static void null(void* p) {
+        Codec<T>::null(*static_cast<T*>(p));
+    }
+
+    static void boolean(void* p, bool value) {
+        Codec<T>::boolean(*static_cast<T*>(p), value);
+    }
+
+    static void number(void* p, const JsonNumber& value) {
+        Codec<T>::number(*static_cast<T*>(p), value);
+    }
+
+    static void string(void* p, std::string_view value) {
+        Codec<T>::string(*static_cast<T*>(p), value);
+    }
+
+    static Container startObject(void* p) {
+        return Codec<T>::startObject(*static_cast<T*>(p));
+    }
+
+    static Container startArray(void* p) {
+        return Codec<T>::startArray(*static_cast<T*>(p));
+    }
+
+    static constexpr ValueOps value = { &null, &boolean, &number, &string, &startObject, &startArray };
+};
+
+template <typename T>
+inline Slot slotOf(T& target) {
+    return Slot{ &target, &Ops<T>::value };
+}
+
+// drops unknown members
+struct Skip {
+    static void null(void*) {
+    }
+
+    static void boolean(void*, bool) {
+    }
+
+    static void number(void*, const JsonNumber&) {
+    }
+
+    static void string(void*, std::string_view) {
+    }
+
+    static Slot next(void*, std::string_view) {
+        return Slot{ nullptr, &value };
+    }
+
+    static Container startObject(void*) {
+        return Container{ nullptr, &next, false };
+    }
+
+    static Container startArray(void*) {
+        return Container{ nullptr, &next, true };
+    }
+
+    static constexpr ValueOps value = { &null, &boolean, &number, &string, &startObject, &startArray };
+};
+
+template <>
+struct Codec<bool> : Reject {
+    static void boolean(bool& out, bool value) {
+        out = value;
+    }
+
+    static void write(bool value, JsonWriter& writer) {
+        writer.boolean(value);
+    }
+};
+
+// integers must be in the range of the type
+template <typename T>
+struct Codec<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> : Reject {
+    static void number(T& out, const JsonNumber& value) {
+        using Limits = std::numeric_limits<T>;
+        bool inRange = false;
+        if (value.kind == nkInt64) {
+            if constexpr (std::is_signed<T>::value)
+                inRange = value.i >= static_cast<long long>(Limits::min()) && value.i <= static_cast<long long>(Limits::max());
+            else
+                inRange = value.i >= 0 && static_cast<unsigned long long>(value.i) <= static_cast<unsigned long long>(Limits::max());
+        } else if (value.kind == nkUInt64) {
+            inRange = value.u <= static_cast<unsigned long long>(Limits::max());
+        } else {
+            unexpectedType();
+        }
+        if (!inRange)
+            throw invalid_format_error("number out of range");
+        out = value.kind == nkInt64 ? static_cast<T>(value.i) : static_cast<T>(value.u);
+    }
+
+    static void write(T value, JsonWriter& writer) {
+        JsonNumber number;
+        if constexpr (std::is_signed<T>::value) {
+            number.kind = nkInt64;
+            number.i = value;
+        } else {
+            number.kind = nkUInt64;
+            number.u = value;
+        }
+        writer.number(number);
+    }
+};
+
+template <typename T>
+struct Codec<T, typename std::enable_if<std::is_floating_point<T>::value>::type> : Reject {
+    static void number(T& out, const JsonNumber& value) {
+        out = static_cast<T>(value.toDouble());
+    }
+
+    static void write(T value, JsonWriter& writer) {
+        JsonNumber number;
+        number.kind = nkDouble;
+        number.d = static_cast<double>(value);
+        writer.number(number);
+    }
+};
+
+template <>
+struct Codec<std::string> : Reject {
+    static void string(std::string& out, std::string_view value) {
+        out.assign(value.data(), value.length());
+    }
+
+    static void write(const std::string& value, JsonWriter& writer) {
+        writer.string(value);
+    }
+};
+
+// null resets the value; a member that has no value isn't written
+template <typename T>
+struct Codec<std::optional<T>> {
+    static void null(std::optional<T>& out) {
+        out.reset();
+    }
+
+    static void boolean(std::optional<T>& out, bool value) {
+        Codec<T>::boolean(out.emplace(), value);
+    }
+
+    static void number(std::optional<T>& out, const JsonNumber& value) {
+        Codec<T>::number(out.emplace(), value);
+    }
+
+    static void string(std::optional<T>& out, std::string_view value) {
+        Codec<T>::string(out.emplace(), value);
+    }
+
+    static Container startObject(std::optional<T>& out) {
+        return Codec<T>::startObject(out.emplace());
+    }
+
+    static Container startArray(std::optional<T>& out) {
+        return Codec<T>::startArray(out.emplace());
+    }
+
+    static void write(const std::optional<T>& value, JsonWriter& writer) {
+        if (value)
+            Codec<T>::write(*value, writer);
+        else
+            writer.null();
+    }
+};
+
+template <typename T, typename Allocator>
+struct Codec<std::vector<T, Allocator>> : Reject {
+    static_assert(!std::is_same<T, bool>::value, "std::vector<bool> can't be bound");
+
+    using Vector = std::vector<T, Allocator>;
+
+    static Container startArray(Vector& out) {
+        out.clear();
+        return Container{ &out, &next, true };
+    }
+
+    static Slot next(void* target, std::string_view) {
+        return slotOf(static_cast<Vector*>(target)->emplace_back());
+    }
+
+    static void write(const Vector& value, JsonWriter& writer) {
+        writer.startArray();
+        for (auto& it : value)
+            Codec<T>::write(it, writer);
+        writer.endArray();
+    }
+};
+
+// a duplicate name keeps the last value
+template <typename Map>
+struct MapCodec : Reject {
+    using Mapped = typename Map::mapped_type;
+
+    static Container startObject(Map& out) {
+        out.clear();
+        return Container{ &out, &next, false };
+    }
+
+    static Slot next(void* target, std::string_view name) {
+        return slotOf((*static_cast<Map*>(target))[std::string(name.data(), name.length())]);
+    }
+
+    static void write(const Map& value, JsonWriter& writer) {
+        writer.startObject();
+        for (auto& it : value) {
+            writer.key(it.first);
+            Codec<Mapped>::write(it.second, writer);
+        }
+        writer.endObject();
+    }
+};
+
+template <typename T, typename Compare, typename Allocator>
+struct Codec<std::map<std::string, T, Compare, Allocator>> : MapCodec<std::map<std::string, T, Compare, Allocator>> {
+};
+
+template <typename T, typename Hash, typename Equal, typename Allocator>
+struct Codec<std::unordered_map<std::string, T, Hash, Equal, Allocator>>
+    : MapCodec<std::unordered_map<std::string, T, Hash, Equal, Allocator>> {
+};
+
+template <typename T>
+using FieldsOf = decltype(youngJSONFields(static_cast<const T*>(nullptr)));
+
+// a struct declared with YOUNGJSON_BIND; members missing from the input keep their value
+// and unknown members are skipped
+template <typename T>
+struct Codec<T, std::void_t<FieldsOf<T>>> : Reject {
+    static constexpr FieldsOf<T> fields = youngJSONFields(static_cast<const T*>(nullptr));
+
+    static Container startObject(T& out) {
+        return Container{ &out, &next, false };
+    }
+
+    static Slot next(void* target, std::string_view name) {
+        size_t index = fields.find(name);
+        if (index == fields.SIZE)
+            return Slot{ nullptr, &Skip::value };
+        return slots[index](*static_cast<T*>(target));
+    }
+
+    static void write(const T& value, JsonWriter& writer) {
+        writer.startObject();
+        std::apply([&](const auto&... member) {
+            (writeMember(value.*member.pointer, member.name, writer), ...);
+        }, fields.members);
+        writer.endObject();
+    }
+
+private:
+    template <size_t I>
+    static Slot memberSlot(T& target) {
+        return slotOf(target.*std::get<I>(fields.members).pointer);
+    }
+
+    template <size_t... I>
+    static constexpr std::array<Slot (*)(T&), sizeof...(I)> makeSlots(std::index_sequence<I...>) {
+        return { { &memberSlot<I>... } };
+    }
+
+    static constexpr auto slots = makeSlots(std::make_index_sequence<FieldsOf<T>::SIZE>());
+
+    template <typename M>
+    static void writeMember(const M& value, std::string_view name, JsonWriter& writer) {
+        writer.key(name);
+        Codec<M>::write(value, writer);
+    }
+
+    template <typename M>
+    static void writeMember(const std::optional<M>& value, std::string_view name, JsonWriter& writer) {
+        if (!value)
+            return;
+        writer.key(name);
+        Codec<M>::write(*value, writer);
+    }
+};
+
+// passes the events of a parse to the codecs
+class Handler {
+public:
+    explicit Handler(Slot root) : mRoot(root), mMember{ nullptr, nullptr } {
+    }
+
+    void null() {
+        Slot slot = next();
+        slot.ops->null(slot.target);
+    }
+
+    void boolean(bool value) {
+        Slot slot = next();
+        slot.ops->boolean(slot.target, value);
+    }
+
+    void number(const JsonNumber& value, std::string_view lexeme) {
+        Slot slot = next();
+        slot.ops->number(slot.target, value);
+    }
+
+    void string(std::string_view s) {
+        Slot slot = next();
+        slot.ops->string(slot.target, s);
+    }
+
+    void key(std::string_view name) {
+        Container& top = mStack.back();
+        mMember = top.next(top.target, name);
+    }
+
+    void startObject() {
+        Slot slot = next();
+        mStack.push_back(slot.ops->startObject(slot.target));
+    }
+
+    void endObject() {
+        mStack.pop_back();
+    }
+
+    void startArray() {
+        Slot slot = next();
+        mStack.push_back(slot.ops->startArray(slot.target));
+    }
+
+    void endArray() {
+        mStack.pop_back();
+    }
+
+private:
+    Slot next() {
+        if (mStack.empty())
+            return mRoot;
+        Container& top = mStack.back();
+        return top.isArray ? top.next(top.target, std::string_view()) : mMember;
+    }
+
+private:
+    Slot                    mRoot;
+    Slot                    mMember;
+    std::vector<Container>  mStack;
+};
+
+}
+
+
+// Parses src straight into value without building a tree. value may be a struct declared
+// with YOUNGJSON_BIND, bool, a number, std::string, std::optional, std::vector, or a map
+// from std::string. A value of another JSON type throws invalid_format_error.
+template <typename T>
+void fromJson(JsonReader& reader, const unsigned char* src, int length, T& value) {
+    bind::Handler handler(bind::slotOf(value));
+    reader.parse(src, length, handler);
+}
+
+template <typename T>
+void fromJson(JsonReader& reader, const std::string& src, T& value) {
+    fromJson(reader, (const unsigned char*)src.data(), inputLength(src.length()), value);
+}
+
+template <typename T>
+void toJson(const T& value, JsonWriter& writer) {
+    bind::Codec<T>::write(value, writer);
+}
+
+template <typename T>
+std::string toJson(const T& value) {
+    std::string res;
+    JsonWriter writer(res);
+    toJson(value, writer);
+    return res;
+}
+
+}
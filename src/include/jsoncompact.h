@@ -0,0 +1,414 @@
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "jsonarena.h"
+#include "jsonvalue.h"
+
+namespace youngJSON {
+
+// 16-byte tagged value.
+//  - number : 8-byte payload (int64 / uint64 / double)
+//  - string : up to 15 bytes inline, otherwise pointer + length
+//  - object : pointer to 2 * size() values (key, value, key, value, ...)
+//  - array  : pointer to size() values
+// Children of a container are stored contiguously in the arena of a CompactDocument.
+class CompactValue {
+public:
+    static const size_t MAX_INLINE_LENGTH = 15;
+
+    CompactValue() {
+        memset(mData, 0, sizeof(mData));
+        mTag = vtNull;
+    }
+
+    explicit CompactValue(ValueTypeT type) : CompactValue() {
+        mTag = static_cast<unsigned char>(type);
+    }
+
+    explicit CompactValue(long long value) : CompactValue() {
+        setPayload(value);
+        mTag = vtNumber | (nkInt64 << 3);
+    }
+
+    explicit CompactValue(unsigned long long value) : CompactValue() {
+        setPayload(value);
+        mTag = vtNumber | (nkUInt64 << 3);
+    }
+
+    explicit CompactValue(double value) : CompactValue() {
+        setPayload(value);
+        mTag = vtNumber | (nkDouble << 3);
+    }
+
+    explicit CompactValue(const JsonNumber& value) : CompactValue() {
+        setPayload(value.u);
+        mTag = static_cast<unsigned char>(vtNumber | (value.kind << 3));
+    }
+
+    // short strings are stored inline, others must outlive this value
+    CompactValue(const char* s, size_t length) : CompactValue() {
+        if (length <= MAX_INLINE_LENGTH) {
+            memcpy(mData, s, length);
+            mTag = static_cast<unsigned char>(vtString | 0x08 | (length << 4));
+        } else {
+            setPayload(s);
+            setLength(length);
+            mTag = vtString;
+        }
+    }
+
+    CompactValue(const char* s, size_t length, JsonArena& arena)
+        : CompactValue(length <= MAX_INLINE_LENGTH ? s : arena.copyString(s, length), length) {
+    }
+
+    // children must outlive this value
+    CompactValue(ValueTypeT type, const CompactValue* children, size_t size) : CompactValue() {
+        setPayload(children);
+        setLength(size);
+        mTag = static_cast<unsigned char>(type);
+    }
+
+    ValueTypeT type() const {
+        return static_cast<ValueTypeT>(mTag & 0x07);
+    }
+
+    NumberKindT numberKind() const {
+        return static_cast<NumberKindT>((mTag >> 3) & 0x03);
+    }
+
+    bool isNull() const {
+        return type() == vtNull;
+    }
+
+    bool isTrue() const {
+        return type() == vtTrue;
+    }
+
+    bool isFalse() const {
+        return type() == vtFalse;
+    }
+
+    bool isBool() const {
+        return type() == vtTrue || type() == vtFalse;
+    }
+
+    bool isNumber() const {
+        return type() == vtNumber;
+    }
+
+    bool isString() const {
+        return type() == vtString;
+    }
+
+    bool isObject() const {
+        return type() == vtObject;
+    }
+
+    bool isArray() const {
+        return type() == vtArray;
+    }
+
+    bool toBool() const {
+        switch (type()) {
+        case vtTrue:
+            return true;
+        case vtNumber:
+            return toDouble() != 0.0;
+        case vtString:
+            return !toStringView().empty();
+        case vtObject:
+        case vtArray:
+            return size() > 0;
+        default:
+            return false;
+        }
+    }
+
+    int toInt32() const {
+        return static_cast<int>(toInt64());
+    }
+
+    long long toInt64() const {
+        switch (type()) {
+        case vtTrue:
+            return 1ll;
+        case vtNumber:
+            return toNumber().toInt64();
+        case vtString:
+            return std::stoll(toRawString());
+        default:
+            return 0ll;
+        }
+    }
+
+    unsigned int toUInt32() const {
+        return static_cast<unsigned int>(toUInt64());
+    }
+
+    unsigned long long toUInt64() const {
+        switch (type()) {
+        case vtTrue:
+            return 1ull;
+        case vtNumber:
+            return toNumber().toUInt64();
+        case vtString:
+            return std::stoull(toRawString());
+        default:
+            return 0ull;
+        }
+    }
+
+    double toDouble() const {
+        switch (type()) {
+        case vtTrue:
+            return 1.0;
+        case vtNumber:
+            return toNumber().toDouble();
+        case vtString:
+            return std::stod(toRawString());
+        default:
+            return 0.0;
+        }
+    }
+
+    JsonNumber toNumber() const {
+        JsonNumber res;
+        if (type() == vtNumber) {
+            res.kind = numberKind();
+            res.u = payload<unsigned long long>();
+        }
+        return res;
+    }
+
+    std::string_view toStringView() const {
+        if (type() != vtString)
+            return std::string_view();
+        if (mTag & 0x08)
+            return std::string_view(reinterpret_cast<const char*>(mData), mTag >> 4);
+        return std::string_view(payload<const char*>(), length());
+    }
+
+    std::string toRawString() const {
+        if (type() == vtString) {
+            auto s = toStringView();
+            return std::string(s.data(), s.length());
+        }
+        return toStringIndent(0);
+    }
+
+    std::string toString() const {
+        return toStringIndent(0);
+    }
+
+    std::string toStringIndent(int indentation) const {
+        std::string res;
+        JsonWriter writer(res, 2);
+        writer.setBaseIndent(indentation);
+        write(writer);
+        return res;
+    }
+
+    std::string toCompactString() const {
+        std::string res;
+        JsonWriter writer(res);
+        write(writer);
+        return res;
+    }
+
+    void write(JsonWriter& writer) const {
+        switch (type()) {
+        case vtNull:
+            writer.null();
+            break;
+        case vtFalse:
+            writer.boolean(false);
+            break;
+        case vtTrue:
+            writer.boolean(true);
+            break;
+        case vtNumber:
+            writer.number(toNumber());
+            break;
+        case vtString:
+            writer.string(toStringView());
+            break;
+        case vtObject:
+        {
+            writer.startObject();
+            const CompactValue* p = children();
+            for (int i = 0; i < size(); i++, p += 2) {
+                writer.key(p->toStringView());
+                p[1].write(writer);
+            }
+            writer.endObject();
+            break;
+        }
+        case vtArray:
+        {
+            writer.startArray();
+            const CompactValue* p = children();
+            for (int i = 0; i < size(); i++)
+                p[i].write(writer);
+            writer.endArray();
+            break;
+        }
+        }
+    }
+
+    int size() const {
+        if (type() == vtObject || type() == vtArray)
+            return static_cast<int>(length());
+        return 0;
+    }
+
+    const CompactValue& get(int index) const {
+        if (type() != vtArray)
+            throw std::invalid_argument("can't be accessed by index");
+        if (index < 0 || index >= size())
+            throw std::out_of_range("index out of range");
+        return children()[index];
+    }
+
+    const CompactValue& get(std::string_view name) const {
+        if (type() != vtObject)
+            throw std::invalid_argument("can't be accessed by name");
+
+        const CompactValue* p = children();
+        const CompactValue* pEnd = p + 2 * length();
+        for (; p < pEnd; p += 2) {
+            if (p->toStringView() == name)
+                return p[1];
+        }
+        throw std::invalid_argument("can't find the name");
+    }
+
+    const CompactValue& operator [](std::string_view name) const {
+        return get(name);
+    }
+
+    const CompactValue& operator [](int idx) const {
+        return get(idx);
+    }
+
+    // objects : fn(std::string_view name, const CompactValue& value)
+    // arrays  : fn(int index, const CompactValue& value)
+    template <typename Function>
+    void forEach(Function fn) const {
+        if constexpr (std::is_invocable<Function, std::string_view, const CompactValue&>::value) {
+            if (type() != vtObject)
+                return;
+            const CompactValue* p = children();
+            for (int i = 0; i < size(); i++, p += 2)
+                fn(p->toStringView(), p[1]);
+        } else {
+            if (type() != vtArray)
+                return;
+            const CompactValue* p = children();
+            for (int i = 0; i < size(); i++)
+                fn(i, p[i]);
+        }
+    }
+
+private:
+    template <typename T>
+    T payload() const {
+        T res;
+        memcpy(&res, mData, sizeof(T));
+        return res;
+    }
+
+    template <typename T>
+    void setPayload(T value) {
+        memcpy(mData, &value, sizeof(T));
+    }
+
+    unsigned int length() const {
+        unsigned int res;
+        memcpy(&res, mData + 8, sizeof(res));
+        return res;
+    }
+
+    void setLength(size_t length) {
+        unsigned int n = static_cast<unsigned int>(length);
+        memcpy(mData + 8, &n, sizeof(n));
+    }
+
+    const CompactValue* children() const {
+        return payload<const CompactValue*>();
+    }
+
+private:
+    alignas(8) unsigned char mData[15];
+    unsigned char mTag;
+};
+
+static_assert(sizeof(CompactValue) == 16, "CompactValue must be 16 bytes");
+
+
+// owns the arena where the compact tree of one parse lives
+class CompactDocument {
+public:
+    explicit CompactDocument(size_t blockSize = JsonArena::DEFAULT_BLOCK_SIZE)
+        : mArena(new JsonArena(blockSize)) {
+    }
+
+    CompactDocument(CompactDocument&& rhs) noexcept : mArena(std::move(rhs.mArena)), mRoot(rhs.mRoot) {
+        rhs.mRoot = CompactValue();
+    }
+
+    CompactDocument& operator =(CompactDocument&& rhs) noexcept {
+        mArena = std::move(rhs.mArena);
+        mRoot = rhs.mRoot;
+        rhs.mRoot = CompactValue();
+        return *this;
+    }
+
+    CompactDocument(const CompactDocument&) = delete;
+    CompactDocument& operator =(const CompactDocument&) = delete;
+
+    const CompactValue& root() const {
+        return mRoot;
+    }
+
+    const CompactValue& operator [](std::string_view name) const {
+        return mRoot.get(name);
+    }
+
+    const CompactValue& operator [](int idx) const {
+        return mRoot.get(idx);
+    }
+
+    JsonArena& arena() {
+        if (!mArena)
+            mArena.reset(new JsonArena());
+        return *mArena;
+    }
+
+    // a moved-from document reports an empty arena
+    const JsonArena& arena() const {
+        static const JsonArena empty;
+        return mArena ? *mArena : empty;
+    }
+
+    void setRoot(const CompactValue& root) {
+        mRoot = root;
+    }
+
+    void clear() {
+        mRoot = CompactValue();
+        if (mArena)
+            mArena->reset();
+    }
+
+private:
+    std::unique_ptr<JsonArena>  mArena;
+    CompactValue                mRoot;
+};
+
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <memory>
+#include <type_traits>
+
+#include "jsonarena.h"
+#include "jsonvalue.h"
+
+namespace youngJSON {
+
+// owns every node, key and string of a parsed tree in one arena.
+// The tree is not destroyed node by node; the arena is freed at once.
+class JsonDocument {
+public:
+    explicit JsonDocument(size_t blockSize = JsonArena::DEFAULT_BLOCK_SIZE)
+        : mArena(new JsonArena(blockSize)), mRoot(nullptr) {
+    }
+
+    JsonDocument(JsonDocument&& rhs) noexcept : mArena(std::move(rhs.mArena)), mRoot(rhs.mRoot) {
+        rhs.mRoot = nullptr;
+    }
+
+    JsonDocument& operator =(JsonDocument&& rhs) noexcept {
+        mArena = std::move(rhs.mArena);
+        mRoot = rhs.mRoot;
+        rhs.mRoot = nullptr;
+        return *this;
+    }
+
+    JsonDocument(const JsonDocument&) = delete;
+    JsonDocument& operator =(const JsonDocument&) = delete;
+
+    bool empty() const {
+        return mRoot == nullptr;
+    }
+
+    const JsonValue& root() const {
+        if (!mRoot)
+            throw std::invalid_argument("empty document");
+        return *mRoot;
+    }
+
+    JsonValue& root() {
+        if (!mRoot)
+            throw std::invalid_argument("empty document");
+        return *mRoot;
+    }
+
+    const JsonValue& operator [](const std::string& name) const {
+        return root().get(name);
+    }
+
+    JsonValue& operator [](const std::string& name) {
+        return root().get(name);
+    }
+
+    const JsonValue& operator [](int idx) const {
+        return root().get(idx);
+    }
+
+    JsonValue& operator [](int idx) {
+        return root().get(idx);
+    }
+
+    JsonArena& arena() {
+        if (!mArena)
+            mArena.reset(new JsonArena());
+        return *mArena;
+    }
+
+    // a moved-from document reports an empty arena
+    const JsonArena& arena() const {
+        static const JsonArena empty;
+        return mArena ? *mArena : empty;
+    }
+
+    // returns a non-owning pointer; the node lives as long as the document
+    template <typename T, typename... Args>
+    std::shared_ptr<T> create(Args&&... args) {
+        T* p;
+        if constexpr (std::is_constructible<T, Args..., std::pmr::memory_resource*>::value)
+            p = arena().template create<T>(std::forward<Args>(args)..., static_cast<std::pmr::memory_resource*>(&arena()));
+        else
+            p = arena().template create<T>(std::forward<Args>(args)...);
+        return std::shared_ptr<T>(std::shared_ptr<T>(), p);
+    }
+
+    void setRoot(JsonValue* root) {
+        mRoot = root;
+    }
+
+    // drops the tree and keeps one arena block for the next parse
+    void clear() {
+        mRoot = nullptr;
+        if (mArena)
+            mArena->reset();
+    }
+
+private:
+    std::unique_ptr<JsonArena>  mArena;
+    JsonValue*                  mRoot;
+};
+
+}
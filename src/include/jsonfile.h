@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cerrno>
+#include <string>
+#include <system_error>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace youngJSON {
+
+// Read-only memory mapping of a whole file. The parsers never read past the end of their
+// input, so the mapping needs no padding. A file that is read in order is mapped with
+// sequential read-ahead; pass sequential = false for random access.
+class MappedFile {
+public:
+    MappedFile() : mData(nullptr), mSize(0) {
+    }
+
+    explicit MappedFile(const std::string& path, bool sequential = true) : MappedFile() {
+        open(path, sequential);
+    }
+
+    ~MappedFile() {
+        close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator =(const MappedFile&) = delete;
+
+    void open(const std::string& path, bool sequential = true) {
+        close();
+
+#ifdef _WIN32
+        HANDLE file = ::CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            throw std::system_error(static_cast<int>(::GetLastError()), std::system_category(), "can't open " + path);
+
+        LARGE_INTEGER size;
+        if (!::GetFileSizeEx(file, &size)) {
+            DWORD error = ::GetLastError();
+            ::CloseHandle(file);
+            throw std::system_error(static_cast<int>(error), std::system_category(), "can't stat " + path);
+        }
+
+        if (size.QuadPart > 0) {
+            HANDLE mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            DWORD error = ::GetLastError();
+            ::CloseHandle(file);
+            if (!mapping)
+                throw std::system_error(static_cast<int>(error), std::system_category(), "can't map " + path);
+
+            mData = static_cast<const char*>(::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            error = ::GetLastError();
+            ::CloseHandle(mapping);
+            if (!mData)
+                throw std::system_error(static_cast<int>(error), std::system_category(), "can't map " + path);
+        } else {
+            ::CloseHandle(file);
+        }
+        mSize = static_cast<size_t>(size.QuadPart);
+#else
+        int fd;
+        do {
+            fd = ::open(path.c_str(), O_RDONLY);
+        } while (fd < 0 && errno == EINTR);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), "can't open " + path);
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "can't stat " + path);
+        }
+
+        // an empty file can't be mapped
+        if (st.st_size > 0) {
+            void* p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            int error = errno;
+            ::close(fd);
+            if (p == MAP_FAILED)
+                throw std::system_error(error, std::generic_category(), "can't map " + path);
+            ::madvise(p, static_cast<size_t>(st.st_size), sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+            mData = static_cast<const char*>(p);
+        } else {
+            ::close(fd);
+        }
+        mSize = static_cast<size_t>(st.st_size);
+#endif
+    }
+
+    void close() {
+        if (mData) {
+#ifdef _WIN32
+            ::UnmapViewOfFile(mData);
+#else
+            ::munmap(const_cast<char*>(mData), mSize);
+#endif
+        }
+        mData = nullptr;
+        mSize = 0;
+    }
+
+    const char* data() const {
+        return mData;
+    }
+
+    size_t size() const {
+        return mSize;
+    }
+
+private:
+    const char*     mData;
+    size_t          mSize;
+};
+
+}
@@ -0,0 +1,524 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "jsonparser.h"
+
+namespace youngJSON {
+
+class LazyValue;
+
+// Parses on demand. parse() only builds the structural index of the input, checks that
+// strings are closed and brackets are balanced, and records where every container ends.
+// A value is decoded when it is reached, and lookups skip sibling containers in one step,
+// so reading a few fields of a large document costs little more than the pre-pass.
+// Errors inside values that are never reached are not reported.
+//
+// A duplicate name finds its last value, as in the DOM, but size() and forEach see every
+// member as it is written. Values of a parsed document may be read from several threads.
+//
+// The input is borrowed and must outlive the document and its values.
+class LazyDocument {
+public:
+    LazyDocument() : mSrc(nullptr), mLength(0), mArena(1024) {
+    }
+
+    LazyDocument(const LazyDocument&) = delete;
+    LazyDocument& operator =(const LazyDocument&) = delete;
+
+    void parse(const unsigned char* src, int length) {
+        mSrc = nullptr;
+        mLength = 0;
+        mDecoded.clear();
+        mArena.reset();
+        if (length <= 0 || !mIndex.build(src, length))
+            throw invalid_format_error();
+
+        // the sentinel is the last entry
+        const uint32_t count = static_cast<uint32_t>(mIndex.size()) - 1;
+        mEnds.assign(count, 0);
+        mOpen.clear();
+        for (uint32_t i = 0; i < count; i++) {
+            unsigned char ch = src[mIndex[i]];
+            if (ch == '{' || ch == '[') {
+                mOpen.push_back(i);
+            } else if (ch == '}' || ch == ']') {
+                if (mOpen.empty() || src[mIndex[mOpen.back()]] != (ch == '}' ? '{' : '['))
+                    throw invalid_format_error();
+                mEnds[mOpen.back()] = i;
+                mOpen.pop_back();
+            }
+            if (mOpen.empty() && i + 1 < count)
+                throw invalid_format_error();
+        }
+        if (!mOpen.empty())
+            throw invalid_format_error();
+
+        mSrc = src;
+        mLength = static_cast<size_t>(length);
+    }
+
+    void parse(const std::string& src) {
+        parse((const unsigned char*)src.data(), inputLength(src.length()));
+    }
+
+    // the input must outlive the document
+    void parse(std::string&& src) = delete;
+
+    LazyValue root() const;
+    LazyValue operator [](std::string_view name) const;
+    LazyValue operator [](int idx) const;
+
+private:
+    friend class LazyValue;
+
+    // receives the single string of a slice
+    struct StringHandler {
+        std::string& out;
+
+        void null() {
+        }
+
+        void boolean(bool) {
+        }
+
+        void number(const JsonNumber&, std::string_view) {
+        }
+
+        void string(std::string_view s) {
+            out.assign(s.data(), s.length());
+        }
+
+        void key(std::string_view) {
+        }
+
+        void startObject() {
+        }
+
+        void endObject() {
+        }
+
+        void startArray() {
+        }
+
+        void endArray() {
+        }
+    };
+
+    unsigned char token(uint32_t entry) const {
+        return mSrc[mIndex[entry]];
+    }
+
+    // the entry after the value that starts at entry
+    uint32_t skip(uint32_t entry) const {
+        unsigned char ch = token(entry);
+        return (ch == '{' || ch == '[') ? mEnds[entry] + 1 : entry + 1;
+    }
+
+    std::string_view raw(uint32_t entry) const {
+        const char* first = reinterpret_cast<const char*>(mSrc + mIndex[entry]);
+        unsigned char ch = token(entry);
+        if (ch == '{' || ch == '[')
+            return std::string_view(first, mIndex[mEnds[entry]] + 1 - mIndex[entry]);
+
+        // a scalar ends where whitespace before the next entry begins
+        size_t last = mIndex[entry + 1];
+        while (last > mIndex[entry] && isJsonSpace(mSrc[last - 1]))
+            --last;
+        return std::string_view(first, last - mIndex[entry]);
+    }
+
+    // the characters of an escape-free string in the input, or a null view
+    std::string_view plainString(uint32_t entry) const {
+        std::string_view s = raw(entry);
+        const unsigned char* first = reinterpret_cast<const unsigned char*>(s.data()) + 1;
+        const unsigned char* last = reinterpret_cast<const unsigned char*>(s.data() + s.length());
+        const unsigned char* special = findStringSpecial(first, last);
+        if (special + 1 == last && *special == '\"')
+            return std::string_view(reinterpret_cast<const char*>(first), special - first);
+        return std::string_view();
+    }
+
+    // escape-free strings are returned as a slice of the input, others are decoded into buf
+    std::string_view decodeString(uint32_t entry, std::string& buf) const {
+        std::string_view plain = plainString(entry);
+        if (plain.data())
+            return plain;
+
+        std::string_view s = raw(entry);
+        StringHandler handler{ buf };
+        JsonReader().parse(reinterpret_cast<const unsigned char*>(s.data()), inputLength(s.length()), handler);
+        return buf;
+    }
+
+    // a string with escapes is decoded once and stays in the arena as long as the document
+    std::string_view string(uint32_t entry) const {
+        std::string_view plain = plainString(entry);
+        if (plain.data())
+            return plain;
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mDecoded.find(entry);
+        if (it == mDecoded.end()) {
+            std::string buf;
+            decodeString(entry, buf);
+            it = mDecoded.emplace(entry, std::string_view(mArena.copyString(buf.data(), buf.length()), buf.length())).first;
+        }
+        return it->second;
+    }
+
+    JsonNumber number(uint32_t entry) const {
+        std::string_view s = raw(entry);
+        JsonNumber res;
+        if (parseNumber(s.data(), s.data() + s.length(), res) != s.data() + s.length())
+            throw invalid_format_error();
+        return res;
+    }
+
+    // calls fn(keyEntry, valueEntry) until it returns false
+    template <typename Function>
+    void walkObject(uint32_t entry, Function fn) const {
+        const uint32_t end = mEnds[entry];
+        uint32_t i = entry + 1;
+        if (i == end)
+            return;
+        while (true) {
+            if (i + 2 >= end || token(i) != '\"' || token(i + 1) != ':')
+                throw invalid_format_error();
+            if (!fn(i, i + 2))
+                return;
+            i = skip(i + 2);
+            if (i == end)
+                return;
+            if (token(i) != ',')
+                throw invalid_format_error();
+            ++i;
+        }
+    }
+
+    // calls fn(valueEntry) until it returns false
+    template <typename Function>
+    void walkArray(uint32_t entry, Function fn) const {
+        const uint32_t end = mEnds[entry];
+        uint32_t i = entry + 1;
+        if (i == end)
+            return;
+        while (true) {
+            if (i >= end)
+                throw invalid_format_error();
+            if (!fn(i))
+                return;
+            i = skip(i);
+            if (i == end)
+                return;
+            if (token(i) != ',')
+                throw invalid_format_error();
+            ++i;
+        }
+    }
+
+private:
+    const unsigned char*    mSrc;
+    size_t                  mLength;
+    StructuralIndex         mIndex;
+    std::vector<uint32_t>   mEnds;      // entry of the closing bracket of each container
+    std::vector<uint32_t>   mOpen;
+
+    // strings with escapes by entry
+    mutable std::mutex                                      mMutex;
+    mutable std::unordered_map<uint32_t, std::string_view>  mDecoded;
+    mutable JsonArena                                       mArena;
+};
+
+
+// a position in a LazyDocument; values are decoded by the accessors
+class LazyValue {
+public:
+    ValueTypeT type() const {
+        switch (mDoc->token(mEntry)) {
+        case '{':
+            return vtObject;
+        case '[':
+            return vtArray;
+        case '\"':
+            return vtString;
+        case 't':
+            checkKeyword("true");
+            return vtTrue;
+        case 'f':
+            checkKeyword("false");
+            return vtFalse;
+        case 'n':
+            checkKeyword("null");
+            return vtNull;
+        default:
+            return vtNumber;
+        }
+    }
+
+    bool isNull() const {
+        return type() == vtNull;
+    }
+
+    bool isTrue() const {
+        return type() == vtTrue;
+    }
+
+    bool isFalse() const {
+        return type() == vtFalse;
+    }
+
+    bool isBool() const {
+        return isTrue() || isFalse();
+    }
+
+    bool isNumber() const {
+        return type() == vtNumber;
+    }
+
+    bool isString() const {
+        return type() == vtString;
+    }
+
+    bool isObject() const {
+        return type() == vtObject;
+    }
+
+    bool isArray() const {
+        return type() == vtArray;
+    }
+
+    bool toBool() const {
+        switch (type()) {
+        case vtTrue:
+            return true;
+        case vtNumber:
+            return toDouble() != 0.0;
+        case vtString:
+            return !toStringView().empty();
+        case vtObject:
+        case vtArray:
+            return size() > 0;
+        default:
+            return false;
+        }
+    }
+
+    int toInt32() const {
+        return static_cast<int>(toInt64());
+    }
+
+    long long toInt64() const {
+        switch (type()) {
+        case vtTrue:
+            return 1ll;
+        case vtNumber:
+            return toNumber().toInt64();
+        case vtString:
+            return std::stoll(toRawString());
+        default:
+            return 0ll;
+        }
+    }
+
+    unsigned int toUInt32() const {
+        return static_cast<unsigned int>(toUInt64());
+    }
+
+    unsigned long long toUInt64() const {
+        switch (type()) {
+        case vtTrue:
+            return 1ull;
+        case vtNumber:
+            return toNumber().toUInt64();
+        case vtString:
+            return std::stoull(toRawString());
+        default:
+            return 0ull;
+        }
+    }
+
+    double toDouble() const {
+        switch (type()) {
+        case vtTrue:
+            return 1.0;
+        case vtNumber:
+            return toNumber().toDouble();
+        case vtString:
+            return std::stod(toRawString());
+        default:
+            return 0.0;
+        }
+    }
+
+    JsonNumber toNumber() const {
+        if (type() != vtNumber)
+            return JsonNumber();
+        return mDoc->number(mEntry);
+    }
+
+    // valid as long as the document
+    std::string_view toStringView() const {
+        if (type() != vtString)
+            return std::string_view();
+        return mDoc->string(mEntry);
+    }
+
+    std::string toRawString() const {
+        if (type() == vtString) {
+            auto s = toStringView();
+            return std::string(s.data(), s.length());
+        }
+        return toStringIndent(0);
+    }
+
+    std::string toString() const {
+        return toStringIndent(0);
+    }
+
+    std::string toStringIndent(int indentation) const {
+        std::string res;
+        JsonWriter writer(res, 2);
+        writer.setBaseIndent(indentation);
+        write(writer);
+        return res;
+    }
+
+    std::string toCompactString() const {
+        std::string res;
+        JsonWriter writer(res);
+        write(writer);
+        return res;
+    }
+
+    // the text of the value as it is in the input
+    std::string_view rawJson() const {
+        return mDoc->raw(mEntry);
+    }
+
+    void write(JsonWriter& writer) const {
+        std::string_view s = rawJson();
+        JsonReader().parse(reinterpret_cast<const unsigned char*>(s.data()), inputLength(s.length()), writer);
+    }
+
+    // decodes the whole value
+    std::shared_ptr<JsonValue> toValue() const {
+        std::string_view s = rawJson();
+        return JsonReader().read(reinterpret_cast<const unsigned char*>(s.data()), inputLength(s.length()));
+    }
+
+    // counts the children, skipping every nested container
+    int size() const {
+        int n = 0;
+        if (mDoc->token(mEntry) == '{')
+            mDoc->walkObject(mEntry, [&](uint32_t, uint32_t) { n++; return true; });
+        else if (mDoc->token(mEntry) == '[')
+            mDoc->walkArray(mEntry, [&](uint32_t) { n++; return true; });
+        return n;
+    }
+
+    LazyValue get(int index) const {
+        if (mDoc->token(mEntry) != '[')
+            throw std::invalid_argument("can't be accessed by index");
+
+        uint32_t found = 0;
+        int i = 0;
+        if (index >= 0) {
+            mDoc->walkArray(mEntry, [&](uint32_t entry) {
+                if (i++ < index)
+                    return true;
+                found = entry;
+                return false;
+            });
+        }
+        if (found == 0)
+            throw std::out_of_range("index out of range");
+        return LazyValue(mDoc, found);
+    }
+
+    LazyValue get(std::string_view name) const {
+        if (mDoc->token(mEntry) != '{')
+            throw std::invalid_argument("can't be accessed by name");
+
+        uint32_t found = 0;
+        std::string buf;
+        mDoc->walkObject(mEntry, [&](uint32_t key, uint32_t value) {
+            if (mDoc->decodeString(key, buf) == name)
+                found = value;
+            return true;
+        });
+        if (found == 0)
+            throw std::invalid_argument("can't find the name");
+        return LazyValue(mDoc, found);
+    }
+
+    LazyValue operator [](std::string_view name) const {
+        return get(name);
+    }
+
+    LazyValue operator [](int idx) const {
+        return get(idx);
+    }
+
+    // objects : fn(std::string_view name, const LazyValue& value)
+    // arrays  : fn(int index, const LazyValue& value)
+    template <typename Function>
+    void forEach(Function fn) const {
+        if constexpr (std::is_invocable<Function, std::string_view, const LazyValue&>::value) {
+            if (mDoc->token(mEntry) != '{')
+                return;
+            std::string buf;
+            mDoc->walkObject(mEntry, [&](uint32_t key, uint32_t value) {
+                fn(mDoc->decodeString(key, buf), LazyValue(mDoc, value));
+                return true;
+            });
+        } else {
+            if (mDoc->token(mEntry) != '[')
+                return;
+            int i = 0;
+            mDoc->walkArray(mEntry, [&](uint32_t value) {
+                fn(i++, LazyValue(mDoc, value));
+                return true;
+            });
+        }
+    }
+
+private:
+    friend class LazyDocument;
+
+    LazyValue(const LazyDocument* doc, uint32_t entry) : mDoc(doc), mEntry(entry) {
+    }
+
+    void checkKeyword(std::string_view keyword) const {
+        if (rawJson() != keyword)
+            throw invalid_format_error();
+    }
+
+private:
+    const LazyDocument* mDoc;
+    uint32_t            mEntry;
+};
+
+
+inline LazyValue LazyDocument::root() const {
+    if (!mSrc)
+        throw std::invalid_argument("empty document");
+    return LazyValue(this, 0);
+}
+
+inline LazyValue LazyDocument::operator [](std::string_view name) const {
+    return root().get(name);
+}
+
+inline LazyValue LazyDocument::operator [](int idx) const {
+    return root().get(idx);
+}
+
+}
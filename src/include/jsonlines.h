@@ -0,0 +1,243 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <mutex>
+#include <vector>
+
+#include "jsonparser.h"
+#include "jsonthreadpool.h"
+
+namespace youngJSON {
+
+// Parses newline-delimited JSON (JSON Lines) on a thread pool and delivers the records in order.
+//
+// The input is cut into batches of batchSize bytes. A record belongs to the batch in which
+// it starts, so every thread finds its own record boundaries. A JSON string can't contain a
+// raw newline (it must be escaped as \n), so every newline byte of valid input ends a record.
+// Only a bounded number of parsed batches is kept in flight ahead of delivery.
+class JsonLinesParser {
+public:
+    static const size_t DEFAULT_BATCH_SIZE = 256 * 1024;
+    static const size_t DEFAULT_WINDOW_SIZE = 64 * 1024 * 1024;
+    static const size_t RECORD_BLOCK_SIZE = 4 * 1024;
+
+    // threadCount includes the calling thread; 0 uses every hardware thread
+    explicit JsonLinesParser(unsigned threadCount = 0, size_t batchSize = DEFAULT_BATCH_SIZE)
+        : mPool(threadCount), mBatchSize(batchSize), mWindowSize(DEFAULT_WINDOW_SIZE) {
+    }
+
+    unsigned threadCount() const {
+        return mPool.size();
+    }
+
+    // The settings of this reader are copied to the reader of every thread. Its statistics
+    // observer is called once per parse, on the calling thread, with the records' sum.
+    JsonReader& reader() {
+        return mReader;
+    }
+
+    // bytes read from a stream at a time; a longer record grows the window
+    void setWindowSize(size_t size) {
+        mWindowSize = size;
+    }
+
+    // Parses every non-blank line of src and calls fn(size_t index, Document& doc) on the
+    // calling thread in input order. doc is reused after fn returns, and fn may return false
+    // to stop. A record that fails to parse rethrows its error after every record before it
+    // has been delivered. Returns the number of records delivered.
+    template <typename Document = JsonDocument, typename Function>
+    size_t parse(const char* src, size_t length, Function fn) {
+        bool stopped = false;
+        WorkerReaders readers(mReader, mPool.size());
+        size_t count = parseBuffer<Document>(readers, src, length, 0, fn, stopped);
+        readers.report(mReader);
+        return count;
+    }
+
+    // reads the stream one window at a time, so memory doesn't depend on the stream size
+    template <typename Document = JsonDocument, typename Function>
+    size_t parse(std::istream& is, Function fn) {
+        std::vector<char> buf(mWindowSize > 0 ? mWindowSize : DEFAULT_WINDOW_SIZE);
+        size_t filled = 0;
+        size_t count = 0;
+        bool stopped = false;
+        WorkerReaders readers(mReader, mPool.size());
+
+        while (!stopped) {
+            if (filled == buf.size())
+                buf.resize(buf.size() * 2);
+            is.read(buf.data() + filled, static_cast<std::streamsize>(buf.size() - filled));
+            size_t n = static_cast<size_t>(is.gcount());
+            filled += n;
+            bool eof = !is || n == 0;
+
+            // parse up to the last complete line, keep the rest for the next window
+            size_t cut = filled;
+            if (!eof) {
+                while (cut > 0 && buf[cut - 1] != '\n')
+                    --cut;
+            }
+            if (cut > 0) {
+                count += parseBuffer<Document>(readers, buf.data(), cut, count, fn, stopped);
+                memmove(buf.data(), buf.data() + cut, filled - cut);
+                filled -= cut;
+            }
+            if (eof)
+                break;
+        }
+        readers.report(mReader);
+        return count;
+    }
+
+private:
+    template <typename Document>
+    struct Batch {
+        std::vector<Document>   docs;
+        size_t                  count = 0;
+        std::exception_ptr      error;
+        bool                    ready = false;
+    };
+
+    template <typename Document>
+    void parseBatch(JsonReader& reader, const char* src, size_t length, size_t task, Batch<Document>& batch) {
+        size_t begin = task * mBatchSize;
+        size_t end = std::min(begin + mBatchSize, length);
+
+        size_t pos = begin;
+        if (task > 0) {
+            const char* nl = static_cast<const char*>(memchr(src + begin - 1, '\n', length - begin + 1));
+            pos = nl ? nl - src + 1 : length;
+        }
+
+        batch.count = 0;
+        try {
+            while (pos < end) {
+                const char* nl = static_cast<const char*>(memchr(src + pos, '\n', length - pos));
+                size_t lineEnd = nl ? nl - src : length;
+
+                size_t first = pos;
+                while (first < lineEnd && isJsonSpace(src[first]))
+                    ++first;
+                if (first < lineEnd) {
+                    if (batch.docs.size() <= batch.count)
+                        batch.docs.emplace_back(static_cast<size_t>(RECORD_BLOCK_SIZE));
+                    reader.read(reinterpret_cast<const unsigned char*>(src + first), inputLength(lineEnd - first),
+                                batch.docs[batch.count]);
+                    batch.count++;
+                }
+                pos = nl ? lineEnd + 1 : length;
+            }
+        } catch (...) {
+            batch.error = std::current_exception();
+        }
+    }
+
+    template <typename Document, typename Function>
+    size_t parseBuffer(WorkerReaders& readers, const char* src, size_t length, size_t firstIndex, Function& fn, bool& stopped) {
+        const size_t taskCount = (length + mBatchSize - 1) / mBatchSize;
+        if (taskCount == 0)
+            return 0;
+
+        std::vector<Batch<Document>> slots(std::min<size_t>(taskCount, 2 * mPool.size()));
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        size_t next = 0;
+        size_t delivered = 0;
+        bool abort = false;
+        size_t count = 0;
+
+        auto process = [&](unsigned worker, size_t task) {
+            Batch<Document>& batch = slots[task % slots.size()];
+            parseBatch(readers[worker], src, length, task, batch);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                batch.ready = true;
+            }
+            cv.notify_all();
+        };
+
+        auto stop = [&] {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                abort = true;
+            }
+            cv.notify_all();
+        };
+
+        // the calling thread delivers in order and parses while the next batch isn't ready;
+        // the others take the next batch as long as a slot is free
+        std::function<void(unsigned)> job = [&](unsigned worker) {
+            if (worker != 0) {
+                while (true) {
+                    size_t task;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        cv.wait(lock, [&] { return abort || next >= taskCount || next < delivered + slots.size(); });
+                        if (abort || next >= taskCount)
+                            return;
+                        task = next++;
+                    }
+                    process(worker, task);
+                }
+            }
+
+            try {
+                for (size_t k = 0; k < taskCount && !stopped; k++) {
+                    Batch<Document>& batch = slots[k % slots.size()];
+                    while (true) {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        if (batch.ready)
+                            break;
+                        if (next < taskCount && next < delivered + slots.size()) {
+                            size_t task = next++;
+                            lock.unlock();
+                            process(0, task);
+                            continue;
+                        }
+                        cv.wait(lock, [&] { return batch.ready; });
+                        break;
+                    }
+
+                    for (size_t i = 0; i < batch.count; i++) {
+                        if (!acceptEvent([&] { return fn(firstIndex + count, batch.docs[i]); })) {
+                            stopped = true;
+                            break;
+                        }
+                        count++;
+                    }
+                    if (batch.error && !stopped)
+                        std::rethrow_exception(batch.error);
+
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        batch.ready = false;
+                        batch.error = nullptr;
+                        delivered++;
+                    }
+                    cv.notify_all();
+                }
+            } catch (...) {
+                stop();
+                throw;
+            }
+            stop();
+        };
+
+        mPool.run(job);
+        return count;
+    }
+
+private:
+    ThreadPool  mPool;
+    JsonReader  mReader;
+    size_t      mBatchSize;
+    size_t      mWindowSize;
+};
+
+}
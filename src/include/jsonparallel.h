@@ -0,0 +1,307 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "jsonparser.h"
+#include "jsonthreadpool.h"
+
+namespace youngJSON {
+
+// Parses the elements of one large array on a thread pool.
+//
+// A sequential pass over the structural characters finds the array and the commas at its
+// top level. The elements are then grouped into tasks of about the same number of bytes,
+// and every thread parses whole tasks with its own copy of reader(). The result is the same
+// tree JsonReader::read would build; only the array itself is filled on the calling thread.
+class ParallelArrayReader {
+public:
+    static const size_t TASKS_PER_THREAD = 8;
+
+    // threadCount includes the calling thread; 0 uses every hardware thread
+    explicit ParallelArrayReader(unsigned threadCount = 0) : mPool(threadCount) {
+    }
+
+    unsigned threadCount() const {
+        return mPool.size();
+    }
+
+    // The settings of this reader are copied to the reader of every thread. Its statistics
+    // observer is called once per read, on the calling thread, with the sum of every part.
+    JsonReader& reader() {
+        return mReader;
+    }
+
+    // Names of the members that lead from the root object to the array, e.g. { "data", "items" }.
+    // A name is compared with the key as it is written in the input. Empty for a root array.
+    void setArrayPath(const std::vector<std::string>& path) {
+        mPath = path;
+    }
+
+    const std::vector<std::string>& arrayPath() const {
+        return mPath;
+    }
+
+    std::shared_ptr<JsonValue> read(const unsigned char* src, size_t length) {
+        Layout layout = split(src, length);
+        std::vector<std::shared_ptr<JsonValue>> elements(layout.count());
+        WorkerReaders readers(mReader, mPool.size());
+        parseElements(readers, src, layout, elements, nullptr);
+
+        std::shared_ptr<JsonValue> root;
+        ValueArray* array;
+        if (mPath.empty()) {
+            auto arr = std::make_shared<ValueArray>();
+            array = arr.get();
+            root = std::move(arr);
+        } else {
+            std::string outer = enclosing(src, length, layout);
+            JsonReader reader(readers[0]);
+            reader.setStringMode(smCopy);
+            root = reader.read(outer);
+            array = findArray(*root);
+        }
+
+        array->reserve(elements.size());
+        for (auto& it : elements)
+            array->add(std::move(it));
+        readers.report(mReader);
+        return root;
+    }
+
+    std::shared_ptr<JsonValue> read(const std::string& src) {
+        return read((const unsigned char*)src.data(), src.length());
+    }
+
+    // every thread allocates from its own arena, which the document keeps alive
+    void read(const unsigned char* src, size_t length, JsonDocument& doc) {
+        doc.clear();
+
+        try {
+            Layout layout = split(src, length);
+            std::vector<std::shared_ptr<JsonValue>> elements(layout.count());
+            std::vector<std::shared_ptr<JsonArena>> arenas(mPool.size());
+            WorkerReaders readers(mReader, mPool.size());
+            parseElements(readers, src, layout, elements, &arenas);
+
+            ValueArray* array;
+            if (mPath.empty()) {
+                auto arr = doc.create<ValueArray>();
+                array = arr.get();
+                doc.setRoot(array);
+                if (mReader.symbolTable())
+                    doc.arena().retain(mReader.symbolTable());
+                if (mReader.shapeTable())
+                    doc.arena().retain(mReader.shapeTable());
+            } else {
+                std::string outer = enclosing(src, length, layout);
+                JsonReader reader(readers[0]);
+                reader.setStringMode(smCopy);
+                reader.read((const unsigned char*)outer.data(), inputLength(outer.length()), doc);
+                array = findArray(doc.root());
+            }
+
+            for (auto& it : arenas) {
+                if (it)
+                    doc.arena().retain(std::move(it));
+            }
+            array->reserve(elements.size());
+            for (auto& it : elements)
+                array->add(std::move(it));
+            readers.report(mReader);
+        } catch (...) {
+            doc.clear();
+            throw;
+        }
+    }
+
+    void read(const std::string& src, JsonDocument& doc) {
+        read((const unsigned char*)src.data(), src.length(), doc);
+    }
+
+private:
+    // element i lies between separators[i] and separators[i + 1], the first being the
+    // opening bracket and the last the closing one; empty for []
+    struct Layout {
+        size_t              open;
+        size_t              close;
+        std::vector<size_t> separators;
+
+        size_t count() const {
+            return separators.empty() ? 0 : separators.size() - 1;
+        }
+    };
+
+    Layout split(const unsigned char* src, size_t length) const {
+        size_t pos = skipSpace(src, length, 0);
+        for (auto& name : mPath) {
+            if (pos >= length || src[pos] != '{')
+                throw invalid_format_error();
+            pos = skipSpace(src, length, findMember(src, length, pos, name));
+        }
+        if (pos >= length || src[pos] != '[')
+            throw invalid_format_error();
+
+        Layout layout;
+        layout.open = pos;
+        layout.separators.push_back(pos);
+
+        StructuralScanner scanner(src, length, pos + 1);
+        int depth = 0;
+        while (true) {
+            size_t next = scanner.next();
+            if (next >= length)
+                throw invalid_format_error();
+
+            unsigned char ch = src[next];
+            if (ch == '{' || ch == '[') {
+                depth++;
+            } else if (ch == '}' || ch == ']') {
+                if (depth-- == 0) {
+                    if (ch != ']')
+                        throw invalid_format_error();
+                    layout.close = next;
+                    layout.separators.push_back(next);
+                    break;
+                }
+            } else if (ch == ',' && depth == 0) {
+                layout.separators.push_back(next);
+            }
+        }
+
+        if (layout.count() == 1 && skipSpace(src, length, layout.open + 1) == layout.close)
+            layout.separators.clear();
+
+        if (mPath.empty() && skipSpace(src, length, layout.close + 1) != length)
+            throw invalid_format_error();
+        return layout;
+    }
+
+    // returns the position after the colon of the member of the object at pos
+    static size_t findMember(const unsigned char* src, size_t length, size_t pos, const std::string& name) {
+        StructuralScanner scanner(src, length, pos + 1, true);
+        int depth = 0;
+        bool inString = false;
+        size_t keyBegin = 0;
+        size_t keyEnd = 0;
+
+        while (true) {
+            size_t next = scanner.next();
+            if (next >= length)
+                throw invalid_format_error();
+
+            switch (src[next]) {
+            case '\"':
+                if (inString)
+                    keyEnd = next;
+                else
+                    keyBegin = next + 1;
+                inString = !inString;
+                break;
+            case '{':
+            case '[':
+                depth++;
+                break;
+            case '}':
+            case ']':
+                if (depth-- == 0)
+                    throw std::invalid_argument("can't find the name");
+                break;
+            case ':':
+                if (depth == 0 && keyEnd - keyBegin == name.length() &&
+                    memcmp(src + keyBegin, name.data(), name.length()) == 0)
+                    return next + 1;
+                break;
+            }
+        }
+    }
+
+    static size_t skipSpace(const unsigned char* src, size_t length, size_t pos) {
+        while (pos < length && isJsonSpace(src[pos]))
+            ++pos;
+        return pos;
+    }
+
+    // the input with an empty array in place of the parsed one
+    static std::string enclosing(const unsigned char* src, size_t length, const Layout& layout) {
+        std::string res;
+        res.reserve(length - (layout.close - layout.open) + 1);
+        res.append((const char*)src, layout.open + 1);
+        res.append((const char*)src + layout.close, length - layout.close);
+        return res;
+    }
+
+    ValueArray* findArray(JsonValue& root) const {
+        JsonValue* value = &root;
+        for (auto& name : mPath)
+            value = &value->get(name);
+        ValueArray* array = dynamic_cast<ValueArray*>(value);
+        if (!array)
+            throw std::invalid_argument("not an array");
+        return array;
+    }
+
+    void parseElements(WorkerReaders& readers, const unsigned char* src, const Layout& layout,
+                       std::vector<std::shared_ptr<JsonValue>>& elements,
+                       std::vector<std::shared_ptr<JsonArena>>* arenas) {
+        const size_t count = layout.count();
+        if (count == 0)
+            return;
+
+        // tasks[i] is the first element of task i
+        const std::vector<size_t>& sep = layout.separators;
+        size_t taskBytes = (sep.back() - sep.front()) / (mPool.size() * TASKS_PER_THREAD) + 1;
+        std::vector<size_t> tasks;
+        for (size_t i = 0; i < count; i++) {
+            if (tasks.empty() || sep[i] - sep[tasks.back()] >= taskBytes)
+                tasks.push_back(i);
+        }
+        tasks.push_back(count);
+
+        std::atomic<size_t> next(0);
+        std::atomic<bool> failed(false);
+
+        std::function<void(unsigned)> job = [&](unsigned worker) {
+            JsonReader& reader = readers[worker];
+            JsonArena* arena = nullptr;
+
+            while (!failed) {
+                size_t task = next++;
+                if (task + 1 >= tasks.size())
+                    return;
+
+                if (arenas && !arena) {
+                    (*arenas)[worker] = std::make_shared<JsonArena>();
+                    arena = (*arenas)[worker].get();
+                }
+                try {
+                    for (size_t i = tasks[task]; i < tasks[task + 1]; i++) {
+                        const unsigned char* begin = src + sep[i] + 1;
+                        int length = inputLength(sep[i + 1] - sep[i] - 1);
+                        if (arena)
+                            elements[i] = reader.read(begin, length, *arena);
+                        else
+                            elements[i] = reader.read(begin, length);
+                    }
+                } catch (...) {
+                    failed = true;
+                    throw;
+                }
+            }
+        };
+
+        mPool.run(job);
+    }
+
+private:
+    ThreadPool                  mPool;
+    JsonReader                  mReader;
+    std::vector<std::string>    mPath;
+};
+
+}
@@ -1,9 +1,21 @@
 #pragma once
 
+#include <cstring>
+#include <climits>
 #include <exception>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 #include "jsonvalue.h"
+#include "jsondocument.h"
+#include "jsoncompact.h"
 #include "jsonencoding.h"
+#include "jsonfile.h"
+#include "jsonscan.h"
+#include "jsonstats.h"
+#include "jsontape.h"
 
 namespace youngJSON {
 
@@ -22,101 +34,559 @@ public:
 };
 
 
+enum StringModeT {
+    smCopy,     // every string is copied into its value
+    smBorrow    // escape-free strings refer to the input, which must outlive the result
+};
+
+
+// calls a parse handler method, which may return void, or false to stop parsing
+template <typename Function>
+inline bool acceptEvent(Function fn) {
+    if constexpr (std::is_void<decltype(fn())>::value) {
+        fn();
+        return true;
+    } else {
+        return static_cast<bool>(fn());
+    }
+}
+
+
+// Lengths are ints, so one input, whether a string, a buffer or a file, is limited to
+// INT_MAX bytes (2 GB); a longer string or file throws std::length_error.
+inline int inputLength(size_t length) {
+    if (length > static_cast<size_t>(INT_MAX))
+        throw std::length_error("input is larger than the 2 GB a JsonReader accepts");
+    return static_cast<int>(length);
+}
+
 class JsonReader {
 public:
     JsonReader(EncodingType type = etUTF8) : encodingType(type) {
         p = pEnd = nullptr;
+        mArena = nullptr;
+        mStringMode = smCopy;
+        mInSitu = false;
+        mKeepNumberLexeme = false;
+        mUseIndex = true;
+        mBase = nullptr;
+        mIndexPos = nullptr;
+#ifdef YOUNGJSON_STATS
+        mDepth = 0;
+        mParseStart = 0;
+#endif
+    }
+
+    // when enabled, a SIMD pre-pass finds every structural position and
+    // whitespace runs are skipped by jumping to the next one
+    void setStructuralIndex(bool enable) {
+        mUseIndex = enable;
+    }
+
+    bool usesStructuralIndex() const {
+        return mUseIndex;
+    }
+
+    void setStringMode(StringModeT mode) {
+        mStringMode = mode;
+    }
+
+    StringModeT stringMode() const {
+        return mStringMode;
+    }
+
+    // keeps the lexeme of every number in the DOM for lossless output (big numbers, exact decimals)
+    void setKeepNumberLexeme(bool keep) {
+        mKeepNumberLexeme = keep;
+    }
+
+    bool keepsNumberLexeme() const {
+        return mKeepNumberLexeme;
+    }
+
+    // Interns member names in a table that may be shared by many readers and documents.
+    // A document read with a table keeps it alive; values read without a document don't.
+    void setSymbolTable(std::shared_ptr<JsonSymbolTable> table) {
+        mSymbols = std::move(table);
+        mSymbolCache.clear();
+    }
+
+    const std::shared_ptr<JsonSymbolTable>& symbolTable() const {
+        return mSymbols;
+    }
+
+    // Objects read with a shape table share the shapes of their member names. Like a symbol
+    // table, it is kept alive by a document read with it, but not by values read without one.
+    void setShapeTable(std::shared_ptr<JsonShapeTable> table) {
+        mShapes = std::move(table);
+    }
+
+    const std::shared_ptr<JsonShapeTable>& shapeTable() const {
+        return mShapes;
+    }
+
+#ifdef YOUNGJSON_STATS
+    // statistics of the last read
+    const JsonStats& stats() const {
+        return mStats;
+    }
+
+    // called after every successful read with its statistics
+    void setStatsObserver(JsonStatsObserver observer) {
+        mStatsObserver = std::move(observer);
+    }
+
+    const JsonStatsObserver& statsObserver() const {
+        return mStatsObserver;
     }
+#else
+    // all zero, since statistics are compiled out
+    const JsonStats& stats() const {
+        return JsonStats::none();
+    }
+
+    template <typename Observer>
+    void setStatsObserver(Observer&&) {
+        static_assert(sizeof(Observer) == 0, "statistics are compiled out; define YOUNGJSON_STATS");
+    }
+#endif
 
     std::shared_ptr<JsonValue> read(const unsigned char* src, int length) {
-        p = src;
-        pEnd = p + length;
+        begin(src, length, nullptr);
 
-        return readValue();
+        DomBuilder builder(*this);
+        parseValue(builder);
+        finish();
+        return builder.result();
     }
 
     std::shared_ptr<JsonValue> read(const std::string& src) {
-        return read((const unsigned char*)src.data(), (int)src.length());
+        return read((const unsigned char*)src.data(), inputLength(src.length()));
+    }
+
+    // all nodes are allocated from the document's arena
+    void read(const unsigned char* src, int length, JsonDocument& doc) {
+        doc.clear();
+
+        try {
+            begin(src, length, &doc.arena());
+            DomBuilder builder(*this);
+            parseValue(builder);
+            finish();
+            doc.setRoot(builder.result().get());
+            if (mSymbols)
+                doc.arena().retain(mSymbols);
+            if (mShapes)
+                doc.arena().retain(mShapes);
+        } catch (...) {
+            mArena = nullptr;
+            doc.clear();
+            throw;
+        }
+        mArena = nullptr;
+    }
+
+    void read(const std::string& src, JsonDocument& doc) {
+        read((const unsigned char*)src.data(), inputLength(src.length()), doc);
+    }
+
+    // allocates the nodes from arena and returns a non-owning pointer to the root
+    std::shared_ptr<JsonValue> read(const unsigned char* src, int length, JsonArena& arena) {
+        std::shared_ptr<JsonValue> res;
+        try {
+            begin(src, length, &arena);
+            DomBuilder builder(*this);
+            parseValue(builder);
+            finish();
+            res = builder.result();
+        } catch (...) {
+            mArena = nullptr;
+            throw;
+        }
+        mArena = nullptr;
+        return res;
+    }
+
+    // builds 16-byte CompactValues whose children are contiguous in the document's arena
+    void read(const unsigned char* src, int length, CompactDocument& doc) {
+        doc.clear();
+        mStack.clear();
+        mBases.clear();
+
+        try {
+            begin(src, length, &doc.arena());
+            CompactBuilder builder(*this);
+            parseValue(builder);
+            finish();
+            doc.setRoot(mStack.back());
+            if (mSymbols)
+                doc.arena().retain(mSymbols);
+        } catch (...) {
+            mArena = nullptr;
+            doc.clear();
+            throw;
+        }
+        mArena = nullptr;
+    }
+
+    void read(const std::string& src, CompactDocument& doc) {
+        read((const unsigned char*)src.data(), inputLength(src.length()), doc);
+    }
+
+    // writes the document to one flat tape; every string is copied to the document
+    void read(const unsigned char* src, int length, TapeDocument& doc) {
+        doc.clear();
+
+        try {
+            begin(src, length, nullptr);
+            TapeBuilder builder(doc, mTapeBuffers);
+            parseValue(builder);
+            finish();
+        } catch (...) {
+            doc.clear();
+            throw;
+        }
+    }
+
+    void read(const std::string& src, TapeDocument& doc) {
+        read((const unsigned char*)src.data(), inputLength(src.length()), doc);
+    }
+
+    // Reports the document to handler as a sequence of events without building a tree:
+    //   null(), boolean(bool), number(const JsonNumber&, std::string_view lexeme), string(std::string_view),
+    //   key(std::string_view), startObject(), endObject(), startArray(), endArray()
+    // Strings and lexemes are valid only during the call. A method may return false to stop
+    // parsing, in which case parse returns false.
+    template <typename Handler>
+    bool parse(const unsigned char* src, int length, Handler& handler) {
+        begin(src, length, nullptr);
+        if (!parseValue(handler))
+            return false;
+        finish();
+        return true;
+    }
+
+    template <typename Handler>
+    bool parse(const std::string& src, Handler& handler) {
+        return parse((const unsigned char*)src.data(), inputLength(src.length()), handler);
+    }
+
+    // Borrows every string from src. Strings with escapes are decoded in place,
+    // so src is modified and must outlive the document.
+    template <typename Document>
+    void readInSitu(char* src, int length, Document& doc) {
+        mInSitu = true;
+        try {
+            read((const unsigned char*)src, length, doc);
+        } catch (...) {
+            mInSitu = false;
+            throw;
+        }
+        mInSitu = false;
+    }
+
+    // Parses a memory-mapped file. Every string is copied, since the mapping is released on return.
+    std::shared_ptr<JsonValue> readFile(const std::string& path) {
+        MappedFile file(path);
+        StringModeT mode = mStringMode;
+        mStringMode = smCopy;
+        try {
+            auto res = read((const unsigned char*)file.data(), inputLength(file.size()));
+            mStringMode = mode;
+            return res;
+        } catch (...) {
+            mStringMode = mode;
+            throw;
+        }
+    }
+
+    // With smBorrow the document keeps the mapping, so strings refer to the file without a copy.
+    template <typename Document>
+    void readFile(const std::string& path, Document& doc) {
+        auto file = std::make_shared<MappedFile>(path);
+        read((const unsigned char*)file->data(), inputLength(file->size()), doc);
+        if (mStringMode == smBorrow)
+            doc.arena().retain(std::move(file));
+    }
+
+    void readFile(const std::string& path, TapeDocument& doc) {
+        MappedFile file(path);
+        read((const unsigned char*)file.data(), inputLength(file.size()), doc);
     }
 
 private:
+    void begin(const unsigned char* src, int length, JsonArena* arena) {
+        p = src;
+        pEnd = p + length;
+        mArena = arena;
+
+#ifdef YOUNGJSON_STATS
+        mStats.clear();
+        mStats.bytes = static_cast<size_t>(length);
+        mDepth = 0;
+        mParseStart = JsonStats::now();
+#endif
+
+        mBase = src;
+        mIndexPos = nullptr;
+        if (mUseIndex && length > 0) {
+#ifdef YOUNGJSON_STATS
+            stats::Timer timer(mStats, spIndex);
+#endif
+            if (!mIndex.build(src, length))
+                throw invalid_format_error();
+            mIndexPos = mIndex.data();
+        }
+    }
+
+    void finish() {
+        checkEnd();
+#ifdef YOUNGJSON_STATS
+        mStats.ticks[spParse] = JsonStats::now() - mParseStart;
+        if (mStatsObserver)
+            mStatsObserver(mStats);
+#endif
+    }
+
+    void countNode(ValueTypeT type) {
+#ifdef YOUNGJSON_STATS
+        mStats.nodes[type]++;
+#endif
+    }
+
+    void countAllocation(size_t bytes) {
+#ifdef YOUNGJSON_STATS
+        mStats.allocations++;
+        mStats.allocatedBytes += bytes;
+#endif
+    }
+
+    void enterContainer(ValueTypeT type) {
+#ifdef YOUNGJSON_STATS
+        mStats.nodes[type]++;
+        if (++mDepth > mStats.maxDepth)
+            mStats.maxDepth = mDepth;
+#endif
+    }
+
+    void leaveContainer() {
+#ifdef YOUNGJSON_STATS
+        mDepth--;
+#endif
+    }
+
+    // only whitespace may follow the root value
+    void checkEnd() {
+        while (p < pEnd && isJsonSpace(*p))
+            ++p;
+        if (p != pEnd)
+            throw invalid_format_error();
+    }
+
     void checkOutOfRange() {
         if (p >= pEnd)
             throw invalid_format_error();
     }
 
+    // Every non-space byte that follows whitespace outside a string is in the index,
+    // so a whitespace run always ends at the next indexed position.
     void skipSpace() {
-        while (p < pEnd && isspace(*p))
-            ++p;
+        if (p < pEnd && isJsonSpace(*p)) {
+            if (mIndexPos) {
+                uint32_t offset = static_cast<uint32_t>(p - mBase);
+                while (*mIndexPos < offset)
+                    ++mIndexPos;
+                p = mBase + *mIndexPos;
+            } else {
+                do {
+                    ++p;
+                } while (p < pEnd && isJsonSpace(*p));
+            }
+        }
         checkOutOfRange();
     }
 
     unsigned int hexToUInt(int ch) {
-        return isdigit(ch) ? ch - '0' : toupper(ch) - 'A' + 10;
+        if (!isJsonHex(ch))
+            throw invalid_format_error();
+        return isJsonDigit(ch) ? ch - '0' : (ch | 0x20) - 'a' + 10;
     }
 
-    std::string readString() {
-        std::string res;
+    template <typename T, typename... Args>
+    std::shared_ptr<JsonValue> makeValue(Args&&... args) {
+        countAllocation(sizeof(T));
+        if (!mArena)
+            return std::make_shared<T>(std::forward<Args>(args)...);
+        T* value = mArena->create<T>(std::forward<Args>(args)...);
+        return std::shared_ptr<JsonValue>(std::shared_ptr<JsonValue>(), value);
+    }
 
-        skipSpace();
-        if (*p != '\"')
+    bool isBorrowable(std::string_view s) const {
+        return (mStringMode == smBorrow || mInSitu)
+            && reinterpret_cast<const unsigned char*>(s.data()) >= mBase
+            && reinterpret_cast<const unsigned char*>(s.data()) < pEnd;
+    }
+
+    std::shared_ptr<JsonValue> makeString(std::string_view s) {
+        if (isBorrowable(s))
+            return makeValue<ValueStringRef>(s);
+
+        countAllocation(s.length());
+        if (mArena && mStringMode == smBorrow)
+            return makeValue<ValueStringRef>(std::string_view(mArena->copyString(s.data(), s.length()), s.length()));
+        else if (!mArena)
+            return makeValue<ValueString>(s.data(), s.length(), std::pmr::get_default_resource());
+        return makeValue<ValueString>(s.data(), s.length(), mArena);
+    }
+
+    std::shared_ptr<JsonValue> makeNumber(const JsonNumber& value, std::string_view raw) {
+        if (!mKeepNumberLexeme)
+            return makeValue<ValueNumber>(value);
+        else if (isBorrowable(raw))
+            return makeValue<ValueNumber>(value, raw, nullptr);
+
+        countAllocation(raw.length());
+        if (mArena)
+            return makeValue<ValueNumber>(value, raw, mArena);
+        return makeValue<ValueNumber>(value, raw, std::pmr::get_default_resource());
+    }
+
+    unsigned int readHex4() {
+        if (pEnd - p < 5)
+            throw invalid_format_error();
+        unsigned int code = 0;
+        code += hexToUInt(*++p) << 12;
+        code += hexToUInt(*++p) << 8;
+        code += hexToUInt(*++p) << 4;
+        code += hexToUInt(*++p);
+        return code;
+    }
+
+    void appendCodeUnit(std::string& res, unsigned int code) {
+        res += static_cast<char>(code >> 8);
+        res += static_cast<char>(code & 0xff);
+    }
+
+    // p points to '\\'; on return p points to the last character of the escape sequence
+    void readEscape(std::string& res) {
+        if (++p >= pEnd)
             throw invalid_format_error();
+#ifdef YOUNGJSON_STATS
+        mStats.escapes++;
+#endif
+
+        switch (*p) {
+        case 'b': res += '\b'; break;
+        case 'f': res += '\f'; break;
+        case 'n': res += '\n'; break;
+        case 'r': res += '\r'; break;
+        case 't': res += '\t'; break;
+        case 'u':
+        {
+            unsigned int code = readHex4();
+            if (encodingType != etUTF8) {
+                appendCodeUnit(res, code);
+                break;
+            }
 
-        while (*++p != '\"') {
-            if (*p == '\\') {
-                switch (*++p) {
-                case 'b': res += '\b'; break;
-                case 'f': res += '\f'; break;
-                case 'n': res += '\n'; break;
-                case 'r': res += '\r'; break;
-                case 't': res += '\t'; break;
-                case 'u':
-                {
-                    unsigned int code = 0;
-                    code += hexToUInt(*++p) << 12;
-                    code += hexToUInt(*++p) << 8;
-                    code += hexToUInt(*++p) << 4;
-                    code += hexToUInt(*++p);
-                    if (encodingType == etUTF8)
-                        appendUTF8(res, code);
-                    else {
-                        res += code >> 8;
-                        res += code & 0xff;
+            if (code >= 0xD800 && code <= 0xDBFF) {
+                // high surrogate : combine with the following low surrogate
+                if (pEnd - p > 6 && p[1] == '\\' && p[2] == 'u') {
+                    const unsigned char* save = p;
+                    p += 2;
+                    unsigned int low = readHex4();
+                    if (low >= 0xDC00 && low <= 0xDFFF) {
+                        appendUTF8(res, 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00));
+                        break;
                     }
-                    break;
+                    p = save;
                 }
-                default:
-                    res += *p;
-                }
-            } else {
-                res += *p;
+                code = 0xFFFD;
+            } else if (code >= 0xDC00 && code <= 0xDFFF) {
+                code = 0xFFFD;
             }
+            appendUTF8(res, code);
+            break;
+        }
+        default:
+            res += *p;
+        }
+    }
+
+    // escape-free strings are returned as a slice of the input,
+    // others are decoded into mBuffer
+    std::string_view readString() {
+#ifdef YOUNGJSON_STATS
+        stats::Timer timer(mStats, spStrings);
+#endif
+        skipSpace();
+        if (*p != '\"')
+            throw invalid_format_error();
+
+        const unsigned char* start = ++p;
+        const unsigned char* first = start;
+        p = findStringSpecial(p, pEnd);
+        checkOutOfRange();
+        if (*p == '\"')
+            return std::string_view(reinterpret_cast<const char*>(first), p++ - first);
+
+        std::string& res = mBuffer;
+        res.clear();
+        res.append(reinterpret_cast<const char*>(first), p - first);
+        while (true) {
+            if (*p == '\"')
+                break;
+            else if (*p < 0x20)
+                throw invalid_format_error();
+
+            readEscape(res);
+
+            first = ++p;
+            p = findStringSpecial(p, pEnd);
+            res.append(reinterpret_cast<const char*>(first), p - first);
+            checkOutOfRange();
         }
         ++p;
 
+        if (mInSitu) {
+            // the decoded string is never longer than its source
+            char* dst = const_cast<char*>(reinterpret_cast<const char*>(start));
+            memcpy(dst, res.data(), res.length());
+            return std::string_view(dst, res.length());
+        }
+
         return res;
     }
 
-    std::string readKeyword() {
-        std::string res;
-        while (p < pEnd && isalpha(*p))
-            res += *p++;
-        return res;
+    std::string_view readKeyword() {
+        const unsigned char* first = p;
+        while (p < pEnd && isJsonAlpha(*p))
+            ++p;
+        return std::string_view(reinterpret_cast<const char*>(first), p - first);
     }
 
-    bool isValidNumberChar(int ch) {
-        return *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E' || isdigit(*p);
+    bool isNumberStart(int ch) {
+        return ch == '-' || isJsonDigit(ch);
     }
 
-    std::string readNumber() {
-        std::string res;
-        while (p < pEnd && isValidNumberChar(*p))
-            res += *p++;
-        return res;
+    // validates the JSON number grammar and converts the number once
+    std::string_view readNumber(JsonNumber& value) {
+#ifdef YOUNGJSON_STATS
+        stats::Timer timer(mStats, spNumbers);
+#endif
+        const char* first = reinterpret_cast<const char*>(p);
+        const char* end = parseNumber(first, reinterpret_cast<const char*>(pEnd), value);
+        if (!end)
+            throw invalid_format_error();
+        p = reinterpret_cast<const unsigned char*>(end);
+        return std::string_view(first, end - first);
     }
 
-    std::shared_ptr<JsonValue> readObject() {
-        auto res = std::make_shared<ValueObject>();
+    template <typename Handler>
+    bool parseObject(Handler& handler) {
+        if (!acceptEvent([&] { return handler.startObject(); }))
+            return false;
+        enterContainer(vtObject);
 
         int cnt = 0;
 
@@ -132,23 +602,33 @@ private:
                 skipSpace();
             }
 
-            auto name = readString();
+            std::string_view name = readString();
+            if (!acceptEvent([&] { return handler.key(name); }))
+                return false;
+#ifdef YOUNGJSON_STATS
+            mStats.keys++;
+#endif
             skipSpace();
             if (*p++ != ':')
                 throw invalid_format_error();
             skipSpace();
 
-            res->add(name, readValue());
+            if (!parseValue(handler))
+                return false;
             cnt++;
         }
         if (*p++ != '}')
             throw invalid_format_error();
 
-        return res;
+        leaveContainer();
+        return acceptEvent([&] { return handler.endObject(); });
     }
 
-    std::shared_ptr<JsonValue> readArray() {
-        auto res = std::make_shared<ValueArray>();
+    template <typename Handler>
+    bool parseArray(Handler& handler) {
+        if (!acceptEvent([&] { return handler.startArray(); }))
+            return false;
+        enterContainer(vtArray);
 
         int cnt = 0;
 
@@ -165,45 +645,377 @@ private:
                 skipSpace();
             }
 
-            res->add(readValue());
+            if (!parseValue(handler))
+                return false;
             cnt++;
         }
         if (*p++ != ']')
             throw invalid_format_error();
 
-        return res;
+        leaveContainer();
+        return acceptEvent([&] { return handler.endArray(); });
     }
 
-    std::shared_ptr<JsonValue> readValue() {
+    template <typename Handler>
+    bool parseValue(Handler& handler) {
         skipSpace();
 
         if (*p == '{')
-            return readObject();
+            return parseObject(handler);
         else if (*p == '[')
-            return readArray();
-        else if (*p == '\"')
-            return std::make_shared<ValueString>(readString());
-        else if (isalpha(*p)) {
+            return parseArray(handler);
+        else if (*p == '\"') {
+            std::string_view s = readString();
+            countNode(vtString);
+            return acceptEvent([&] { return handler.string(s); });
+        } else if (isJsonAlpha(*p)) {
             auto keyword = readKeyword();
-            if (keyword == "true")
-                return std::make_shared<ValueTrue>();
-            else if (keyword == "false")
-                return std::make_shared<ValueFalse>();
-            else if (keyword == "null")
-                return std::make_shared<ValueNull>();
+            if (keyword == "true") {
+                countNode(vtTrue);
+                return acceptEvent([&] { return handler.boolean(true); });
+            } else if (keyword == "false") {
+                countNode(vtFalse);
+                return acceptEvent([&] { return handler.boolean(false); });
+            } else if (keyword == "null") {
+                countNode(vtNull);
+                return acceptEvent([&] { return handler.null(); });
+            }
         } else {
-            if (isValidNumberChar(*p))
-                return std::make_shared<ValueNumber>(readNumber());
+            if (isNumberStart(*p)) {
+                JsonNumber value;
+                auto raw = readNumber(value);
+                countNode(vtNumber);
+                return acceptEvent([&] { return handler.number(value, raw); });
+            }
         }
 
         throw invalid_format_error();
     }
 
+    // builds a JsonValue tree, from the arena when the reader has one
+    class DomBuilder {
+    public:
+        explicit DomBuilder(JsonReader& reader) : mReader(reader), mSymbol(nullptr) {
+            mReader.mContainers.clear();
+        }
+
+        void null() {
+            add(mReader.makeValue<ValueNull>());
+        }
+
+        void boolean(bool value) {
+            if (value)
+                add(mReader.makeValue<ValueTrue>());
+            else
+                add(mReader.makeValue<ValueFalse>());
+        }
+
+        void number(const JsonNumber& value, std::string_view lexeme) {
+            add(mReader.makeNumber(value, lexeme));
+        }
+
+        void string(std::string_view s) {
+            add(mReader.makeString(s));
+        }
+
+        // only a key decoded into the reader's buffer must be saved before its value is read
+        void key(std::string_view name) {
+            if (mReader.mSymbols) {
+                mSymbol = mReader.intern(name);
+                if (mSymbol)
+                    return;
+            }
+            if (name.data() == mReader.mBuffer.data()) {
+                mKey.assign(name.data(), name.length());
+                name = mKey;
+            }
+            mName = name;
+        }
+
+        void startObject() {
+            JsonArena* arena = mReader.mArena;
+            std::shared_ptr<JsonValue> obj;
+            if (!arena)
+                mReader.countAllocation(sizeof(ValueObject));
+            if (JsonShapeTable* shapes = mReader.mShapes.get())
+                obj = arena ? mReader.makeValue<ValueObject>(*shapes, arena) : std::make_shared<ValueObject>(*shapes);
+            else
+                obj = arena ? mReader.makeValue<ValueObject>(arena) : std::make_shared<ValueObject>();
+            JsonValue* container = obj.get();
+            add(std::move(obj));
+            mReader.mContainers.push_back(container);
+        }
+
+        void endObject() {
+            mReader.mContainers.pop_back();
+        }
+
+        void startArray() {
+            JsonArena* arena = mReader.mArena;
+            if (!arena)
+                mReader.countAllocation(sizeof(ValueArray));
+            auto arr = arena ? mReader.makeValue<ValueArray>(arena) : std::make_shared<ValueArray>();
+            JsonValue* container = arr.get();
+            add(std::move(arr));
+            mReader.mContainers.push_back(container);
+        }
+
+        void endArray() {
+            mReader.mContainers.pop_back();
+        }
+
+        std::shared_ptr<JsonValue> result() const {
+            return mRoot;
+        }
+
+    private:
+        void add(std::shared_ptr<JsonValue> value) {
+            if (mReader.mContainers.empty()) {
+                mRoot = std::move(value);
+                return;
+            }
+
+            JsonValue* parent = mReader.mContainers.back();
+            if (parent->isObject() && mSymbol)
+                static_cast<ValueObject*>(parent)->add(mSymbol, std::move(value));
+            else if (parent->isObject())
+                static_cast<ValueObject*>(parent)->add(mName.data(), mName.length(), std::move(value));
+            else
+                static_cast<ValueArray*>(parent)->add(std::move(value));
+        }
+
+    private:
+        JsonReader&                 mReader;
+        std::shared_ptr<JsonValue>  mRoot;
+        std::string                 mKey;
+        std::string_view            mName;
+        const JsonSymbol*           mSymbol;
+    };
+
+    // Symbols found before are looked up without locking the shared table. The cache holds
+    // only symbols of the table, so it is bounded by JsonSymbolTable::MAX_SYMBOLS; nullptr
+    // when the table refuses the name.
+    const JsonSymbol* intern(std::string_view name) {
+        auto it = mSymbolCache.find(name);
+        if (it != mSymbolCache.end())
+            return it->second;
+        const JsonSymbol* symbol = mSymbols->intern(name);
+        if (symbol)
+            mSymbolCache.emplace(symbol->view(), symbol);
+        return symbol;
+    }
+
+    CompactValue makeCompactString(std::string_view s) {
+        if (isBorrowable(s))
+            return CompactValue(s.data(), s.length());
+        if (s.length() > CompactValue::MAX_INLINE_LENGTH)
+            countAllocation(s.length() + 1);
+        return CompactValue(s.data(), s.length(), *mArena);
+    }
+
+    CompactValue makeCompactContainer(ValueTypeT type, size_t base) {
+        if (type == vtObject && mStack.size() - base > 2)
+            removeDuplicateKeys(base);
+        size_t n = mStack.size() - base;
+        CompactValue* children = nullptr;
+        if (n > 0) {
+            children = mArena->allocArray<CompactValue>(n);
+            countAllocation(sizeof(CompactValue) * n);
+            memcpy(children, mStack.data() + base, sizeof(CompactValue) * n);
+            mStack.resize(base);
+        }
+        return CompactValue(type, children, type == vtObject ? n / 2 : n);
+    }
+
+    // A duplicate name replaces the earlier value in place, as in the DOM. Small objects
+    // look for a name pairwise only when its length and ends have been seen before;
+    // larger ones hash the names into mKeySlots.
+    void removeDuplicateKeys(size_t base) {
+        static const size_t SMALL_OBJECT = 16;
+
+        CompactValue* members = mStack.data() + base;
+        size_t count = (mStack.size() - base) / 2;
+        size_t kept = 0;
+        if (count <= SMALL_OBJECT) {
+            std::string_view names[SMALL_OBJECT];
+            uint64_t seen = 0;
+            for (size_t i = 0; i < count; i++) {
+                std::string_view name = members[2 * i].toStringView();
+                size_t ends = name.empty() ? 0 : static_cast<unsigned char>(name[0]) + static_cast<unsigned char>(name.back()) * 3;
+                uint64_t bit = 1ull << ((name.length() * 7 + ends) & 63);
+                size_t j = kept;
+                if (seen & bit) {
+                    j = 0;
+                    while (j < kept && names[j] != name)
+                        j++;
+                }
+                seen |= bit;
+                if (j == kept) {
+                    members[2 * kept] = members[2 * i];
+                    names[kept++] = name;
+                }
+                members[2 * j + 1] = members[2 * i + 1];
+            }
+        } else {
+            size_t mask = 1;
+            while (mask < count * 2)
+                mask <<= 1;
+            mask--;
+            mKeySlots.assign(mask + 1, 0);
+            for (size_t i = 0; i < count; i++) {
+                std::string_view name = members[2 * i].toStringView();
+                size_t h = hashName(name) & mask;
+                while (mKeySlots[h] && members[2 * (mKeySlots[h] - 1)].toStringView() != name)
+                    h = (h + 1) & mask;
+                if (!mKeySlots[h]) {
+                    members[2 * kept] = members[2 * i];
+                    mKeySlots[h] = static_cast<uint32_t>(++kept);
+                }
+                members[2 * (mKeySlots[h] - 1) + 1] = members[2 * i + 1];
+            }
+        }
+        mStack.resize(base + 2 * kept);
+    }
+
+    // builds CompactValues on mStack; a container is moved to the arena when it ends
+    class CompactBuilder {
+    public:
+        explicit CompactBuilder(JsonReader& reader) : mReader(reader), mStack(reader.mStack), mBases(reader.mBases) {
+        }
+
+        void null() {
+            mStack.push_back(CompactValue(vtNull));
+        }
+
+        void boolean(bool value) {
+            mStack.push_back(CompactValue(value ? vtTrue : vtFalse));
+        }
+
+        void number(const JsonNumber& value, std::string_view lexeme) {
+            mStack.push_back(CompactValue(value));
+        }
+
+        void string(std::string_view s) {
+            mStack.push_back(mReader.makeCompactString(s));
+        }
+
+        void key(std::string_view name) {
+            if (mReader.mSymbols && name.length() > CompactValue::MAX_INLINE_LENGTH) {
+                if (const JsonSymbol* symbol = mReader.intern(name)) {
+                    mStack.push_back(CompactValue(symbol->name, symbol->length));
+                    return;
+                }
+            }
+            mStack.push_back(mReader.makeCompactString(name));
+        }
+
+        void startObject() {
+            mBases.push_back(mStack.size());
+        }
+
+        void endObject() {
+            endContainer(vtObject);
+        }
+
+        void startArray() {
+            mBases.push_back(mStack.size());
+        }
+
+        void endArray() {
+            endContainer(vtArray);
+        }
+
+    private:
+        void endContainer(ValueTypeT type) {
+            size_t base = mBases.back();
+            mBases.pop_back();
+            CompactValue value = mReader.makeCompactContainer(type, base);
+            mStack.push_back(value);
+        }
+
+    private:
+        JsonReader&                 mReader;
+        std::vector<CompactValue>&  mStack;
+        std::vector<size_t>&        mBases;
+    };
+
 private:
     const unsigned char*    p;
     const unsigned char*    pEnd;
 
     EncodingType            encodingType;
+
+    JsonArena*              mArena;
+    std::string             mBuffer;
+
+    StringModeT             mStringMode;
+    bool                    mInSitu;
+    bool                    mKeepNumberLexeme;
+
+    bool                    mUseIndex;
+    StructuralIndex         mIndex;
+    const unsigned char*    mBase;
+    const uint32_t*         mIndexPos;
+
+    std::shared_ptr<JsonSymbolTable>                        mSymbols;
+    std::shared_ptr<JsonShapeTable>                         mShapes;
+    std::unordered_map<std::string_view, const JsonSymbol*> mSymbolCache;
+
+    std::vector<JsonValue*>     mContainers;
+    std::vector<CompactValue>   mStack;
+    std::vector<size_t>         mBases;
+    std::vector<uint32_t>       mKeySlots;      // member + 1, or 0 for an empty slot
+    TapeBuilder::Buffers        mTapeBuffers;
+
+#ifdef YOUNGJSON_STATS
+    JsonStats           mStats;
+    JsonStatsObserver   mStatsObserver;
+    size_t              mDepth;
+    uint64_t            mParseStart;
+#endif
+};
+
+
+// Copies of a reader for the threads of a pool. The copies don't call the reader's statistics
+// observer, which needn't be thread-safe: each copy adds to its own total, and report() passes
+// the sum to the observer on the calling thread.
+class WorkerReaders {
+public:
+    WorkerReaders(const JsonReader& reader, unsigned count) : mReaders(count, reader) {
+#ifdef YOUNGJSON_STATS
+        mTotals.resize(count);
+        for (unsigned i = 0; i < count; i++) {
+            JsonStats* total = &mTotals[i];
+            if (reader.statsObserver())
+                mReaders[i].setStatsObserver([total](const JsonStats& stats) { total->add(stats); });
+        }
+#endif
+    }
+
+    WorkerReaders(const WorkerReaders&) = delete;
+    WorkerReaders& operator =(const WorkerReaders&) = delete;
+
+    JsonReader& operator [](unsigned worker) {
+        return mReaders[worker];
+    }
+
+    // calls the observer of reader once with the statistics of every document the copies read
+    void report(const JsonReader& reader) const {
+#ifdef YOUNGJSON_STATS
+        if (!reader.statsObserver())
+            return;
+        JsonStats total;
+        for (auto& it : mTotals)
+            total.add(it);
+        reader.statsObserver()(total);
+#endif
+    }
+
+private:
+    std::vector<JsonReader> mReaders;
+#ifdef YOUNGJSON_STATS
+    std::vector<JsonStats>  mTotals;
+#endif
 };
 
 }
@@ -0,0 +1,350 @@
+#pragma once
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "jsonvalue.h"
+
+namespace youngJSON {
+
+enum PatchOpT {
+    poAdd,
+    poRemove,
+    poReplace,
+    poMove,
+    poCopy,
+    poTest
+};
+
+// A JSON Patch (RFC 6902), compiled once and applied to any number of documents.
+class JsonPatch {
+public:
+    struct Operation {
+        PatchOpT                    op;
+        std::vector<std::string>    path;       // unescaped JSON Pointer tokens
+        std::vector<std::string>    from;       // for move and copy
+        std::shared_ptr<JsonValue>  value;      // for add, replace and test
+    };
+
+    JsonPatch() {
+    }
+
+    // patch is an array of operation objects; throws std::invalid_argument if it isn't valid
+    explicit JsonPatch(const JsonValue& patch) {
+        if (!patch.isArray())
+            throw std::invalid_argument("invalid patch");
+        for (int i = 0; i < patch.size(); i++) {
+            const JsonValue& it = patch.get(i);
+            if (!it.isObject())
+                throw std::invalid_argument("invalid patch operation");
+            const ValueObject& obj = static_cast<const ValueObject&>(it);
+
+            const JsonValue* op = obj.find("op");
+            const JsonValue* path = obj.find("path");
+            if (!op || !op->isString() || !path || !path->isString())
+                throw std::invalid_argument("invalid patch operation");
+
+            Operation res;
+            size_t n = 0;
+            while (n <= poTest && op->toStringView() != opName(static_cast<PatchOpT>(n)))
+                n++;
+            if (n > poTest)
+                throw std::invalid_argument("unknown patch operation");
+            res.op = static_cast<PatchOpT>(n);
+            res.path = parsePointer(path->toStringView());
+
+            if (res.op == poMove || res.op == poCopy) {
+                const JsonValue* from = obj.find("from");
+                if (!from || !from->isString())
+                    throw std::invalid_argument("invalid patch operation");
+                res.from = parsePointer(from->toStringView());
+            } else if (res.op != poRemove) {
+                const JsonValue* value = obj.find("value");
+                if (!value)
+                    throw std::invalid_argument("invalid patch operation");
+                res.value = copyValue(*value);
+            }
+            mOperations.push_back(std::move(res));
+        }
+    }
+
+    // The operations that turn from into to. Subtrees found equal by their structural hash
+    // are skipped; arrays are compared element by element after their common ends.
+    static JsonPatch diff(const JsonValue& from, const JsonValue& to) {
+        JsonPatch res;
+        std::vector<std::string> path;
+        res.diff(from, to, path);
+        return res;
+    }
+
+    const std::vector<Operation>& operations() const {
+        return mOperations;
+    }
+
+    size_t size() const {
+        return mOperations.size();
+    }
+
+    bool empty() const {
+        return mOperations.empty();
+    }
+
+    // Applies the operations to root in place and returns the root, which is a new value only
+    // when the whole document is replaced. Throws std::invalid_argument when a path is missing
+    // or a test fails; the operations before the failing one stay applied.
+    std::shared_ptr<JsonValue> apply(std::shared_ptr<JsonValue> root) const {
+        for (auto& it : mOperations) {
+            switch (it.op) {
+            case poAdd:
+                add(root, it.path, copyValue(*it.value));
+                break;
+            case poRemove:
+                remove(*root, it.path);
+                break;
+            case poReplace:
+                resolve(*root, it.path);
+                if (it.path.empty())
+                    root = copyValue(*it.value);
+                else
+                    add(root, it.path, copyValue(*it.value), true);
+                break;
+            case poMove:
+            {
+                if (isPrefix(it.from, it.path) && it.from.size() < it.path.size())
+                    throw std::invalid_argument("can't move a value into itself");
+                if (it.from == it.path) {
+                    resolve(*root, it.from);
+                    break;
+                }
+                auto value = copyValue(resolve(*root, it.from));
+                remove(*root, it.from);
+                add(root, it.path, value);
+                break;
+            }
+            case poCopy:
+                add(root, it.path, copyValue(resolve(*root, it.from)));
+                break;
+            case poTest:
+                if (!(resolve(*root, it.path) == *it.value))
+                    throw std::invalid_argument("patch test failed");
+                break;
+            }
+        }
+        return root;
+    }
+
+    std::shared_ptr<ValueArray> toValue() const {
+        auto res = std::make_shared<ValueArray>();
+        res->reserve(mOperations.size());
+        for (auto& it : mOperations) {
+            auto& op = res->add(ValueObject());
+            op.add("op", ValueString(opName(it.op)));
+            if (it.op == poMove || it.op == poCopy)
+                op.add("from", ValueString(formatPointer(it.from)));
+            op.add("path", ValueString(formatPointer(it.path)));
+            if (it.value)
+                op.add("value", 5, copyValue(*it.value));
+        }
+        return res;
+    }
+
+    std::string toString() const {
+        return toValue()->toCompactString();
+    }
+
+    static std::vector<std::string> parsePointer(std::string_view pointer) {
+        std::vector<std::string> res;
+        if (pointer.empty())
+            return res;
+        if (pointer[0] != '/')
+            throw std::invalid_argument("invalid path");
+
+        res.emplace_back();
+        for (size_t i = 1; i < pointer.length(); i++) {
+            char ch = pointer[i];
+            if (ch == '/') {
+                res.emplace_back();
+            } else if (ch != '~') {
+                res.back() += ch;
+            } else if (i + 1 < pointer.length() && (pointer[i + 1] == '0' || pointer[i + 1] == '1')) {
+                res.back() += pointer[++i] == '0' ? '~' : '/';
+            } else {
+                throw std::invalid_argument("invalid path");
+            }
+        }
+        return res;
+    }
+
+    static std::string formatPointer(const std::vector<std::string>& tokens) {
+        std::string res;
+        for (auto& token : tokens) {
+            res += '/';
+            for (char ch : token) {
+                if (ch == '~')
+                    res += "~0";
+                else if (ch == '/')
+                    res += "~1";
+                else
+                    res += ch;
+            }
+        }
+        return res;
+    }
+
+private:
+    static const char* opName(PatchOpT op) {
+        static const char* names[] = { "add", "remove", "replace", "move", "copy", "test" };
+        return names[op];
+    }
+
+    static bool isSame(const JsonValue& lhs, const JsonValue& rhs) {
+        return &lhs == &rhs || (lhs.hash() == rhs.hash() && lhs == rhs);
+    }
+
+    void diff(const JsonValue& from, const JsonValue& to, std::vector<std::string>& path) {
+        if (isSame(from, to))
+            return;
+
+        if (from.isObject() && to.isObject()) {
+            const ValueObject& lhs = static_cast<const ValueObject&>(from);
+            const ValueObject& rhs = static_cast<const ValueObject&>(to);
+            lhs.forEach([&](std::string_view name, const JsonValue& value) {
+                path.emplace_back(name);
+                if (const JsonValue* other = rhs.find(name))
+                    diff(value, *other, path);
+                else
+                    mOperations.push_back(Operation{ poRemove, path, {}, nullptr });
+                path.pop_back();
+            });
+            rhs.forEach([&](std::string_view name, const JsonValue& value) {
+                if (lhs.find(name))
+                    return;
+                path.emplace_back(name);
+                mOperations.push_back(Operation{ poAdd, path, {}, copyValue(value) });
+                path.pop_back();
+            });
+        } else if (from.isArray() && to.isArray()) {
+            int n = from.size(), m = to.size();
+            int head = 0, tail = 0;
+            while (head < n && head < m && isSame(from.get(head), to.get(head)))
+                head++;
+            while (tail < n - head && tail < m - head && isSame(from.get(n - 1 - tail), to.get(m - 1 - tail)))
+                tail++;
+
+            // the elements between the common ends are changed in place, then the rest of
+            // the old ones are removed from the back or the rest of the new ones added
+            int common = (n < m ? n : m) - head - tail;
+            for (int i = head; i < head + common; i++) {
+                path.push_back(std::to_string(i));
+                diff(from.get(i), to.get(i), path);
+                path.pop_back();
+            }
+            for (int i = n - tail - 1; i >= head + common; i--) {
+                path.push_back(std::to_string(i));
+                mOperations.push_back(Operation{ poRemove, path, {}, nullptr });
+                path.pop_back();
+            }
+            for (int i = head + common; i < m - tail; i++) {
+                path.push_back(std::to_string(i));
+                mOperations.push_back(Operation{ poAdd, path, {}, copyValue(to.get(i)) });
+                path.pop_back();
+            }
+        } else {
+            mOperations.push_back(Operation{ poReplace, path, {}, copyValue(to) });
+        }
+    }
+
+    static bool isPrefix(const std::vector<std::string>& prefix, const std::vector<std::string>& path) {
+        if (prefix.size() > path.size())
+            return false;
+        for (size_t i = 0; i < prefix.size(); i++) {
+            if (prefix[i] != path[i])
+                return false;
+        }
+        return true;
+    }
+
+    // an array index without leading zeros; size is accepted only when end is true
+    static int parseIndex(const std::string& token, int size, bool end) {
+        if (token.empty() || token.length() > 9 || (token[0] == '0' && token.length() > 1))
+            throw std::invalid_argument("invalid array index");
+        int index = 0;
+        for (char ch : token) {
+            if (ch < '0' || ch > '9')
+                throw std::invalid_argument("invalid array index");
+            index = index * 10 + (ch - '0');
+        }
+        if (index > size || (index == size && !end))
+            throw std::invalid_argument("index out of range");
+        return index;
+    }
+
+    static JsonValue* child(JsonValue& parent, const std::string& token) {
+        if (parent.isObject())
+            return static_cast<ValueObject&>(parent).find(token);
+        if (parent.isArray())
+            return &parent.get(parseIndex(token, parent.size(), false));
+        return nullptr;
+    }
+
+    static JsonValue& resolve(JsonValue& root, const std::vector<std::string>& path, size_t count) {
+        JsonValue* value = &root;
+        for (size_t i = 0; i < count; i++) {
+            value = child(*value, path[i]);
+            if (!value)
+                throw std::invalid_argument("can't find the path");
+        }
+        return *value;
+    }
+
+    static JsonValue& resolve(JsonValue& root, const std::vector<std::string>& path) {
+        return resolve(root, path, path.size());
+    }
+
+    // replace requires the member to exist already, which resolve() has checked
+    static void add(std::shared_ptr<JsonValue>& root, const std::vector<std::string>& path,
+                    std::shared_ptr<JsonValue> value, bool replace = false) {
+        if (path.empty()) {
+            root = std::move(value);
+            return;
+        }
+        JsonValue& parent = resolve(*root, path, path.size() - 1);
+        const std::string& last = path.back();
+        if (parent.isObject()) {
+            static_cast<ValueObject&>(parent).add(last, std::move(value));
+        } else if (parent.isArray()) {
+            ValueArray& arr = static_cast<ValueArray&>(parent);
+            if (replace)
+                arr.set(parseIndex(last, arr.size(), false), std::move(value));
+            else if (last == "-")
+                arr.add(std::move(value));
+            else
+                arr.insert(parseIndex(last, arr.size(), true), std::move(value));
+        } else {
+            throw std::invalid_argument("can't find the path");
+        }
+    }
+
+    static void remove(JsonValue& root, const std::vector<std::string>& path) {
+        if (path.empty())
+            throw std::invalid_argument("can't remove the root");
+        JsonValue& parent = resolve(root, path, path.size() - 1);
+        const std::string& last = path.back();
+        if (parent.isObject()) {
+            if (!static_cast<ValueObject&>(parent).remove(last))
+                throw std::invalid_argument("can't find the path");
+        } else if (parent.isArray()) {
+            static_cast<ValueArray&>(parent).remove(parseIndex(last, parent.size(), false));
+        } else {
+            throw std::invalid_argument("can't find the path");
+        }
+    }
+
+private:
+    std::vector<Operation>  mOperations;
+};
+
+}
@@ -0,0 +1,413 @@
+#pragma once
+
+#include <climits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "jsonparser.h"
+#include "jsonpushparser.h"
+
+namespace youngJSON {
+
+enum PathStepKindT {
+    pkName,         // member name; in a JSON Pointer, also an array index when it is a number
+    pkIndex,        // array index, negative from the end
+    pkWildcard,     // every member or element
+    pkSlice         // [start:end:step] of an array
+};
+
+// A query compiled once and run on a tree or while parsing.
+//  - JSON Pointer (RFC 6901)  : "", "/data/0/id", "/a~1b/m~0n", and "/data/*/id" as a wildcard
+//  - JSONPath subset          : $.data[*].id, $['a b'][-1], $.items[2:10:2], $.*
+class JsonPath {
+public:
+    explicit JsonPath(std::string_view path) {
+        if (!path.empty() && path[0] == '$')
+            compilePath(path);
+        else
+            compilePointer(path);
+    }
+
+    size_t size() const {
+        return mSteps.size();
+    }
+
+    // every matching value in document order
+    std::vector<const JsonValue*> select(const JsonValue& root) const {
+        std::vector<const JsonValue*> res;
+        select(root, 0, res);
+        return res;
+    }
+
+    // the first matching value, or nullptr
+    const JsonValue* find(const JsonValue& root) const {
+        auto res = select(root);
+        return res.empty() ? nullptr : res.front();
+    }
+
+    // Parses src and calls fn(std::shared_ptr<JsonValue>) for every matching value. Only
+    // the matching subtrees are built; the rest of the input is validated and dropped.
+    // Returns the number of matches.
+    template <typename Function>
+    size_t extract(JsonReader& reader, const unsigned char* src, int length, Function fn) const {
+        for (auto& step : mSteps) {
+            if ((step.kind == pkIndex && step.index < 0) ||
+                (step.kind == pkSlice && ((step.hasStart && step.start < 0) || (step.hasEnd && step.end < 0))))
+                throw std::invalid_argument("a negative index needs the size of the array");
+        }
+
+        size_t count = 0;
+        auto counter = [&](std::shared_ptr<JsonValue> value) {
+            count++;
+            fn(std::move(value));
+        };
+        Extractor<decltype(counter)> extractor(*this, counter);
+        reader.parse(src, length, extractor);
+        return count;
+    }
+
+    template <typename Function>
+    size_t extract(JsonReader& reader, const std::string& src, Function fn) const {
+        return extract(reader, (const unsigned char*)src.data(), inputLength(src.length()), fn);
+    }
+
+private:
+    struct Step {
+        PathStepKindT   kind;
+        std::string     name;
+        long long       index = -1;
+        long long       start = 0;
+        long long       end = 0;
+        long long       stride = 1;
+        bool            hasStart = false;
+        bool            hasEnd = false;
+    };
+
+    // passes the events of every matching value to a ValueBuilder
+    template <typename Function>
+    class Extractor {
+    public:
+        Extractor(const JsonPath& path, Function fn) : mPath(path), mBuilder(fn), mForward(0) {
+        }
+
+        void null() {
+            if (beginValue())
+                mBuilder.null();
+        }
+
+        void boolean(bool value) {
+            if (beginValue())
+                mBuilder.boolean(value);
+        }
+
+        void number(const JsonNumber& value, std::string_view lexeme) {
+            if (beginValue())
+                mBuilder.number(value, lexeme);
+        }
+
+        void string(std::string_view s) {
+            if (beginValue())
+                mBuilder.string(s);
+        }
+
+        void key(std::string_view name) {
+            if (mForward > 0)
+                mBuilder.key(name);
+            else if (mFrames.back().onPath)
+                mKey.assign(name.data(), name.length());
+        }
+
+        void startObject() {
+            if (startContainer(false))
+                mBuilder.startObject();
+        }
+
+        void endObject() {
+            if (endContainer())
+                mBuilder.endObject();
+        }
+
+        void startArray() {
+            if (startContainer(true))
+                mBuilder.startArray();
+        }
+
+        void endArray() {
+            if (endContainer())
+                mBuilder.endArray();
+        }
+
+    private:
+        struct Frame {
+            bool        onPath;     // every step up to this container matched
+            bool        isArray;
+            long long   index;
+        };
+
+        // returns whether the value is forwarded; onPath tells whether a container's
+        // children may still match
+        bool beginValue(bool* onPath = nullptr) {
+            if (mForward > 0)
+                return true;
+
+            bool matched;
+            if (mFrames.empty()) {
+                matched = true;
+            } else {
+                Frame& frame = mFrames.back();
+                const size_t depth = mFrames.size() - 1;
+                if (frame.isArray) {
+                    long long index = frame.index++;
+                    matched = frame.onPath && mPath.matchesIndex(mPath.mSteps[depth], index, LLONG_MAX);
+                } else {
+                    matched = frame.onPath && mPath.matchesName(mPath.mSteps[depth], mKey);
+                }
+            }
+
+            bool last = mFrames.size() == mPath.mSteps.size();
+            if (onPath)
+                *onPath = matched && !last;
+            return matched && last;
+        }
+
+        bool startContainer(bool isArray) {
+            if (mForward > 0) {
+                mForward++;
+                return true;
+            }
+            bool onPath;
+            if (beginValue(&onPath)) {
+                mForward = 1;
+                return true;
+            }
+            mFrames.push_back(Frame{ onPath, isArray, 0 });
+            return false;
+        }
+
+        bool endContainer() {
+            if (mForward > 0) {
+                mForward--;
+                return true;
+            }
+            mFrames.pop_back();
+            return false;
+        }
+
+    private:
+        const JsonPath&             mPath;
+        ValueBuilder<Function>      mBuilder;
+        std::vector<Frame>          mFrames;
+        std::string                 mKey;
+        size_t                      mForward;   // depth inside the value being forwarded
+    };
+
+    void select(const JsonValue& value, size_t depth, std::vector<const JsonValue*>& res) const {
+        if (depth == mSteps.size()) {
+            res.push_back(&value);
+            return;
+        }
+
+        const Step& step = mSteps[depth];
+        if (value.isObject()) {
+            const ValueObject& obj = static_cast<const ValueObject&>(value);
+            if (step.kind == pkName) {
+                if (const JsonValue* child = obj.find(step.name))
+                    select(*child, depth + 1, res);
+            } else if (step.kind == pkWildcard) {
+                obj.forEach([&](std::string_view, const JsonValue& child) {
+                    select(child, depth + 1, res);
+                });
+            }
+        } else if (value.isArray()) {
+            long long first, last, stride;
+            if (!range(step, value.size(), first, last, stride))
+                return;
+            for (long long i = first; i < last; i += stride)
+                select(value.get(static_cast<int>(i)), depth + 1, res);
+        }
+    }
+
+    bool matchesName(const Step& step, std::string_view name) const {
+        return step.kind == pkWildcard || (step.kind == pkName && step.name == name);
+    }
+
+    bool matchesIndex(const Step& step, long long index, long long size) const {
+        long long first, last, stride;
+        if (!range(step, size, first, last, stride))
+            return false;
+        return index >= first && index < last && (index - first) % stride == 0;
+    }
+
+    // the indexes [first, last) of an array of size elements that the step selects
+    static bool range(const Step& step, long long size, long long& first, long long& last, long long& stride) {
+        first = last = 0;
+        stride = 1;
+        switch (step.kind) {
+        case pkName:
+            if (step.index < 0)
+                return false;
+            first = step.index;
+            last = first + 1;
+            break;
+        case pkIndex:
+            first = step.index < 0 ? step.index + size : step.index;
+            last = first + 1;
+            break;
+        case pkWildcard:
+            first = 0;
+            last = size;
+            break;
+        case pkSlice:
+            first = !step.hasStart ? 0 : step.start < 0 ? step.start + size : step.start;
+            last = !step.hasEnd ? size : step.end < 0 ? step.end + size : step.end;
+            stride = step.stride;
+            break;
+        }
+        first = first < 0 ? 0 : first;
+        last = last > size ? size : last;
+        return first < last;
+    }
+
+    void compilePointer(std::string_view path) {
+        if (path.empty())
+            return;
+        if (path[0] != '/')
+            throw std::invalid_argument("invalid path");
+
+        size_t pos = 1;
+        while (true) {
+            size_t next = path.find('/', pos);
+            std::string_view token = path.substr(pos, next == std::string_view::npos ? std::string_view::npos : next - pos);
+
+            Step step;
+            step.kind = token == "*" ? pkWildcard : pkName;
+            for (size_t i = 0; i < token.length(); i++) {
+                if (token[i] != '~') {
+                    step.name += token[i];
+                } else if (i + 1 < token.length() && (token[i + 1] == '0' || token[i + 1] == '1')) {
+                    step.name += token[++i] == '0' ? '~' : '/';
+                } else {
+                    throw std::invalid_argument("invalid path");
+                }
+            }
+
+            // array indexes have no leading zeros
+            const std::string& s = step.name;
+            if (!s.empty() && s.length() <= 18 && s.find_first_not_of("0123456789") == std::string::npos &&
+                (s[0] != '0' || s.length() == 1))
+                step.index = std::stoll(s);
+            mSteps.push_back(std::move(step));
+
+            if (next == std::string_view::npos)
+                break;
+            pos = next + 1;
+        }
+    }
+
+    void compilePath(std::string_view path) {
+        size_t pos = 1;
+        while (pos < path.length()) {
+            Step step;
+            if (path[pos] == '.') {
+                ++pos;
+                if (pos < path.length() && path[pos] == '*') {
+                    step.kind = pkWildcard;
+                    ++pos;
+                } else {
+                    size_t first = pos;
+                    while (pos < path.length() && path[pos] != '.' && path[pos] != '[')
+                        ++pos;
+                    if (pos == first)
+                        throw std::invalid_argument("invalid path");
+                    step.kind = pkName;
+                    step.name.assign(path.data() + first, pos - first);
+                }
+            } else if (path[pos] == '[') {
+                pos = compileBracket(path, pos + 1, step);
+            } else {
+                throw std::invalid_argument("invalid path");
+            }
+            mSteps.push_back(std::move(step));
+        }
+    }
+
+    // pos is after '['; returns the position after ']'
+    static size_t compileBracket(std::string_view path, size_t pos, Step& step) {
+        auto skipSpace = [&] {
+            while (pos < path.length() && path[pos] == ' ')
+                ++pos;
+        };
+        auto peek = [&] {
+            return pos < path.length() ? path[pos] : '\0';
+        };
+        auto readInt = [&](long long& out) {
+            size_t first = pos;
+            if (peek() == '-')
+                ++pos;
+            while (pos < path.length() && isJsonDigit(path[pos]))
+                ++pos;
+            if (pos == first || (pos == first + 1 && path[first] == '-') || pos - first > 18)
+                throw std::invalid_argument("invalid path");
+            out = std::stoll(std::string(path.data() + first, pos - first));
+        };
+
+        skipSpace();
+        char ch = peek();
+        if (ch == '*') {
+            step.kind = pkWildcard;
+            ++pos;
+        } else if (ch == '\'' || ch == '\"') {
+            step.kind = pkName;
+            ++pos;
+            while (peek() != ch) {
+                if (pos >= path.length())
+                    throw std::invalid_argument("invalid path");
+                if (path[pos] == '\\' && pos + 1 < path.length())
+                    ++pos;
+                step.name += path[pos++];
+            }
+            ++pos;
+        } else {
+            step.kind = pkIndex;
+            if (peek() != ':') {
+                readInt(step.start);
+                step.hasStart = true;
+            }
+            skipSpace();
+            if (peek() == ':') {
+                step.kind = pkSlice;
+                ++pos;
+                skipSpace();
+                if (peek() != ':' && peek() != ']') {
+                    readInt(step.end);
+                    step.hasEnd = true;
+                }
+                skipSpace();
+                if (peek() == ':') {
+                    ++pos;
+                    skipSpace();
+                    readInt(step.stride);
+                    if (step.stride <= 0)
+                        throw std::invalid_argument("invalid path");
+                }
+            } else if (!step.hasStart) {
+                throw std::invalid_argument("invalid path");
+            } else {
+                step.index = step.start;
+            }
+        }
+
+        skipSpace();
+        if (peek() != ']')
+            throw std::invalid_argument("invalid path");
+        return pos + 1;
+    }
+
+private:
+    std::vector<Step>   mSteps;
+};
+
+}
@@ -0,0 +1,565 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "jsonscan.h"
+
+namespace youngJSON {
+
+// A regular expression in the ECMAScript syntax of JSON Schema, compiled to a Thompson NFA.
+// A search runs every thread in step over the subject once, so its time is linear in the
+// subject and its memory doesn't depend on it, with every standard library alike.
+// Back-references and lookaround need backtracking and throw std::invalid_argument, as do
+// syntax errors. The subject is UTF-8; a class or a dot matches one code point.
+class JsonPattern {
+public:
+    // instructions after counted repeats are expanded; a longer program throws
+    static const size_t MAX_PROGRAM_SIZE = 16 * 1024;
+
+    explicit JsonPattern(std::string_view source) : mSource(source), mPos(0) {
+        Expr root = parseAlternative(0);
+        if (mPos != mSource.length())
+            fail();
+        emit(root);
+        push(opMatch);
+        mSource = std::string_view();
+    }
+
+    // whether the pattern matches anywhere in subject
+    bool search(std::string_view subject) const {
+        std::vector<uint32_t> current, next, stack;
+        std::vector<size_t> marks(mProgram.size(), 0);
+        size_t generation = 1;
+        size_t pos = 0;
+        uint32_t prev = NO_CHAR;
+        uint32_t ch = pos < subject.length() ? decode(subject, pos) : NO_CHAR;
+
+        while (true) {
+            // a thread starts at every position, which leaves the search unanchored
+            if (addThread(0, generation, prev, ch, current, marks, stack))
+                return true;
+            if (ch == NO_CHAR)
+                return false;
+
+            uint32_t following = pos < subject.length() ? decode(subject, pos) : NO_CHAR;
+            ++generation;
+            next.clear();
+            for (uint32_t pc : current) {
+                if (matches(mProgram[pc].x, ch) && addThread(pc + 1, generation, ch, following, next, marks, stack))
+                    return true;
+            }
+            current.swap(next);
+            prev = ch;
+            ch = following;
+        }
+    }
+
+private:
+    enum ExprKind { ekClass, ekAssert, ekConcat, ekAlternate, ekRepeat };
+    enum OpCode { opClass, opAssert, opSplit, opJump, opMatch };
+    enum Assertion { asBegin, asEnd, asWordBoundary, asNotWordBoundary };
+
+    // a byte that starts no valid UTF-8 sequence is read as INVALID_BYTE plus its value
+    static const uint32_t INVALID_BYTE = 0x110000;
+    static const uint32_t MAX_CHAR = INVALID_BYTE + 0xff;
+    static const uint32_t NO_CHAR = 0xffffffff;     // before the start and after the end
+
+    static const int MAX_DEPTH = 256;
+    static const int UNBOUNDED = -1;
+
+    struct Range {
+        uint32_t first;
+        uint32_t last;
+    };
+    typedef std::vector<Range> CharSet;     // sorted and disjoint once compiled
+
+    struct Expr {
+        explicit Expr(ExprKind k) : kind(k) {}
+
+        ExprKind            kind;
+        uint32_t            arg = 0;    // class index or assertion
+        int                 min = 0;
+        int                 max = 0;    // UNBOUNDED or at least min
+        std::vector<Expr>   children;
+    };
+
+    struct Instruction {
+        OpCode      op;
+        uint32_t    x;      // class index, assertion or target
+        uint32_t    y;      // the other target of a split
+    };
+
+    [[noreturn]] static void fail() {
+        throw std::invalid_argument("invalid pattern");
+    }
+
+    char peek() const {
+        return mPos < mSource.length() ? mSource[mPos] : '\0';
+    }
+
+    bool accept(char ch) {
+        if (mPos >= mSource.length() || mSource[mPos] != ch)
+            return false;
+        ++mPos;
+        return true;
+    }
+
+    Expr parseAlternative(int depth) {
+        if (depth > MAX_DEPTH)
+            fail();
+        Expr first = parseSequence(depth);
+        if (peek() != '|')
+            return first;
+
+        Expr alternate(ekAlternate);
+        alternate.children.push_back(std::move(first));
+        while (accept('|'))
+            alternate.children.push_back(parseSequence(depth));
+        return alternate;
+    }
+
+    Expr parseSequence(int depth) {
+        Expr sequence(ekConcat);
+        while (mPos < mSource.length() && peek() != '|' && peek() != ')')
+            sequence.children.push_back(parseTerm(depth));
+        return sequence;
+    }
+
+    Expr parseTerm(int depth) {
+        Expr atom = parseAtom(depth);
+        int min, max;
+        if (!parseQuantifier(min, max))
+            return atom;
+        if (atom.kind == ekAssert)
+            fail();
+        accept('?');    // a lazy repeat matches the same strings
+
+        Expr repeat(ekRepeat);
+        repeat.min = min;
+        repeat.max = max;
+        repeat.children.push_back(std::move(atom));
+        return repeat;
+    }
+
+    bool parseQuantifier(int& min, int& max) {
+        switch (peek()) {
+        case '*': min = 0; max = UNBOUNDED; break;
+        case '+': min = 1; max = UNBOUNDED; break;
+        case '?': min = 0; max = 1; break;
+        case '{': return parseBraces(min, max);
+        default: return false;
+        }
+        ++mPos;
+        return true;
+    }
+
+    // {n}, {n,} or {n,m}; anything else leaves '{' a literal
+    bool parseBraces(int& min, int& max) {
+        size_t pos = mPos + 1;
+        if (!readCount(pos, min))
+            return false;
+        max = min;
+        if (pos < mSource.length() && mSource[pos] == ',') {
+            ++pos;
+            max = UNBOUNDED;
+            if (pos < mSource.length() && isJsonDigit(mSource[pos]))
+                readCount(pos, max);
+        }
+        if (pos >= mSource.length() || mSource[pos] != '}')
+            return false;
+        if (max != UNBOUNDED && max < min)
+            fail();
+        mPos = pos + 1;
+        return true;
+    }
+
+    // counts beyond the program size can't compile, so they are clamped
+    bool readCount(size_t& pos, int& out) const {
+        size_t first = pos;
+        out = 0;
+        while (pos < mSource.length() && isJsonDigit(mSource[pos])) {
+            out = std::min(out * 10 + (mSource[pos] - '0'), static_cast<int>(MAX_PROGRAM_SIZE) + 1);
+            ++pos;
+        }
+        return pos > first;
+    }
+
+    Expr parseAtom(int depth) {
+        int min, max;
+        switch (peek()) {
+        case '^':
+            ++mPos;
+            return assertion(asBegin);
+        case '$':
+            ++mPos;
+            return assertion(asEnd);
+        case '.': {
+            ++mPos;
+            CharSet lineTerminators = {{'\n', '\n'}, {'\r', '\r'}, {0x2028, 0x2029}};
+            return charClass(lineTerminators, true);
+        }
+        case '(':
+            ++mPos;
+            return parseGroup(depth);
+        case '[':
+            ++mPos;
+            return parseClass();
+        case '\\':
+            ++mPos;
+            return parseEscape();
+        case '*':
+        case '+':
+        case '?':
+            fail();
+        case '{':
+            if (parseBraces(min, max))
+                fail();
+            break;
+        }
+        uint32_t ch = decode(mSource, mPos);
+        return charClass({{ch, ch}});
+    }
+
+    Expr parseGroup(int depth) {
+        if (accept('?')) {
+            if (accept(':')) {
+            } else if (accept('<') && peek() != '=' && peek() != '!') {
+                // a named group; the name only matters to back-references
+                size_t end = mSource.find('>', mPos);
+                if (end == std::string_view::npos || end == mPos)
+                    fail();
+                mPos = end + 1;
+            } else {
+                fail();
+            }
+        }
+        Expr group = parseAlternative(depth + 1);
+        if (!accept(')'))
+            fail();
+        if (group.kind == ekAssert) {
+            Expr sequence(ekConcat);
+            sequence.children.push_back(std::move(group));
+            return sequence;
+        }
+        return group;
+    }
+
+    Expr parseClass() {
+        bool negate = accept('^');
+        CharSet set;
+        while (!accept(']')) {
+            if (mPos >= mSource.length())
+                fail();
+            CharSet escapes;
+            uint32_t first = parseClassAtom(escapes);
+            if (peek() == '-' && mPos + 1 < mSource.length() && mSource[mPos + 1] != ']') {
+                ++mPos;
+                uint32_t last = parseClassAtom(escapes);
+                if (first != NO_CHAR && last != NO_CHAR) {
+                    if (first > last)
+                        fail();
+                    set.push_back({first, last});
+                    continue;
+                }
+                // a class escape such as \d bounds no range, so the '-' is literal
+                set.push_back({'-', '-'});
+                if (last != NO_CHAR)
+                    set.push_back({last, last});
+            }
+            if (first != NO_CHAR)
+                set.push_back({first, first});
+            set.insert(set.end(), escapes.begin(), escapes.end());
+        }
+        return charClass(set, negate);
+    }
+
+    // returns the character, or NO_CHAR after adding a class escape to escapes
+    uint32_t parseClassAtom(CharSet& escapes) {
+        if (!accept('\\'))
+            return decode(mSource, mPos);
+        if (mPos >= mSource.length())
+            fail();
+        char ch = mSource[mPos++];
+        if (ch == 'b')
+            return '\b';
+        if (ch == '-')
+            return '-';
+        if (classEscape(ch, escapes))
+            return NO_CHAR;
+        return charEscape(ch);
+    }
+
+    Expr parseEscape() {
+        if (mPos >= mSource.length())
+            fail();
+        char ch = mSource[mPos++];
+        if (ch == 'b')
+            return assertion(asWordBoundary);
+        if (ch == 'B')
+            return assertion(asNotWordBoundary);
+        CharSet set;
+        if (classEscape(ch, set))
+            return charClass(set);
+        uint32_t code = charEscape(ch);
+        return charClass({{code, code}});
+    }
+
+    static bool classEscape(char ch, CharSet& set) {
+        static const CharSet digits = {{'0', '9'}};
+        static const CharSet word = {{'0', '9'}, {'A', 'Z'}, {'_', '_'}, {'a', 'z'}};
+        static const CharSet space = {{0x09, 0x0d}, {0x20, 0x20}, {0xa0, 0xa0}, {0x1680, 0x1680},
+                                      {0x2000, 0x200a}, {0x2028, 0x2029}, {0x202f, 0x202f},
+                                      {0x205f, 0x205f}, {0x3000, 0x3000}, {0xfeff, 0xfeff}};
+        const CharSet* base;
+        switch (ch | 0x20) {
+        case 'd': base = &digits; break;
+        case 'w': base = &word; break;
+        case 's': base = &space; break;
+        default: return false;
+        }
+        CharSet add = (ch & 0x20) ? *base : complement(*base);
+        set.insert(set.end(), add.begin(), add.end());
+        return true;
+    }
+
+    // ch, after the backslash, has been consumed
+    uint32_t charEscape(char ch) {
+        switch (ch) {
+        case 't': return '\t';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 'f': return '\f';
+        case 'v': return '\v';
+        case '0':
+            if (isJsonDigit(peek()))
+                fail();
+            return 0;
+        case 'c':
+            if (!isJsonAlpha(peek()))
+                fail();
+            return mSource[mPos++] % 32;
+        case 'x':
+            return readHex(2);
+        case 'u': {
+            uint32_t code = readHex(4);
+            if (code >= 0xd800 && code <= 0xdbff && mSource.substr(mPos, 2) == "\\u") {
+                size_t pos = mPos;
+                mPos += 2;
+                uint32_t low = readHex(4);
+                if (low >= 0xdc00 && low <= 0xdfff)
+                    return 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                mPos = pos;
+            }
+            return code;
+        }
+        }
+        // back-references, \k<name> and unknown letters are errors; the rest stand for themselves
+        if (isJsonAlpha(ch) || isJsonDigit(ch))
+            fail();
+        return decode(mSource, --mPos);
+    }
+
+    uint32_t readHex(int digits) {
+        uint32_t code = 0;
+        for (int i = 0; i < digits; i++) {
+            char ch = peek();
+            if (!isJsonHex(ch))
+                fail();
+            code = code * 16 + (isJsonDigit(ch) ? ch - '0' : (ch | 0x20) - 'a' + 10);
+            ++mPos;
+        }
+        return code;
+    }
+
+    static CharSet normalize(CharSet set) {
+        std::sort(set.begin(), set.end(), [](const Range& a, const Range& b) { return a.first < b.first; });
+        CharSet res;
+        for (const Range& r : set) {
+            if (!res.empty() && r.first <= res.back().last + 1)
+                res.back().last = std::max(res.back().last, r.last);
+            else
+                res.push_back(r);
+        }
+        return res;
+    }
+
+    static CharSet complement(const CharSet& set) {
+        CharSet sorted = normalize(set);
+        CharSet res;
+        uint32_t next = 0;
+        for (const Range& r : sorted) {
+            if (r.first > next)
+                res.push_back({next, r.first - 1});
+            next = r.last + 1;
+        }
+        if (next <= MAX_CHAR)
+            res.push_back({next, MAX_CHAR});
+        return res;
+    }
+
+    Expr charClass(const CharSet& set, bool negate = false) {
+        Expr expr(ekClass);
+        expr.arg = static_cast<uint32_t>(mClasses.size());
+        mClasses.push_back(negate ? complement(set) : normalize(set));
+        return expr;
+    }
+
+    static Expr assertion(Assertion kind) {
+        Expr expr(ekAssert);
+        expr.arg = kind;
+        return expr;
+    }
+
+    uint32_t push(OpCode op, size_t x = 0) {
+        if (mProgram.size() >= MAX_PROGRAM_SIZE)
+            fail();
+        mProgram.push_back({op, static_cast<uint32_t>(x), 0});
+        return static_cast<uint32_t>(mProgram.size() - 1);
+    }
+
+    void emit(const Expr& expr) {
+        switch (expr.kind) {
+        case ekClass:
+            push(opClass, expr.arg);
+            break;
+        case ekAssert:
+            push(opAssert, expr.arg);
+            break;
+        case ekConcat:
+            for (const Expr& child : expr.children)
+                emit(child);
+            break;
+        case ekAlternate: {
+            std::vector<uint32_t> jumps;
+            for (size_t i = 0; i + 1 < expr.children.size(); i++) {
+                uint32_t split = push(opSplit, mProgram.size() + 1);
+                emit(expr.children[i]);
+                jumps.push_back(push(opJump));
+                mProgram[split].y = static_cast<uint32_t>(mProgram.size());
+            }
+            emit(expr.children.back());
+            for (uint32_t jump : jumps)
+                mProgram[jump].x = static_cast<uint32_t>(mProgram.size());
+            break;
+        }
+        case ekRepeat: {
+            const Expr& child = expr.children[0];
+            for (int i = 0; i < expr.min; i++)
+                emit(child);
+            if (expr.max == UNBOUNDED) {
+                uint32_t split = push(opSplit, mProgram.size() + 1);
+                emit(child);
+                push(opJump, split);
+                mProgram[split].y = static_cast<uint32_t>(mProgram.size());
+            } else {
+                // each optional copy may skip to the end
+                std::vector<uint32_t> splits;
+                for (int i = expr.min; i < expr.max; i++) {
+                    splits.push_back(push(opSplit, mProgram.size() + 1));
+                    emit(child);
+                }
+                for (uint32_t split : splits)
+                    mProgram[split].y = static_cast<uint32_t>(mProgram.size());
+            }
+            break;
+        }
+        }
+    }
+
+    // decodes the UTF-8 sequence at pos and moves past it
+    static uint32_t decode(std::string_view s, size_t& pos) {
+        static const uint32_t least[] = {0, 0, 0x80, 0x800, 0x10000};
+        unsigned char lead = static_cast<unsigned char>(s[pos]);
+        if (lead < 0x80) {
+            ++pos;
+            return lead;
+        }
+        size_t length = lead >= 0xf8 ? 0 : lead >= 0xf0 ? 4 : lead >= 0xe0 ? 3 : lead >= 0xc0 ? 2 : 0;
+        if (length == 0 || pos + length > s.length()) {
+            ++pos;
+            return INVALID_BYTE + lead;
+        }
+        uint32_t code = lead & (0x7f >> length);
+        for (size_t i = 1; i < length; i++) {
+            unsigned char ch = static_cast<unsigned char>(s[pos + i]);
+            if ((ch & 0xc0) != 0x80) {
+                ++pos;
+                return INVALID_BYTE + lead;
+            }
+            code = (code << 6) | (ch & 0x3f);
+        }
+        if (code < least[length] || code > 0x10ffff) {
+            ++pos;
+            return INVALID_BYTE + lead;
+        }
+        pos += length;
+        return code;
+    }
+
+    static bool isWordChar(uint32_t ch) {
+        return ch < 0x80 && (isJsonAlpha(static_cast<unsigned char>(ch)) || isJsonDigit(static_cast<unsigned char>(ch)) || ch == '_');
+    }
+
+    static bool holds(uint32_t kind, uint32_t prev, uint32_t ch) {
+        switch (kind) {
+        case asBegin: return prev == NO_CHAR;
+        case asEnd: return ch == NO_CHAR;
+        case asWordBoundary: return isWordChar(prev) != isWordChar(ch);
+        default: return isWordChar(prev) == isWordChar(ch);
+        }
+    }
+
+    bool matches(uint32_t cls, uint32_t ch) const {
+        const CharSet& set = mClasses[cls];
+        auto it = std::upper_bound(set.begin(), set.end(), ch, [](uint32_t c, const Range& r) { return c < r.first; });
+        return it != set.begin() && ch <= (it - 1)->last;
+    }
+
+    // follows the jumps from pc between prev and ch, and adds the threads that wait for a
+    // character to list; returns true on reaching the end of the pattern
+    bool addThread(uint32_t pc, size_t generation, uint32_t prev, uint32_t ch, std::vector<uint32_t>& list,
+                   std::vector<size_t>& marks, std::vector<uint32_t>& stack) const {
+        stack.clear();
+        stack.push_back(pc);
+        while (!stack.empty()) {
+            pc = stack.back();
+            stack.pop_back();
+            if (marks[pc] == generation)
+                continue;
+            marks[pc] = generation;
+
+            const Instruction& in = mProgram[pc];
+            switch (in.op) {
+            case opClass:
+                list.push_back(pc);
+                break;
+            case opAssert:
+                if (holds(in.x, prev, ch))
+                    stack.push_back(pc + 1);
+                break;
+            case opSplit:
+                stack.push_back(in.y);
+                stack.push_back(in.x);
+                break;
+            case opJump:
+                stack.push_back(in.x);
+                break;
+            case opMatch:
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    std::string_view            mSource;    // while compiling
+    size_t                      mPos;
+    std::vector<CharSet>        mClasses;
+    std::vector<Instruction>    mProgram;
+};
+
+}
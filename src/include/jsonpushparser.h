@@ -0,0 +1,485 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "jsonparser.h"
+
+namespace youngJSON {
+
+// Incremental parser for input that arrives in chunks. feed() can be called with any split
+// of the input, including the middle of a string, an escape sequence or a number, and reports
+// the same events as JsonReader::parse as soon as each token is complete.
+// Only UTF-8 input is supported.
+template <typename Handler>
+class JsonPushParser {
+public:
+    explicit JsonPushParser(Handler& handler) : mHandler(handler), mMultipleValues(false) {
+        reset();
+    }
+
+    // accepts a sequence of top-level values separated by whitespace (e.g. JSON Lines)
+    void setMultipleValues(bool enable) {
+        mMultipleValues = enable;
+    }
+
+    bool multipleValues() const {
+        return mMultipleValues;
+    }
+
+    // Consumes a chunk. The chunk is not referenced after the call returns.
+    // Returns false once the handler has stopped parsing.
+    bool feed(const char* data, size_t length) {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+        const unsigned char* pEnd = p + length;
+
+        while (p < pEnd && mState != psStopped) {
+            switch (mState) {
+            case psString:
+                p = continueString(p, pEnd);
+                break;
+            case psEscape:
+                p = continueEscape(p);
+                break;
+            case psUnicode:
+                p = continueUnicode(p, pEnd);
+                break;
+            case psSurrogate:
+                if (*p == '\\') {
+                    ++p;
+                    mState = psSurrogateU;
+                } else {
+                    appendUTF8(mToken, 0xFFFD);
+                    mHighSurrogate = 0;
+                    mState = psString;
+                }
+                break;
+            case psSurrogateU:
+                if (*p == 'u') {
+                    ++p;
+                    mCode = 0;
+                    mHexCount = 0;
+                    mState = psUnicode;
+                } else {
+                    // not a low surrogate : p is the character of an ordinary escape
+                    appendUTF8(mToken, 0xFFFD);
+                    mHighSurrogate = 0;
+                    mState = psEscape;
+                }
+                break;
+            case psNumber:
+                p = continueNumber(p, pEnd);
+                break;
+            case psLiteral:
+                p = continueLiteral(p, pEnd);
+                break;
+            default:
+                while (p < pEnd && isJsonSpace(*p))
+                    ++p;
+                if (p < pEnd)
+                    p = structural(p, pEnd);
+                break;
+            }
+        }
+        return mState != psStopped;
+    }
+
+    bool feed(const std::string& chunk) {
+        return feed(chunk.data(), chunk.length());
+    }
+
+    // Signals the end of the input. A number at the very end is completed here.
+    // Throws invalid_format_error if the input does not end after a complete value.
+    void finish() {
+        if (mState == psNumber)
+            endNumber(nullptr, nullptr);
+        if (mState == psStopped)
+            return;
+        if (mState != psEnd)
+            throw invalid_format_error();
+    }
+
+    // whether every top-level value fed so far is complete
+    bool done() const {
+        return mState == psEnd;
+    }
+
+    // number of complete top-level values
+    size_t valueCount() const {
+        return mValueCount;
+    }
+
+    // discards any partial input so that a new document can be fed
+    void reset() {
+        mState = psValue;
+        mStack.clear();
+        mToken.clear();
+        mIsKey = false;
+        mCode = 0;
+        mHexCount = 0;
+        mHighSurrogate = 0;
+        mLiteral = nullptr;
+        mLiteralPos = 0;
+        mValueCount = 0;
+    }
+
+private:
+    enum PushStateT {
+        psValue,        // a value
+        psFirstValue,   // a value or ']'
+        psFirstKey,     // a key or '}'
+        psKey,          // a key
+        psColon,        // ':'
+        psNext,         // ',' or the end of the container
+        psEnd,          // whitespace after a top-level value
+        psString,
+        psEscape,       // the character after '\\'
+        psUnicode,      // the hex digits of \uXXXX
+        psSurrogate,    // '\\' of the low surrogate that should follow a high one
+        psSurrogateU,   // 'u' of the low surrogate
+        psNumber,
+        psLiteral,      // true, false or null
+        psStopped
+    };
+
+    void emit(bool accepted) {
+        if (!accepted)
+            mState = psStopped;
+    }
+
+    // moves to the state that follows a complete value
+    void endValue() {
+        if (mState == psStopped)
+            return;
+        if (mStack.empty()) {
+            mValueCount++;
+            mState = psEnd;
+        } else {
+            mState = psNext;
+        }
+    }
+
+    const unsigned char* structural(const unsigned char* p, const unsigned char* pEnd) {
+        switch (mState) {
+        case psEnd:
+            if (!mMultipleValues)
+                throw invalid_format_error();
+            mState = psValue;
+            return p;
+        case psFirstKey:
+            if (*p == '}')
+                return endContainer(p, '{');
+            // fall through
+        case psKey:
+            if (*p != '\"')
+                throw invalid_format_error();
+            mIsKey = true;
+            mToken.clear();
+            mState = psString;
+            return p + 1;
+        case psColon:
+            if (*p != ':')
+                throw invalid_format_error();
+            mState = psValue;
+            return p + 1;
+        case psNext:
+            if (*p == ',') {
+                mState = (mStack.back() == '{') ? psKey : psValue;
+                return p + 1;
+            }
+            return endContainer(p, *p == '}' ? '{' : '[');
+        case psFirstValue:
+            if (*p == ']')
+                return endContainer(p, '[');
+            // fall through
+        default:
+            return startValue(p, pEnd);
+        }
+    }
+
+    const unsigned char* endContainer(const unsigned char* p, char open) {
+        if ((*p != '}' && *p != ']') || mStack.back() != open)
+            throw invalid_format_error();
+        mStack.pop_back();
+        if (open == '{')
+            emit(acceptEvent([&] { return mHandler.endObject(); }));
+        else
+            emit(acceptEvent([&] { return mHandler.endArray(); }));
+        endValue();
+        return p + 1;
+    }
+
+    const unsigned char* startValue(const unsigned char* p, const unsigned char* pEnd) {
+        switch (*p) {
+        case '{':
+            mStack.push_back('{');
+            mState = psFirstKey;
+            emit(acceptEvent([&] { return mHandler.startObject(); }));
+            return p + 1;
+        case '[':
+            mStack.push_back('[');
+            mState = psFirstValue;
+            emit(acceptEvent([&] { return mHandler.startArray(); }));
+            return p + 1;
+        case '\"':
+            mIsKey = false;
+            mToken.clear();
+            mState = psString;
+            return p + 1;
+        case 't':
+            mLiteral = "true";
+            break;
+        case 'f':
+            mLiteral = "false";
+            break;
+        case 'n':
+            mLiteral = "null";
+            break;
+        default:
+            if (*p != '-' && !isJsonDigit(*p))
+                throw invalid_format_error();
+            mToken.clear();
+            mState = psNumber;
+            return continueNumber(p, pEnd);
+        }
+        mLiteralPos = 1;
+        mState = psLiteral;
+        return p + 1;
+    }
+
+    // a string that completes inside one chunk without escapes is passed without a copy
+    const unsigned char* continueString(const unsigned char* p, const unsigned char* pEnd) {
+        const unsigned char* first = p;
+        p = findStringSpecial(p, pEnd);
+        if (p == pEnd) {
+            mToken.append(reinterpret_cast<const char*>(first), p - first);
+            return p;
+        }
+
+        if (*p == '\\') {
+            mToken.append(reinterpret_cast<const char*>(first), p - first);
+            mState = psEscape;
+            return p + 1;
+        }
+        if (*p != '\"')
+            throw invalid_format_error();
+
+        std::string_view s;
+        if (mToken.empty()) {
+            s = std::string_view(reinterpret_cast<const char*>(first), p - first);
+        } else {
+            mToken.append(reinterpret_cast<const char*>(first), p - first);
+            s = mToken;
+        }
+
+        if (mIsKey) {
+            mState = psColon;
+            emit(acceptEvent([&] { return mHandler.key(s); }));
+        } else {
+            emit(acceptEvent([&] { return mHandler.string(s); }));
+            endValue();
+        }
+        return p + 1;
+    }
+
+    const unsigned char* continueEscape(const unsigned char* p) {
+        mState = psString;
+        switch (*p) {
+        case 'b': mToken += '\b'; break;
+        case 'f': mToken += '\f'; break;
+        case 'n': mToken += '\n'; break;
+        case 'r': mToken += '\r'; break;
+        case 't': mToken += '\t'; break;
+        case 'u':
+            mCode = 0;
+            mHexCount = 0;
+            mState = psUnicode;
+            break;
+        default:
+            mToken += static_cast<char>(*p);
+        }
+        return p + 1;
+    }
+
+    const unsigned char* continueUnicode(const unsigned char* p, const unsigned char* pEnd) {
+        while (p < pEnd && mHexCount < 4) {
+            unsigned char ch = *p++;
+            if (!isJsonHex(ch))
+                throw invalid_format_error();
+            mCode = (mCode << 4) | (isJsonDigit(ch) ? ch - '0' : (ch | 0x20) - 'a' + 10);
+            mHexCount++;
+        }
+        if (mHexCount < 4)
+            return p;
+
+        unsigned int code = mCode;
+        mState = psString;
+        if (mHighSurrogate) {
+            if (code >= 0xDC00 && code <= 0xDFFF) {
+                appendUTF8(mToken, 0x10000 + ((mHighSurrogate - 0xD800) << 10) + (code - 0xDC00));
+                mHighSurrogate = 0;
+                return p;
+            }
+            appendUTF8(mToken, 0xFFFD);
+            mHighSurrogate = 0;
+        }
+
+        if (code >= 0xD800 && code <= 0xDBFF) {
+            mHighSurrogate = code;
+            mState = psSurrogate;
+        } else {
+            appendUTF8(mToken, (code >= 0xDC00 && code <= 0xDFFF) ? 0xFFFD : code);
+        }
+        return p;
+    }
+
+    // a number ends at the first character that can't be part of it
+    const unsigned char* continueNumber(const unsigned char* p, const unsigned char* pEnd) {
+        const unsigned char* first = p;
+        while (p < pEnd && isJsonNumberChar(*p))
+            ++p;
+        if (p == pEnd) {
+            mToken.append(reinterpret_cast<const char*>(first), p - first);
+            return p;
+        }
+        endNumber(first, p);
+        return p;
+    }
+
+    void endNumber(const unsigned char* first, const unsigned char* last) {
+        const char* s = reinterpret_cast<const char*>(first);
+        const char* e = reinterpret_cast<const char*>(last);
+        if (!mToken.empty()) {
+            mToken.append(s, e - s);
+            s = mToken.data();
+            e = s + mToken.length();
+        }
+
+        JsonNumber value;
+        if (parseNumber(s, e, value) != e || s == e)
+            throw invalid_format_error();
+        std::string_view lexeme(s, e - s);
+        emit(acceptEvent([&] { return mHandler.number(value, lexeme); }));
+        endValue();
+    }
+
+    const unsigned char* continueLiteral(const unsigned char* p, const unsigned char* pEnd) {
+        while (p < pEnd && mLiteral[mLiteralPos]) {
+            if (*p++ != mLiteral[mLiteralPos++])
+                throw invalid_format_error();
+        }
+        if (mLiteral[mLiteralPos])
+            return p;
+
+        if (mLiteral[0] == 't')
+            emit(acceptEvent([&] { return mHandler.boolean(true); }));
+        else if (mLiteral[0] == 'f')
+            emit(acceptEvent([&] { return mHandler.boolean(false); }));
+        else
+            emit(acceptEvent([&] { return mHandler.null(); }));
+        endValue();
+        return p;
+    }
+
+private:
+    Handler&            mHandler;
+    bool                mMultipleValues;
+
+    PushStateT          mState;
+    std::vector<char>   mStack;         // '{' or '[' for every open container
+    std::string         mToken;         // the part of a string or number seen so far
+    bool                mIsKey;
+
+    unsigned int        mCode;
+    int                 mHexCount;
+    unsigned int        mHighSurrogate;
+
+    const char*         mLiteral;
+    int                 mLiteralPos;
+
+    size_t              mValueCount;
+};
+
+
+// Parse handler that builds a heap-allocated JsonValue for every top-level value
+// and passes it to fn(std::shared_ptr<JsonValue>) once the value is complete.
+template <typename Function>
+class ValueBuilder {
+public:
+    explicit ValueBuilder(Function fn) : mFunction(fn) {
+    }
+
+    void null() {
+        add(std::make_shared<ValueNull>());
+    }
+
+    void boolean(bool value) {
+        if (value)
+            add(std::make_shared<ValueTrue>());
+        else
+            add(std::make_shared<ValueFalse>());
+    }
+
+    void number(const JsonNumber& value, std::string_view lexeme) {
+        add(std::make_shared<ValueNumber>(value));
+    }
+
+    void string(std::string_view s) {
+        add(std::make_shared<ValueString>(s.data(), s.length(), std::pmr::get_default_resource()));
+    }
+
+    void key(std::string_view name) {
+        mKey.assign(name.data(), name.length());
+    }
+
+    void startObject() {
+        auto obj = std::make_shared<ValueObject>();
+        add(obj);
+        mContainers.push_back(obj);
+    }
+
+    void endObject() {
+        endContainer();
+    }
+
+    void startArray() {
+        auto arr = std::make_shared<ValueArray>();
+        add(arr);
+        mContainers.push_back(arr);
+    }
+
+    void endArray() {
+        endContainer();
+    }
+
+private:
+    void add(std::shared_ptr<JsonValue> value) {
+        if (mContainers.empty()) {
+            if (!value->isObject() && !value->isArray())
+                mFunction(std::move(value));
+            return;
+        }
+
+        JsonValue& parent = *mContainers.back();
+        if (parent.isObject())
+            static_cast<ValueObject&>(parent).add(mKey, value);
+        else
+            static_cast<ValueArray&>(parent).add(value);
+    }
+
+    void endContainer() {
+        std::shared_ptr<JsonValue> value = std::move(mContainers.back());
+        mContainers.pop_back();
+        if (mContainers.empty())
+            mFunction(std::move(value));
+    }
+
+private:
+    Function                                    mFunction;
+    std::vector<std::shared_ptr<JsonValue>>     mContainers;
+    std::string                                 mKey;
+};
+
+}
@@ -0,0 +1,500 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define YOUNGJSON_X64
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(YOUNGJSON_X64) && (defined(__GNUC__) || defined(__clang__))
+#define YOUNGJSON_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define YOUNGJSON_TARGET_AVX2
+#endif
+
+namespace youngJSON {
+
+enum CharClassT {
+    ccSpace         = 0x01,     // JSON whitespace : ' ', '\t', '\n', '\r'
+    ccStructural    = 0x02,     // '{', '}', '[', ']', ':', ','
+    ccDigit         = 0x04,
+    ccAlpha         = 0x08,
+    ccNumber        = 0x10,     // digits, '-', '+', '.', 'e', 'E'
+    ccHex           = 0x20
+};
+
+struct CharClassTable {
+    unsigned char value[256];
+};
+
+constexpr CharClassTable makeCharClassTable() {
+    CharClassTable res{};
+    res.value[(unsigned char)' '] = ccSpace;
+    res.value[(unsigned char)'\t'] = ccSpace;
+    res.value[(unsigned char)'\n'] = ccSpace;
+    res.value[(unsigned char)'\r'] = ccSpace;
+    for (const char* s = "{}[]:,"; *s; s++)
+        res.value[(unsigned char)*s] = ccStructural;
+    for (int ch = '0'; ch <= '9'; ch++)
+        res.value[ch] = ccDigit | ccNumber | ccHex;
+    for (int ch = 'a'; ch <= 'z'; ch++)
+        res.value[ch] = ccAlpha | (ch <= 'f' ? ccHex : 0);
+    for (int ch = 'A'; ch <= 'Z'; ch++)
+        res.value[ch] = ccAlpha | (ch <= 'F' ? ccHex : 0);
+    for (const char* s = "-+.eE"; *s; s++)
+        res.value[(unsigned char)*s] |= ccNumber;
+    return res;
+}
+
+inline constexpr CharClassTable gCharClass = makeCharClassTable();
+
+inline bool isJsonSpace(unsigned char ch) {
+    return (gCharClass.value[ch] & ccSpace) != 0;
+}
+
+inline bool isJsonDigit(unsigned char ch) {
+    return (gCharClass.value[ch] & ccDigit) != 0;
+}
+
+inline bool isJsonAlpha(unsigned char ch) {
+    return (gCharClass.value[ch] & ccAlpha) != 0;
+}
+
+inline bool isJsonNumberChar(unsigned char ch) {
+    return (gCharClass.value[ch] & ccNumber) != 0;
+}
+
+inline bool isJsonHex(unsigned char ch) {
+    return (gCharClass.value[ch] & ccHex) != 0;
+}
+
+inline int countTrailingZeros(uint64_t x) {
+#if defined(_MSC_VER) && defined(YOUNGJSON_X64)
+    unsigned long idx;
+    _BitScanForward64(&idx, x);
+    return (int)idx;
+#elif defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+
+// returns the first '"', '\\' or control character in [p, pEnd), or pEnd
+inline const unsigned char* findStringSpecial(const unsigned char* p, const unsigned char* pEnd) {
+#ifdef YOUNGJSON_X64
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    while (pEnd - p >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                                       _mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+        int mask = _mm_movemask_epi8(special);
+        if (mask)
+            return p + countTrailingZeros((uint64_t)mask);
+        p += 16;
+    }
+#endif
+    while (p < pEnd && *p != '\"' && *p != '\\' && *p >= 0x20)
+        ++p;
+    return p;
+}
+
+
+enum ScanImplT {
+    siScalar,
+    siSSE2,
+    siAVX2
+};
+
+// bit i of each mask describes byte i of a 64-byte block
+struct BlockMasks {
+    uint64_t    quote;
+    uint64_t    backslash;
+    uint64_t    structural;
+    uint64_t    space;
+};
+
+namespace scan {
+
+inline void classifyScalar(const unsigned char* src, size_t blockCount, BlockMasks* out) {
+    for (size_t b = 0; b < blockCount; b++, src += 64) {
+        BlockMasks m = { 0, 0, 0, 0 };
+        for (int i = 0; i < 64; i++) {
+            uint64_t bit = 1ull << i;
+            unsigned char cls = gCharClass.value[src[i]];
+            if (src[i] == '\"')
+                m.quote |= bit;
+            else if (src[i] == '\\')
+                m.backslash |= bit;
+            else if (cls & ccStructural)
+                m.structural |= bit;
+            else if (cls & ccSpace)
+                m.space |= bit;
+        }
+        out[b] = m;
+    }
+}
+
+#ifdef YOUNGJSON_X64
+
+inline void classifySSE2(const unsigned char* src, size_t blockCount, BlockMasks* out) {
+    const __m128i quote = _mm_set1_epi8('\"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i lbracket = _mm_set1_epi8('[');
+    const __m128i rbracket = _mm_set1_epi8(']');
+    const __m128i lbrace = _mm_set1_epi8('{');
+    const __m128i rbrace = _mm_set1_epi8('}');
+
+    for (size_t b = 0; b < blockCount; b++, src += 64) {
+        BlockMasks m = { 0, 0, 0, 0 };
+        for (int i = 0; i < 4; i++) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 16));
+            uint64_t q = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote));
+            uint64_t bs = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash));
+            __m128i ws = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+                                      _mm_or_si128(_mm_cmpeq_epi8(v, lf), _mm_cmpeq_epi8(v, cr)));
+            __m128i op = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, comma), _mm_cmpeq_epi8(v, colon)),
+                                      _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, lbracket), _mm_cmpeq_epi8(v, rbracket)),
+                                                   _mm_or_si128(_mm_cmpeq_epi8(v, lbrace), _mm_cmpeq_epi8(v, rbrace))));
+            m.quote |= q << (i * 16);
+            m.backslash |= bs << (i * 16);
+            m.space |= (uint64_t)(uint32_t)_mm_movemask_epi8(ws) << (i * 16);
+            m.structural |= (uint64_t)(uint32_t)_mm_movemask_epi8(op) << (i * 16);
+        }
+        out[b] = m;
+    }
+}
+
+YOUNGJSON_TARGET_AVX2
+inline void classifyAVX2(const unsigned char* src, size_t blockCount, BlockMasks* out) {
+    const __m256i quote = _mm256_set1_epi8('\"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i lbracket = _mm256_set1_epi8('[');
+    const __m256i rbracket = _mm256_set1_epi8(']');
+    const __m256i lbrace = _mm256_set1_epi8('{');
+    const __m256i rbrace = _mm256_set1_epi8('}');
+
+    for (size_t b = 0; b < blockCount; b++, src += 64) {
+        BlockMasks m = { 0, 0, 0, 0 };
+        for (int i = 0; i < 2; i++) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 32));
+            uint64_t q = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote));
+            uint64_t bs = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, backslash));
+            __m256i ws = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, space), _mm256_cmpeq_epi8(v, tab)),
+                                         _mm256_or_si256(_mm256_cmpeq_epi8(v, lf), _mm256_cmpeq_epi8(v, cr)));
+            __m256i op = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, comma), _mm256_cmpeq_epi8(v, colon)),
+                                         _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, lbracket), _mm256_cmpeq_epi8(v, rbracket)),
+                                                         _mm256_or_si256(_mm256_cmpeq_epi8(v, lbrace), _mm256_cmpeq_epi8(v, rbrace))));
+            m.quote |= q << (i * 32);
+            m.backslash |= bs << (i * 32);
+            m.space |= (uint64_t)(uint32_t)_mm256_movemask_epi8(ws) << (i * 32);
+            m.structural |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op) << (i * 32);
+        }
+        out[b] = m;
+    }
+}
+
+inline bool cpuSupportsAVX2() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) || defined(__clang__)
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+#endif
+
+inline uint64_t prefixXor(uint64_t x) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+// escape and in-string state carried from one 64-byte block to the next
+class StringState {
+public:
+    StringState() : mPrevEscaped(0), mPrevInString(0) {
+    }
+
+    // Returns the bytes inside strings, from the byte after an opening quote up to and
+    // including the closing quote. quote receives the unescaped quotes of the block.
+    uint64_t next(const BlockMasks& m, uint64_t& quote) {
+        uint64_t escaped = findEscaped(m.backslash);
+        quote = m.quote & ~escaped;
+
+        // from an opening quote up to (not including) its closing quote
+        uint64_t inString = prefixXor(quote) ^ mPrevInString;
+        mPrevInString = (uint64_t)((int64_t)inString >> 63);
+        return inString ^ quote;
+    }
+
+    // whether the last block ended inside a string
+    bool inString() const {
+        return mPrevInString != 0;
+    }
+
+private:
+    uint64_t findEscaped(uint64_t backslash) {
+        backslash &= ~mPrevEscaped;
+        uint64_t followsEscape = (backslash << 1) | mPrevEscaped;
+
+        const uint64_t evenBits = 0x5555555555555555ull;
+        uint64_t oddSequenceStarts = backslash & ~evenBits & ~followsEscape;
+        uint64_t sequencesStartingOnEvenBits = oddSequenceStarts + backslash;
+        mPrevEscaped = sequencesStartingOnEvenBits < oddSequenceStarts ? 1 : 0;
+        uint64_t invertMask = sequencesStartingOnEvenBits << 1;
+
+        return (evenBits ^ invertMask) & followsEscape;
+    }
+
+private:
+    uint64_t    mPrevEscaped;
+    uint64_t    mPrevInString;
+};
+
+}
+
+
+// stage 1 of the reader : positions of every structural character outside strings,
+// every opening quote and the first byte of every other scalar, followed by a
+// sentinel equal to the input length.
+class StructuralIndex {
+public:
+    typedef void (*ClassifyFunc)(const unsigned char*, size_t, BlockMasks*);
+
+    StructuralIndex() : mCount(0) {
+    }
+
+    static ScanImplT bestImplementation() {
+#ifdef YOUNGJSON_X64
+        static const ScanImplT impl = scan::cpuSupportsAVX2() ? siAVX2 : siSSE2;
+        return impl;
+#else
+        return siScalar;
+#endif
+    }
+
+    static bool isSupported(ScanImplT impl) {
+        switch (impl) {
+        case siScalar:
+            return true;
+#ifdef YOUNGJSON_X64
+        case siSSE2:
+            return true;
+        case siAVX2:
+            return bestImplementation() == siAVX2;
+#endif
+        default:
+            return false;
+        }
+    }
+
+    static const char* implementationName(ScanImplT impl) {
+        switch (impl) {
+        case siSSE2: return "sse2";
+        case siAVX2: return "avx2";
+        default:     return "scalar";
+        }
+    }
+
+    // returns false when the input ends inside a string
+    bool build(const unsigned char* src, size_t length) {
+        return build(src, length, bestImplementation());
+    }
+
+    static ClassifyFunc classifier(ScanImplT impl) {
+#ifdef YOUNGJSON_X64
+        if (impl == siSSE2)
+            return scan::classifySSE2;
+        else if (impl == siAVX2 && isSupported(siAVX2))
+            return scan::classifyAVX2;
+#endif
+        return scan::classifyScalar;
+    }
+
+    bool build(const unsigned char* src, size_t length, ScanImplT impl) {
+        ClassifyFunc classify = classifier(impl);
+
+        mCount = 0;
+        mStringState = scan::StringState();
+        mPrevScalar = 0;
+
+        const size_t BATCH = 64;
+        BlockMasks masks[BATCH];
+
+        size_t fullBlocks = length / 64;
+        size_t offset = 0;
+        while (fullBlocks > 0) {
+            size_t n = fullBlocks < BATCH ? fullBlocks : BATCH;
+            classify(src + offset, n, masks);
+            for (size_t i = 0; i < n; i++, offset += 64)
+                addBlock(masks[i], offset);
+            fullBlocks -= n;
+        }
+
+        if (offset < length) {
+            unsigned char tail[64];
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, src + offset, length - offset);
+            classify(tail, 1, masks);
+            addBlock(masks[0], offset);
+        }
+
+        reserve(1);
+        mPositions[mCount++] = static_cast<uint32_t>(length);
+
+        return !mStringState.inString();
+    }
+
+    const uint32_t* data() const {
+        return mPositions.data();
+    }
+
+    // number of positions including the sentinel
+    size_t size() const {
+        return mCount;
+    }
+
+    uint32_t operator [](size_t i) const {
+        return mPositions[i];
+    }
+
+private:
+    void reserve(size_t n) {
+        if (mCount + n > mPositions.size())
+            mPositions.resize(mPositions.size() * 2 > mCount + n ? mPositions.size() * 2 : mCount + n);
+    }
+
+    void addBlock(const BlockMasks& m, size_t offset) {
+        uint64_t quote;
+        uint64_t stringTail = mStringState.next(m, quote);
+
+        uint64_t scalar = ~(m.structural | m.space | m.quote);
+        uint64_t followsScalar = (scalar << 1) | mPrevScalar;
+        mPrevScalar = scalar >> 63;
+
+        uint64_t bits = (m.structural | quote | (scalar & ~followsScalar)) & ~stringTail;
+
+        reserve(64);
+        uint32_t* out = mPositions.data() + mCount;
+        uint32_t base = static_cast<uint32_t>(offset);
+        while (bits) {
+            *out++ = base + countTrailingZeros(bits);
+            bits &= bits - 1;
+        }
+        mCount = out - mPositions.data();
+    }
+
+private:
+    std::vector<uint32_t>   mPositions;
+    size_t                  mCount;
+
+    scan::StringState       mStringState;
+    uint64_t                mPrevScalar;
+};
+
+
+// Visits, in order, the structural characters outside strings from a position that is
+// not inside a string. With quotes, the opening and closing quote of every string are
+// visited too. Unlike StructuralIndex, nothing is stored, so offsets may exceed 4GB.
+class StructuralScanner {
+public:
+    StructuralScanner(const unsigned char* src, size_t length, size_t offset, bool quotes = false)
+        : mSrc(src), mLength(length), mBase(offset), mNext(offset), mBits(0), mQuotes(quotes),
+          mClassify(StructuralIndex::classifier(StructuralIndex::bestImplementation())) {
+    }
+
+    // returns the length of the input when nothing is left
+    size_t next() {
+        while (mBits == 0) {
+            if (mNext >= mLength)
+                return mLength;
+            loadBlock();
+        }
+        size_t pos = mBase + countTrailingZeros(mBits);
+        mBits &= mBits - 1;
+        return pos;
+    }
+
+    // whether the input ended inside a string
+    bool inString() const {
+        return mStringState.inString();
+    }
+
+private:
+    void loadBlock() {
+        BlockMasks m;
+        if (mLength - mNext >= 64) {
+            mClassify(mSrc + mNext, 1, &m);
+        } else {
+            unsigned char tail[64];
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, mSrc + mNext, mLength - mNext);
+            mClassify(tail, 1, &m);
+        }
+
+        uint64_t quote;
+        uint64_t stringTail = mStringState.next(m, quote);
+        mBits = m.structural & ~stringTail;
+        if (mQuotes)
+            mBits |= quote;
+
+        mBase = mNext;
+        mNext += 64;
+    }
+
+private:
+    const unsigned char*            mSrc;
+    size_t                          mLength;
+    size_t                          mBase;
+    size_t                          mNext;
+    uint64_t                        mBits;
+    bool                            mQuotes;
+    StructuralIndex::ClassifyFunc   mClassify;
+    scan::StringState               mStringState;
+};
+
+}
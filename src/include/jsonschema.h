@@ -0,0 +1,715 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "jsonparser.h"
+#include "jsonpattern.h"
+#include "jsonpushparser.h"
+
+namespace youngJSON {
+
+template <typename Handler>
+class ValidatingHandler;
+
+// A JSON Schema subset compiled once into a table of nodes:
+//   type, enum, const, required, properties, additionalProperties, items,
+//   minimum, maximum, exclusiveMinimum, exclusiveMaximum, minLength, maxLength, pattern,
+//   minItems, maxItems, minProperties, maxProperties
+// A schema of true accepts every value and false none. Annotations such as title are
+// ignored; any other keyword throws std::invalid_argument rather than being skipped.
+// A pattern is a JsonPattern, so back-references and lookaround are invalid.
+// Errors read "#/items/1/count: below minimum", the path being a JSON Pointer.
+class JsonSchema {
+public:
+    explicit JsonSchema(const JsonValue& schema) {
+        mNodes.resize(2);
+        mNodes[FALSE_NODE].types = 0;
+        mRoot = compile(schema);
+    }
+
+    // returns whether value is valid; error receives the first failure
+    bool validate(const JsonValue& value, std::string* error = nullptr) const {
+        std::string path = "#";
+        const char* reason = check(mRoot, value, path);
+        if (reason && error)
+            *error = path + ": " + reason;
+        return !reason;
+    }
+
+    // validates while parsing without building a tree, and stops at the first failure
+    bool validate(JsonReader& reader, const unsigned char* src, int length, std::string* error = nullptr) const;
+
+    bool validate(JsonReader& reader, const std::string& src, std::string* error = nullptr) const {
+        return validate(reader, (const unsigned char*)src.data(), inputLength(src.length()), error);
+    }
+
+private:
+    template <typename Handler>
+    friend class ValidatingHandler;
+
+    static const uint32_t TRUE_NODE = 0;
+    static const uint32_t FALSE_NODE = 1;
+
+    enum TypeBits : unsigned {
+        tNull = 1, tBoolean = 2, tInteger = 4, tNumber = 8, tString = 16, tObject = 32, tArray = 64, tAny = 127
+    };
+
+    struct Property {
+        std::string name;
+        uint32_t    node;
+        int         required;   // index among the required members, or -1
+    };
+
+    struct Node {
+        unsigned                    types = tAny;
+        std::vector<std::shared_ptr<JsonValue>> values;     // enum, empty when not given
+        bool                        hasEnum = false;
+
+        double                      minimum = -std::numeric_limits<double>::infinity();
+        double                      maximum = std::numeric_limits<double>::infinity();
+        bool                        exclusiveMinimum = false;
+        bool                        exclusiveMaximum = false;
+
+        size_t                      minLength = 0;
+        size_t                      maxLength = SIZE_MAX;
+        std::shared_ptr<JsonPattern> pattern;
+
+        size_t                      minItems = 0;
+        size_t                      maxItems = SIZE_MAX;
+        size_t                      minProperties = 0;
+        size_t                      maxProperties = SIZE_MAX;
+
+        std::vector<Property>       properties;     // sorted by name
+        size_t                      requiredCount = 0;
+        uint32_t                    additional = TRUE_NODE;
+        uint32_t                    items = TRUE_NODE;
+    };
+
+    // a scalar value, from a tree or from an event
+    struct Scalar {
+        ValueTypeT          type;
+        JsonNumber          number;
+        std::string_view    string;
+    };
+
+    uint32_t compile(const JsonValue& schema) {
+        if (schema.isBool())
+            return schema.isTrue() ? TRUE_NODE : FALSE_NODE;
+        if (!schema.isObject())
+            throw std::invalid_argument("invalid schema");
+
+        Node node;
+        std::vector<std::string> required;
+        const JsonValue* properties = nullptr;
+        const JsonValue* additional = nullptr;
+        const JsonValue* items = nullptr;
+        bool exclusiveMinimum = false, exclusiveMaximum = false;
+
+        static_cast<const ValueObject&>(schema).forEach([&](std::string_view name, const JsonValue& value) {
+            if (name == "type") {
+                node.types = 0;
+                if (value.isString()) {
+                    node.types = typeBits(value.toStringView());
+                } else if (value.isArray()) {
+                    for (int i = 0; i < value.size(); i++)
+                        node.types |= typeBits(value.get(i).toStringView());
+                } else {
+                    throw std::invalid_argument("invalid schema type");
+                }
+                if (node.types & tNumber)
+                    node.types |= tInteger;
+            } else if (name == "enum" || name == "const") {
+                if (name == "enum" && !value.isArray())
+                    throw std::invalid_argument("invalid schema enum");
+                node.hasEnum = true;
+                if (name == "const") {
+                    node.values.push_back(copy(value));
+                } else {
+                    for (int i = 0; i < value.size(); i++)
+                        node.values.push_back(copy(value.get(i)));
+                }
+            } else if (name == "minimum") {
+                node.minimum = number(value);
+            } else if (name == "maximum") {
+                node.maximum = number(value);
+            } else if (name == "exclusiveMinimum") {
+                // a boolean in draft 4, a bound since draft 6
+                if (value.isBool()) {
+                    exclusiveMinimum = value.isTrue();
+                } else {
+                    node.minimum = number(value);
+                    node.exclusiveMinimum = true;
+                }
+            } else if (name == "exclusiveMaximum") {
+                if (value.isBool()) {
+                    exclusiveMaximum = value.isTrue();
+                } else {
+                    node.maximum = number(value);
+                    node.exclusiveMaximum = true;
+                }
+            } else if (name == "minLength") {
+                node.minLength = count(value);
+            } else if (name == "maxLength") {
+                node.maxLength = count(value);
+            } else if (name == "pattern") {
+                node.pattern = compilePattern(value.toRawString());
+            } else if (name == "minItems") {
+                node.minItems = count(value);
+            } else if (name == "maxItems") {
+                node.maxItems = count(value);
+            } else if (name == "minProperties") {
+                node.minProperties = count(value);
+            } else if (name == "maxProperties") {
+                node.maxProperties = count(value);
+            } else if (name == "required") {
+                if (!value.isArray())
+                    throw std::invalid_argument("invalid schema required");
+                for (int i = 0; i < value.size(); i++)
+                    required.push_back(value.get(i).toRawString());
+            } else if (name == "properties") {
+                if (!value.isObject())
+                    throw std::invalid_argument("invalid schema properties");
+                properties = &value;
+            } else if (name == "additionalProperties") {
+                additional = &value;
+            } else if (name == "items") {
+                items = &value;
+            } else if (!isAnnotation(name)) {
+                throw std::invalid_argument("unsupported schema keyword " + std::string(name));
+            }
+        });
+
+        if (exclusiveMinimum)
+            node.exclusiveMinimum = true;
+        if (exclusiveMaximum)
+            node.exclusiveMaximum = true;
+
+        uint32_t index = static_cast<uint32_t>(mNodes.size());
+        mNodes.emplace_back();
+
+        if (properties) {
+            static_cast<const ValueObject*>(properties)->forEach([&](std::string_view name, const JsonValue& value) {
+                node.properties.push_back(Property{ std::string(name), compile(value), -1 });
+            });
+        }
+        for (auto& name : required) {
+            auto it = std::find_if(node.properties.begin(), node.properties.end(),
+                                   [&](const Property& p) { return p.name == name; });
+            if (it == node.properties.end()) {
+                node.properties.push_back(Property{ name, TRUE_NODE, -1 });
+                it = node.properties.end() - 1;
+            }
+            if (it->required < 0)
+                it->required = static_cast<int>(node.requiredCount++);
+        }
+        std::sort(node.properties.begin(), node.properties.end(),
+                  [](const Property& a, const Property& b) { return a.name < b.name; });
+        if (additional)
+            node.additional = compile(*additional);
+        if (items)
+            node.items = compile(*items);
+
+        mNodes[index] = std::move(node);
+        return index;
+    }
+
+    static unsigned typeBits(std::string_view name) {
+        if (name == "null")
+            return tNull;
+        if (name == "boolean")
+            return tBoolean;
+        if (name == "integer")
+            return tInteger;
+        if (name == "number")
+            return tNumber;
+        if (name == "string")
+            return tString;
+        if (name == "object")
+            return tObject;
+        if (name == "array")
+            return tArray;
+        throw std::invalid_argument("invalid schema type");
+    }
+
+    static bool isAnnotation(std::string_view name) {
+        for (const char* s : { "$schema", "$id", "id", "$comment", "title", "description", "default", "examples",
+                               "format", "readOnly", "writeOnly", "deprecated" }) {
+            if (name == s)
+                return true;
+        }
+        return false;
+    }
+
+    static double number(const JsonValue& value) {
+        if (!value.isNumber())
+            throw std::invalid_argument("invalid schema number");
+        return value.toDouble();
+    }
+
+    static size_t count(const JsonValue& value) {
+        if (!value.isNumber() || value.toDouble() < 0)
+            throw std::invalid_argument("invalid schema count");
+        return static_cast<size_t>(value.toUInt64());
+    }
+
+    static std::shared_ptr<JsonPattern> compilePattern(const std::string& source) {
+        try {
+            return std::make_shared<JsonPattern>(source);
+        } catch (std::invalid_argument&) {
+            throw std::invalid_argument("invalid schema pattern");
+        }
+    }
+
+    static std::shared_ptr<JsonValue> copy(const JsonValue& value) {
+        return JsonReader().read(value.toCompactString());
+    }
+
+    const Property* findProperty(const Node& node, std::string_view name) const {
+        auto it = std::lower_bound(node.properties.begin(), node.properties.end(), name,
+                                   [](const Property& p, std::string_view s) { return std::string_view(p.name) < s; });
+        return it != node.properties.end() && it->name == name ? &*it : nullptr;
+    }
+
+    static bool isInteger(const JsonNumber& value) {
+        return value.kind != nkDouble || (std::isfinite(value.d) && value.d == std::floor(value.d));
+    }
+
+    static const char* typeError(unsigned types) {
+        switch (types) {
+        case 0:        return "not allowed";
+        case tNull:    return "expected null";
+        case tBoolean: return "expected boolean";
+        case tInteger: return "expected integer";
+        case tNumber | tInteger: return "expected number";
+        case tString:  return "expected string";
+        case tObject:  return "expected object";
+        case tArray:   return "expected array";
+        default:       return "unexpected type";
+        }
+    }
+
+    static unsigned typeOf(ValueTypeT type) {
+        switch (type) {
+        case vtNull:   return tNull;
+        case vtFalse:
+        case vtTrue:   return tBoolean;
+        case vtNumber: return tNumber;
+        case vtString: return tString;
+        case vtObject: return tObject;
+        default:       return tArray;
+        }
+    }
+
+    // returns the reason a scalar fails the node, or nullptr
+    const char* checkScalar(const Node& node, const Scalar& value) const {
+        unsigned type = typeOf(value.type);
+        if (type == tNumber && isInteger(value.number))
+            type = tInteger;
+        if (!(node.types & type))
+            return typeError(node.types);
+
+        if (node.hasEnum) {
+            bool found = false;
+            for (auto& it : node.values) {
+                if (equals(*it, value)) {
+                    found = true;
+                    break;
+                }
+            }
+            if (!found)
+                return "not in enum";
+        }
+
+        if (value.type == vtNumber) {
+            double d = value.number.toDouble();
+            if (d < node.minimum || (node.exclusiveMinimum && d == node.minimum))
+                return "below minimum";
+            if (d > node.maximum || (node.exclusiveMaximum && d == node.maximum))
+                return "above maximum";
+        } else if (value.type == vtString) {
+            if (node.minLength > 0 || node.maxLength != SIZE_MAX) {
+                size_t length = 0;
+                for (char ch : value.string)
+                    length += (static_cast<unsigned char>(ch) & 0xc0) != 0x80;
+                if (length < node.minLength)
+                    return "too short";
+                if (length > node.maxLength)
+                    return "too long";
+            }
+            if (node.pattern && !node.pattern->search(value.string))
+                return "doesn't match pattern";
+        }
+        return nullptr;
+    }
+
+    static bool equals(const JsonValue& lhs, const Scalar& rhs) {
+        switch (rhs.type) {
+        case vtNull:
+            return lhs.isNull();
+        case vtFalse:
+            return lhs.isFalse();
+        case vtTrue:
+            return lhs.isTrue();
+        case vtNumber:
+            return lhs.isNumber() && static_cast<const ValueNumber&>(lhs).value().equals(rhs.number);
+        case vtString:
+            return lhs.isString() && lhs.toStringView() == rhs.string;
+        default:
+            return false;
+        }
+    }
+
+    static bool inEnum(const Node& node, const JsonValue& value) {
+        for (auto& it : node.values) {
+            if (*it == value)
+                return true;
+        }
+        return false;
+    }
+
+    // returns the reason value fails, with path extended to the failing value, or nullptr
+    const char* check(uint32_t index, const JsonValue& value, std::string& path) const {
+        const Node& node = mNodes[index];
+        if (index == TRUE_NODE)
+            return nullptr;
+
+        if (!value.isObject() && !value.isArray()) {
+            Scalar scalar{ vtNull, JsonNumber(), std::string_view() };
+            if (value.isNumber()) {
+                scalar.type = vtNumber;
+                scalar.number = static_cast<const ValueNumber&>(value).value();
+            } else if (value.isString()) {
+                scalar.type = vtString;
+                scalar.string = value.toStringView();
+            } else {
+                scalar.type = value.isNull() ? vtNull : value.isTrue() ? vtTrue : vtFalse;
+            }
+            return checkScalar(node, scalar);
+        }
+
+        unsigned type = value.isObject() ? tObject : tArray;
+        if (!(node.types & type))
+            return typeError(node.types);
+        if (node.hasEnum && !inEnum(node, value))
+            return "not in enum";
+
+        size_t size = static_cast<size_t>(value.size());
+        if (size < minCount(node, value.isArray()))
+            return value.isArray() ? "too few items" : "too few members";
+        if (size > maxCount(node, value.isArray()))
+            return value.isArray() ? "too many items" : "too many members";
+
+        size_t length = path.length();
+        if (value.isArray()) {
+            for (int i = 0; i < value.size(); i++) {
+                path += '/';
+                path += std::to_string(i);
+                if (const char* reason = check(node.items, value.get(i), path))
+                    return reason;
+                path.resize(length);
+            }
+            return nullptr;
+        }
+
+        auto& obj = static_cast<const ValueObject&>(value);
+        for (auto& it : node.properties) {
+            if (it.required >= 0 && !obj.find(it.name)) {
+                appendToken(path, it.name);
+                return "missing";
+            }
+        }
+
+        const char* res = nullptr;
+        obj.forEach([&](std::string_view name, const JsonValue& child) {
+            if (res)
+                return;
+            const Property* property = findProperty(node, name);
+            appendToken(path, name);
+            res = check(property ? property->node : node.additional, child, path);
+            if (!res)
+                path.resize(length);
+        });
+        return res;
+    }
+
+    static size_t minCount(const Node& node, bool isArray) {
+        return isArray ? node.minItems : node.minProperties;
+    }
+
+    static size_t maxCount(const Node& node, bool isArray) {
+        return isArray ? node.maxItems : node.maxProperties;
+    }
+
+    // appends a JSON Pointer token
+    static void appendToken(std::string& path, std::string_view name) {
+        path += '/';
+        for (char ch : name) {
+            if (ch == '~')
+                path += "~0";
+            else if (ch == '/')
+                path += "~1";
+            else
+                path += ch;
+        }
+    }
+
+private:
+    std::vector<Node>       mNodes;
+    uint32_t                mRoot;
+};
+
+
+// Parse handler that checks every event against a schema and passes it on to handler,
+// or to nothing when Handler is void. It returns false at the first failure, so a
+// parse stops before the rest of an invalid payload is read or built.
+template <typename Handler>
+class ValidatingHandler {
+public:
+    template <typename H = Handler, typename = typename std::enable_if<std::is_void<H>::value>::type>
+    explicit ValidatingHandler(const JsonSchema& schema) : mSchema(schema), mHandler(nullptr), mMember(0) {
+    }
+
+    template <typename H = Handler, typename = typename std::enable_if<!std::is_void<H>::value>::type>
+    ValidatingHandler(const JsonSchema& schema, H& handler) : mSchema(schema), mHandler(&handler), mMember(0) {
+    }
+
+    // the path and reason of the failure
+    const std::string& error() const {
+        return mError;
+    }
+
+    bool null() {
+        return scalar(JsonSchema::Scalar{ vtNull, JsonNumber(), std::string_view() }) &&
+               forward([&](auto& h) { return h.null(); });
+    }
+
+    bool boolean(bool value) {
+        return scalar(JsonSchema::Scalar{ value ? vtTrue : vtFalse, JsonNumber(), std::string_view() }) &&
+               forward([&](auto& h) { return h.boolean(value); });
+    }
+
+    bool number(const JsonNumber& value, std::string_view lexeme) {
+        return scalar(JsonSchema::Scalar{ vtNumber, value, std::string_view() }) &&
+               forward([&](auto& h) { return h.number(value, lexeme); });
+    }
+
+    bool string(std::string_view s) {
+        return scalar(JsonSchema::Scalar{ vtString, JsonNumber(), s }) &&
+               forward([&](auto& h) { return h.string(s); });
+    }
+
+    bool key(std::string_view name) {
+        Frame& frame = mFrames.back();
+        frame.key.assign(name.data(), name.length());
+
+        const JsonSchema::Node& node = mSchema.mNodes[frame.node];
+        const JsonSchema::Property* property = mSchema.findProperty(node, name);
+        mMember = property ? property->node : node.additional;
+        if (property && property->required >= 0 && !mSeen[frame.seen + property->required]) {
+            mSeen[frame.seen + property->required] = 1;
+            frame.required++;
+        }
+        if (mMember == JsonSchema::FALSE_NODE)
+            return fail("not allowed");
+
+        for (auto& it : mCaptures)
+            it->builder.key(name);
+        return forward([&](auto& h) { return h.key(name); });
+    }
+
+    bool startObject() {
+        return startContainer(false) && forward([&](auto& h) { return h.startObject(); });
+    }
+
+    bool endObject() {
+        return endContainer() && forward([&](auto& h) { return h.endObject(); });
+    }
+
+    bool startArray() {
+        return startContainer(true) && forward([&](auto& h) { return h.startArray(); });
+    }
+
+    bool endArray() {
+        return endContainer() && forward([&](auto& h) { return h.endArray(); });
+    }
+
+private:
+    struct Frame {
+        uint32_t    node;
+        bool        isArray;
+        size_t      count;      // members or elements so far
+        size_t      seen;       // first flag of the required members in mSeen
+        size_t      required;   // required members seen
+        std::string key;
+    };
+
+    struct Store {
+        std::shared_ptr<JsonValue>* out;
+
+        void operator ()(std::shared_ptr<JsonValue> value) {
+            *out = std::move(value);
+        }
+    };
+
+    // builds a container that must be compared with an enum
+    struct Capture {
+        size_t                      depth;
+        uint32_t                    node;
+        std::shared_ptr<JsonValue>  value;
+        ValueBuilder<Store>         builder;
+
+        Capture(size_t d, uint32_t n) : depth(d), node(n), builder(Store{ &value }) {
+        }
+    };
+
+    template <typename Function>
+    bool forward(Function fn) {
+        if constexpr (std::is_void<Handler>::value)
+            return true;
+        else
+            return acceptEvent([&] { return fn(*mHandler); });
+    }
+
+    // returns the node of the value that starts now
+    uint32_t enter() {
+        if (mFrames.empty())
+            return mSchema.mRoot;
+        Frame& frame = mFrames.back();
+        frame.count++;
+        return frame.isArray ? mSchema.mNodes[frame.node].items : mMember;
+    }
+
+    bool scalar(const JsonSchema::Scalar& value) {
+        uint32_t index = enter();
+        if (tooMany())
+            return fail(mFrames.back().isArray ? "too many items" : "too many members", false);
+        if (index != JsonSchema::TRUE_NODE) {
+            if (const char* reason = mSchema.checkScalar(mSchema.mNodes[index], value))
+                return fail(reason);
+        }
+
+        for (auto& it : mCaptures) {
+            switch (value.type) {
+            case vtNull:   it->builder.null(); break;
+            case vtFalse:  it->builder.boolean(false); break;
+            case vtTrue:   it->builder.boolean(true); break;
+            case vtNumber: it->builder.number(value.number, std::string_view()); break;
+            default:       it->builder.string(value.string); break;
+            }
+        }
+        return true;
+    }
+
+    bool startContainer(bool isArray) {
+        uint32_t index = enter();
+        if (tooMany())
+            return fail(mFrames.back().isArray ? "too many items" : "too many members", false);
+
+        const JsonSchema::Node& node = mSchema.mNodes[index];
+        if (!(node.types & (isArray ? JsonSchema::tArray : JsonSchema::tObject)))
+            return fail(JsonSchema::typeError(node.types));
+
+        for (auto& it : mCaptures) {
+            if (isArray)
+                it->builder.startArray();
+            else
+                it->builder.startObject();
+        }
+        if (node.hasEnum) {
+            mCaptures.push_back(std::make_unique<Capture>(mFrames.size(), index));
+            if (isArray)
+                mCaptures.back()->builder.startArray();
+            else
+                mCaptures.back()->builder.startObject();
+        }
+
+        mFrames.push_back(Frame{ index, isArray, 0, mSeen.size(), 0, std::string() });
+        mSeen.resize(mSeen.size() + node.requiredCount, 0);
+        return true;
+    }
+
+    bool endContainer() {
+        Frame& frame = mFrames.back();
+        const JsonSchema::Node& node = mSchema.mNodes[frame.node];
+        if (frame.count < JsonSchema::minCount(node, frame.isArray))
+            return fail(frame.isArray ? "too few items" : "too few members", false);
+        if (frame.required < node.requiredCount) {
+            for (auto& it : node.properties) {
+                if (it.required >= 0 && !mSeen[frame.seen + it.required]) {
+                    frame.key = it.name;
+                    return fail("missing");
+                }
+            }
+        }
+
+        for (auto& it : mCaptures) {
+            if (frame.isArray)
+                it->builder.endArray();
+            else
+                it->builder.endObject();
+        }
+        if (!mCaptures.empty() && mCaptures.back()->depth == mFrames.size() - 1) {
+            bool found = JsonSchema::inEnum(node, *mCaptures.back()->value);
+            mCaptures.pop_back();
+            if (!found)
+                return fail("not in enum", false);
+        }
+
+        mSeen.resize(frame.seen);
+        mFrames.pop_back();
+        return true;
+    }
+
+    bool tooMany() const {
+        if (mFrames.empty())
+            return false;
+        const Frame& frame = mFrames.back();
+        return frame.count > JsonSchema::maxCount(mSchema.mNodes[frame.node], frame.isArray);
+    }
+
+    // the failing value is the current member or element, or the innermost container
+    bool fail(const char* reason, bool atValue = true) {
+        std::string path = "#";
+        size_t depth = mFrames.size();
+        for (size_t i = 0; i < depth; i++) {
+            const Frame& frame = mFrames[i];
+            if (!atValue && i == depth - 1)
+                break;
+            if (frame.isArray)
+                path += "/" + std::to_string(frame.count - 1);
+            else
+                JsonSchema::appendToken(path, frame.key);
+        }
+        mError = path + ": " + reason;
+        return false;
+    }
+
+private:
+    const JsonSchema&                       mSchema;
+    typename std::conditional<std::is_void<Handler>::value, char, Handler>::type* mHandler;
+    std::vector<Frame>                      mFrames;
+    std::vector<char>                       mSeen;
+    std::vector<std::unique_ptr<Capture>>   mCaptures;
+    uint32_t                                mMember;
+    std::string                             mError;
+};
+
+
+inline bool JsonSchema::validate(JsonReader& reader, const unsigned char* src, int length, std::string* error) const {
+    ValidatingHandler<void> handler(*this);
+    bool valid = reader.parse(src, length, handler);
+    if (!valid && error)
+        *error = handler.error();
+    return valid;
+}
+
+}
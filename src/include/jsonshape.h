@@ -0,0 +1,266 @@
+#pragma once
+
+#include <atomic>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "jsonarena.h"
+#include "jsonsymbol.h"
+
+namespace youngJSON {
+
+class JsonShapeTable;
+
+// Ordered member names of an object, with a hash index once there are many.
+// A shape from a JsonShapeTable is immutable and shared by every object that got the same
+// names in the same order. An object that doesn't use a table owns a private shape.
+class JsonShape {
+public:
+    static const size_t INDEX_THRESHOLD = 16;
+
+    explicit JsonShape(std::pmr::memory_resource* mr, JsonShapeTable* table = nullptr)
+        : mKeys(mr), mIndex(mr), mTable(table), mChildren(nullptr), mChildCount(0) {
+    }
+
+    JsonShape(const JsonShape&) = delete;
+    JsonShape& operator =(const JsonShape&) = delete;
+
+    size_t size() const {
+        return mKeys.size();
+    }
+
+    const JsonKey& key(size_t slot) const {
+        return mKeys[slot];
+    }
+
+    // the table of a shared shape, nullptr for a private one
+    JsonShapeTable* table() const {
+        return mTable;
+    }
+
+    // returns the slot of the name, or size() when there is no such member
+    size_t find(const JsonKey& key) const {
+        if (mIndex.empty()) {
+            for (size_t i = 0; i < mKeys.size(); i++) {
+                if (mKeys[i] == key)
+                    return i;
+            }
+            return mKeys.size();
+        }
+
+        size_t mask = mIndex.size() - 1;
+        for (size_t i = key.hash & mask; ; i = (i + 1) & mask) {
+            uint32_t slot = mIndex[i];
+            if (slot == 0)
+                return mKeys.size();
+            if (mKeys[slot - 1] == key)
+                return slot - 1;
+        }
+    }
+
+    // the characters of key must live as long as the shape
+    void append(const JsonKey& key) {
+        mKeys.push_back(key);
+        if (mKeys.size() > INDEX_THRESHOLD) {
+            // at most half full
+            if (mKeys.size() * 2 > mIndex.size())
+                rebuildIndex();
+            else
+                addToIndex(mKeys.size() - 1);
+        }
+    }
+
+private:
+    friend class JsonShapeTable;
+
+    void rebuildIndex() {
+        size_t size = INDEX_THRESHOLD * 4;
+        while (size < mKeys.size() * 2)
+            size *= 2;
+        mIndex.assign(size, 0);
+        for (size_t i = 0; i < mKeys.size(); i++)
+            addToIndex(i);
+    }
+
+    void addToIndex(size_t n) {
+        size_t mask = mIndex.size() - 1;
+        size_t i = mKeys[n].hash & mask;
+        while (mIndex[i] != 0)
+            i = (i + 1) & mask;
+        mIndex[i] = static_cast<uint32_t>(n + 1);
+    }
+
+private:
+    std::pmr::vector<JsonKey>   mKeys;
+    std::pmr::vector<uint32_t>  mIndex;     // slot + 1, or 0 for an empty slot
+    JsonShapeTable*             mTable;
+
+    // Shapes with one more name, hashed by that name. A full table is replaced by a larger
+    // one and left in the arena, so that it can be read without locking.
+    struct Transitions {
+        size_t                      mask;
+        std::atomic<JsonShape*>*    slots;
+    };
+
+    std::atomic<Transitions*>   mChildren;
+    size_t                      mChildCount;    // written under the table's lock
+};
+
+
+// Tree of shared shapes: an object that adds a name moves to the child shape for that name.
+// Safe to share between threads; looking up an existing child takes no lock.
+class JsonShapeTable {
+public:
+    // Objects with more members get a private shape, as do objects whose names take a shape
+    // past MAX_CHILDREN transitions or the table past MAX_SHAPES shapes. This bounds the
+    // memory of a table fed documents with ever new names.
+    static const size_t MAX_SHARED_SIZE = 64;
+    static const size_t MAX_CHILDREN = 256;
+    static const size_t MAX_SHAPES = 64 * 1024;
+
+    JsonShapeTable() : mArena(16 * 1024), mCount(1) {
+        mRoot = mArena.create<JsonShape>(&mArena, this);
+    }
+
+    JsonShapeTable(const JsonShapeTable&) = delete;
+    JsonShapeTable& operator =(const JsonShapeTable&) = delete;
+
+    // the shape of an empty object
+    const JsonShape* root() const {
+        return mRoot;
+    }
+
+    // the shape of from with key appended, or nullptr when it would be too large
+    const JsonShape* transition(const JsonShape* from, const JsonKey& key) {
+        if (const JsonShape* child = findChild(from, key))
+            return child;
+        if (from->size() >= MAX_SHARED_SIZE)
+            return nullptr;
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (const JsonShape* child = findChild(from, key))
+            return child;
+        if (from->mChildCount >= MAX_CHILDREN || mCount >= MAX_SHAPES)
+            return nullptr;
+
+        JsonShape* child = mArena.create<JsonShape>(&mArena, this);
+        child->mKeys.reserve(from->size() + 1);
+        child->mKeys.assign(from->mKeys.begin(), from->mKeys.end());
+        // the name is copied even for a symbol, whose table may not live as long as this one
+        child->append(JsonKey(std::string_view(mArena.copyString(key.name.data(), key.name.length()), key.name.length()), key.hash));
+
+        JsonShape* parent = const_cast<JsonShape*>(from);
+        JsonShape::Transitions* children = parent->mChildren.load(std::memory_order_relaxed);
+        if (!children || (parent->mChildCount + 1) * 2 > children->mask + 1) {
+            // at most half full
+            size_t size = children ? (children->mask + 1) * 2 : 4;
+            JsonShape::Transitions* grown = newTransitions(size);
+            if (children) {
+                for (size_t i = 0; i <= children->mask; i++) {
+                    if (JsonShape* it = children->slots[i].load(std::memory_order_relaxed))
+                        insertChild(grown, it);
+                }
+            }
+            insertChild(grown, child);
+            parent->mChildren.store(grown, std::memory_order_release);
+        } else {
+            insertChild(children, child);
+        }
+        parent->mChildCount++;
+        mCount++;
+        return child;
+    }
+
+    // number of shapes, including the root
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mCount;
+    }
+
+private:
+    static const JsonShape* findChild(const JsonShape* from, const JsonKey& key) {
+        const JsonShape::Transitions* children = from->mChildren.load(std::memory_order_acquire);
+        if (!children)
+            return nullptr;
+        for (size_t i = key.hash & children->mask; ; i = (i + 1) & children->mask) {
+            const JsonShape* child = children->slots[i].load(std::memory_order_acquire);
+            if (!child || child->mKeys.back() == key)
+                return child;
+        }
+    }
+
+    JsonShape::Transitions* newTransitions(size_t size) {
+        auto res = mArena.create<JsonShape::Transitions>();
+        res->mask = size - 1;
+        res->slots = static_cast<std::atomic<JsonShape*>*>(mArena.alloc(size * sizeof(std::atomic<JsonShape*>), alignof(std::atomic<JsonShape*>)));
+        for (size_t i = 0; i < size; i++)
+            new (&res->slots[i]) std::atomic<JsonShape*>(nullptr);
+        return res;
+    }
+
+    static void insertChild(JsonShape::Transitions* children, JsonShape* child) {
+        size_t i = child->mKeys.back().hash & children->mask;
+        while (children->slots[i].load(std::memory_order_relaxed))
+            i = (i + 1) & children->mask;
+        children->slots[i].store(child, std::memory_order_release);
+    }
+
+private:
+    mutable std::mutex  mMutex;
+    JsonArena           mArena;
+    JsonShape*          mRoot;
+    size_t              mCount;
+};
+
+
+// A member name for repeated lookups, e.g. in a loop over objects of the same shape.
+// It remembers the slot where the member was last found and tries it first, so a hit
+// costs one name comparison. Use one per thread.
+class JsonField {
+public:
+    explicit JsonField(std::string_view name) : mName(name), mKey(std::string_view()), mSlot(0) {
+        mKey = JsonKey(mName);
+    }
+
+    // the symbol's table must outlive the field
+    explicit JsonField(const JsonSymbol* name) : mKey(name), mSlot(0) {
+    }
+
+    JsonField(const JsonField& rhs) : mName(rhs.mName), mKey(rhs.mKey), mSlot(rhs.mSlot) {
+        if (!mKey.symbol)
+            mKey.name = mName;
+    }
+
+    JsonField& operator =(const JsonField& rhs) {
+        mName = rhs.mName;
+        mKey = rhs.mKey;
+        mSlot = rhs.mSlot;
+        if (!mKey.symbol)
+            mKey.name = mName;
+        return *this;
+    }
+
+    const JsonKey& key() const {
+        return mKey;
+    }
+
+    // returns the slot of the member in shape, or shape.size()
+    size_t find(const JsonShape& shape) const {
+        if (mSlot < shape.size() && shape.key(mSlot) == mKey)
+            return mSlot;
+        size_t slot = shape.find(mKey);
+        if (slot < shape.size())
+            mSlot = slot;
+        return slot;
+    }
+
+private:
+    std::string     mName;
+    JsonKey         mKey;
+    mutable size_t  mSlot;
+};
+
+}
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "jsonfile.h"
+#include "jsonparser.h"
+#include "jsontape.h"
+
+namespace youngJSON {
+
+// Binary image of a tape, read in place without parsing:
+//   header  : 32 bytes, see SnapshotHeader
+//   tape    : tapeSize 64-bit entries, as in a TapeDocument
+//   strings : stringSize bytes; member names are stored once
+// Entries are in the byte order of the machine that wrote the image.
+struct SnapshotHeader {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    byteOrder;
+    uint64_t    tapeSize;
+    uint64_t    stringSize;
+};
+
+static_assert(sizeof(SnapshotHeader) == 32, "SnapshotHeader must be 32 bytes");
+
+
+// A snapshot file mapped into memory, or an image borrowed from the caller. Opening it
+// checks only the header; the values are read from the pages as they are accessed.
+class JsonSnapshot {
+public:
+    static const uint32_t VERSION = 1;
+
+    JsonSnapshot() : mTape(nullptr), mStrings(nullptr), mTapeSize(0), mStringSize(0) {
+    }
+
+    explicit JsonSnapshot(const std::string& path) : JsonSnapshot() {
+        open(path);
+    }
+
+    void open(const std::string& path) {
+        auto file = std::make_unique<MappedFile>(path, false);
+        attach(file->data(), file->size());
+        mFile = std::move(file);
+    }
+
+    // data must be 8-byte aligned and outlive the snapshot
+    void attach(const void* data, size_t size) {
+        close();
+
+        SnapshotHeader header;
+        if (!data || size < sizeof(header))
+            throw invalid_format_error("invalid snapshot");
+        if (reinterpret_cast<uintptr_t>(data) % alignof(uint64_t) != 0)
+            throw std::invalid_argument("snapshot is not aligned");
+
+        memcpy(&header, data, sizeof(header));
+        SnapshotHeader expected = makeHeader(0, 0);
+        if (memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 || header.version != VERSION)
+            throw invalid_format_error("invalid snapshot");
+        if (header.byteOrder != expected.byteOrder)
+            throw invalid_format_error("snapshot has another byte order");
+
+        size_t body = size - sizeof(header);
+        if (header.tapeSize == 0 || header.tapeSize > body / sizeof(uint64_t) ||
+            header.stringSize != body - header.tapeSize * sizeof(uint64_t))
+            throw invalid_format_error("invalid snapshot");
+
+        const char* p = static_cast<const char*>(data) + sizeof(header);
+        mTape = reinterpret_cast<const uint64_t*>(p);
+        mTapeSize = static_cast<size_t>(header.tapeSize);
+        mStrings = p + mTapeSize * sizeof(uint64_t);
+        mStringSize = static_cast<size_t>(header.stringSize);
+    }
+
+    void close() {
+        mFile.reset();
+        mTape = nullptr;
+        mStrings = nullptr;
+        mTapeSize = 0;
+        mStringSize = 0;
+    }
+
+    bool empty() const {
+        return mTapeSize == 0;
+    }
+
+    TapeValue root() const {
+        if (empty())
+            throw std::invalid_argument("empty document");
+        return TapeValue(mTape, mStrings, 0);
+    }
+
+    TapeValue operator [](std::string_view name) const {
+        return root().get(name);
+    }
+
+    TapeValue operator [](int idx) const {
+        return root().get(idx);
+    }
+
+    // Checks every entry, so that the accessors stay in bounds even on a damaged or
+    // untrusted image. This reads the whole snapshot.
+    bool verify() const {
+        struct Open {
+            size_t      start;
+            size_t      end;        // position of the closing entry
+            uint64_t    count;
+            bool        object;
+            bool        expectKey;
+        };
+
+        std::vector<Open> stack;
+        size_t pos = 0;
+        while (true) {
+            if (!stack.empty() && pos == stack.back().end) {
+                Open& open = stack.back();
+                uint64_t size = (mTape[open.start] & tape::PAYLOAD_MASK) >> 32;
+                if ((open.object && !open.expectKey) ||
+                    size != (open.count < tape::MAX_SIZE ? open.count : tape::MAX_SIZE))
+                    return false;
+                pos = open.end + 1;
+                stack.pop_back();
+                if (stack.empty())
+                    return pos == mTapeSize;
+                continue;
+            }
+
+            size_t limit = stack.empty() ? mTapeSize : stack.back().end;
+            if (pos >= limit)
+                return false;
+            uint64_t w = mTape[pos];
+            unsigned tag = tape::tag(w);
+
+            if (!stack.empty() && stack.back().object && stack.back().expectKey) {
+                if (tag != vtString || !isString(w))
+                    return false;
+                stack.back().expectKey = false;
+                pos++;
+                continue;
+            }
+            if (!stack.empty()) {
+                stack.back().count++;
+                stack.back().expectKey = true;
+            }
+
+            switch (tag & 0x07) {
+            case vtNull:
+            case vtFalse:
+            case vtTrue:
+                if (tag > vtTrue)
+                    return false;
+                pos++;
+                break;
+            case vtNumber:
+                if ((tag >> 3) > nkDouble || (tag & ~0x1fu) != 0 || pos + 2 > limit)
+                    return false;
+                pos += 2;
+                break;
+            case vtString:
+                if (tag != vtString || !isString(w))
+                    return false;
+                pos++;
+                break;
+            case vtObject:
+            case vtArray:
+            {
+                size_t end = static_cast<size_t>(w & 0xffffffffu) - 1;
+                if (tag != (tag & 0x07u) || end <= pos || end >= limit || mTape[end] != tape::entry(tag | tape::TAPE_END, pos))
+                    return false;
+                stack.push_back(Open{ pos, end, 0, tag == vtObject, true });
+                pos++;
+                continue;
+            }
+            default:
+                return false;
+            }
+
+            if (stack.empty())
+                return pos == mTapeSize;
+        }
+    }
+
+    static void write(const TapeDocument& doc, std::ostream& os) {
+        if (doc.empty())
+            throw std::invalid_argument("empty document");
+        SnapshotHeader header = makeHeader(doc.tape().size(), doc.strings().size());
+        os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        os.write(reinterpret_cast<const char*>(doc.tape().data()), doc.tape().size() * sizeof(uint64_t));
+        os.write(doc.strings().data(), doc.strings().size());
+    }
+
+    static void write(const JsonValue& value, std::ostream& os) {
+        TapeDocument doc;
+        TapeBuilder builder(doc, true);
+        emit(value, builder);
+        write(doc, os);
+    }
+
+    template <typename Value>
+    static void save(const Value& value, const std::string& path) {
+        std::ofstream os(path, std::ios::binary | std::ios::trunc);
+        if (!os)
+            throw std::system_error(errno, std::generic_category(), "can't open " + path);
+        write(value, os);
+        os.close();
+        if (!os)
+            throw std::system_error(errno, std::generic_category(), "can't write " + path);
+    }
+
+private:
+    static SnapshotHeader makeHeader(uint64_t tapeSize, uint64_t stringSize) {
+        SnapshotHeader header;
+        memcpy(header.magic, "yJSNAP\0\0", sizeof(header.magic));
+        header.version = VERSION;
+        header.byteOrder = 0x01020304;
+        header.tapeSize = tapeSize;
+        header.stringSize = stringSize;
+        return header;
+    }
+
+    bool isString(uint64_t w) const {
+        uint64_t offset = w & tape::PAYLOAD_MASK;
+        uint32_t length;
+        if (mStringSize < sizeof(length) || offset > mStringSize - sizeof(length))
+            return false;
+        memcpy(&length, mStrings + offset, sizeof(length));
+        return length <= mStringSize - sizeof(length) - offset;
+    }
+
+    static void emit(const JsonValue& value, TapeBuilder& builder) {
+        if (value.isNull()) {
+            builder.null();
+        } else if (value.isBool()) {
+            builder.boolean(value.isTrue());
+        } else if (value.isNumber()) {
+            builder.number(static_cast<const ValueNumber&>(value).value(), std::string_view());
+        } else if (value.isString()) {
+            builder.string(value.toStringView());
+        } else if (value.isObject()) {
+            builder.startObject();
+            static_cast<const ValueObject&>(value).forEach([&](std::string_view name, const JsonValue& child) {
+                builder.key(name);
+                emit(child, builder);
+            });
+            builder.endObject();
+        } else {
+            builder.startArray();
+            for (int i = 0; i < value.size(); i++)
+                emit(value.get(i), builder);
+            builder.endArray();
+        }
+    }
+
+private:
+    std::unique_ptr<MappedFile> mFile;
+    const uint64_t*             mTape;
+    const char*                 mStrings;
+    size_t                      mTapeSize;
+    size_t                      mStringSize;
+};
+
+}
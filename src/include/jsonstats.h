@@ -0,0 +1,122 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include "jsonscan.h"
+#include "jsontype.h"
+
+#ifdef YOUNGJSON_X64
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+namespace youngJSON {
+
+enum StatsPhaseT {
+    spIndex,    // structural index pre-pass
+    spStrings,  // scanning and decoding strings
+    spNumbers,  // validating and converting numbers
+    spParse,    // a whole read, including the phases above
+    spWrite,    // writing top-level values
+    SP_COUNT
+};
+
+// What a JsonReader or JsonWriter did for its last document. Collected only when the
+// library is compiled with YOUNGJSON_STATS; otherwise readers and writers hold no
+// statistics at all, stats() is all zero and setStatsObserver doesn't compile. The macro
+// changes the layout of both classes, so define it alike in every translation unit.
+struct JsonStats {
+#ifdef YOUNGJSON_STATS
+    static constexpr bool ENABLED = true;
+#else
+    static constexpr bool ENABLED = false;
+#endif
+
+    size_t      bytes;              // input read or text written
+    size_t      nodes[vtArray + 1]; // values by ValueTypeT
+    size_t      keys;
+    size_t      maxDepth;
+    size_t      escapes;            // escape sequences decoded or written
+    size_t      allocations;        // values and copied strings the reader created
+    size_t      allocatedBytes;
+    uint64_t    ticks[SP_COUNT];    // see JsonStats::now
+
+    JsonStats() : bytes(0), nodes{}, keys(0), maxDepth(0), escapes(0), allocations(0), allocatedBytes(0), ticks{} {
+    }
+
+    void clear() {
+        *this = JsonStats();
+    }
+
+    static const JsonStats& none() {
+        static const JsonStats empty;
+        return empty;
+    }
+
+    // adds the statistics of another document, as for documents read by several threads
+    void add(const JsonStats& rhs) {
+        bytes += rhs.bytes;
+        for (size_t i = 0; i <= vtArray; i++)
+            nodes[i] += rhs.nodes[i];
+        keys += rhs.keys;
+        if (rhs.maxDepth > maxDepth)
+            maxDepth = rhs.maxDepth;
+        escapes += rhs.escapes;
+        allocations += rhs.allocations;
+        allocatedBytes += rhs.allocatedBytes;
+        for (size_t i = 0; i < SP_COUNT; i++)
+            ticks[i] += rhs.ticks[i];
+    }
+
+    size_t nodeCount() const {
+        size_t n = 0;
+        for (size_t count : nodes)
+            n += count;
+        return n;
+    }
+
+    // the time stamp counter where there is one, nanoseconds otherwise
+    static uint64_t now() {
+#ifdef YOUNGJSON_X64
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+};
+
+// called with the statistics of every document read or written
+typedef std::function<void(const JsonStats&)> JsonStatsObserver;
+
+
+namespace stats {
+
+// adds the time from its construction to its destruction to a phase
+class Timer {
+public:
+    Timer(JsonStats& stats, StatsPhaseT phase) : mStats(stats), mPhase(phase), mStart(JsonStats::now()) {
+    }
+
+    ~Timer() {
+        mStats.ticks[mPhase] += JsonStats::now() - mStart;
+    }
+
+    Timer(const Timer&) = delete;
+    Timer& operator =(const Timer&) = delete;
+
+private:
+    JsonStats&  mStats;
+    StatsPhaseT mPhase;
+    uint64_t    mStart;
+};
+
+}
+
+}
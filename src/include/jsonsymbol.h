@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+#include "jsonarena.h"
+
+namespace youngJSON {
+
+inline size_t hashName(std::string_view name) {
+    return std::hash<std::string_view>()(name);
+}
+
+// an interned name; it lives as long as its table
+struct JsonSymbol {
+    const char*     name;
+    size_t          length;
+    size_t          hash;
+
+    std::string_view view() const {
+        return std::string_view(name, length);
+    }
+};
+
+// Interns object member names so that objects of many documents share one copy of each
+// name and compare names by pointer. Safe to share between threads.
+class JsonSymbolTable {
+public:
+    // Names longer than MAX_NAME_LENGTH, and every new name once the table holds MAX_SYMBOLS,
+    // aren't interned; readers store them in their objects instead. This bounds the memory
+    // of a table fed documents with ever new names.
+    static const size_t MAX_SYMBOLS = 64 * 1024;
+    static const size_t MAX_NAME_LENGTH = 256;
+
+    JsonSymbolTable() : mArena(16 * 1024) {
+    }
+
+    JsonSymbolTable(const JsonSymbolTable&) = delete;
+    JsonSymbolTable& operator =(const JsonSymbolTable&) = delete;
+
+    // returns nullptr when the name can't be interned
+    const JsonSymbol* intern(std::string_view name) {
+        if (name.length() > MAX_NAME_LENGTH)
+            return nullptr;
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mSymbols.find(name);
+        if (it != mSymbols.end())
+            return it->second;
+        if (mSymbols.size() >= MAX_SYMBOLS)
+            return nullptr;
+
+        JsonSymbol* symbol = mArena.create<JsonSymbol>();
+        symbol->name = mArena.copyString(name.data(), name.length());
+        symbol->length = name.length();
+        symbol->hash = hashName(name);
+        mSymbols.emplace(symbol->view(), symbol);
+        return symbol;
+    }
+
+    // returns nullptr when the name has never been interned
+    const JsonSymbol* find(std::string_view name) const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mSymbols.find(name);
+        return it == mSymbols.end() ? nullptr : it->second;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mSymbols.size();
+    }
+
+private:
+    mutable std::mutex                                          mMutex;
+    JsonArena                                                   mArena;
+    std::unordered_map<std::string_view, const JsonSymbol*>     mSymbols;
+};
+
+
+// Name of an object member with its hash. The characters belong to a symbol or to the
+// object that holds the key; equal symbols are found without comparing characters.
+struct JsonKey {
+    std::string_view    name;
+    size_t              hash;
+    const JsonSymbol*   symbol;
+
+    explicit JsonKey(std::string_view s) : name(s), hash(hashName(s)), symbol(nullptr) {
+    }
+
+    explicit JsonKey(const JsonSymbol* sym) : name(sym->view()), hash(sym->hash), symbol(sym) {
+    }
+
+    JsonKey(std::string_view s, size_t h) : name(s), hash(h), symbol(nullptr) {
+    }
+
+    bool operator ==(const JsonKey& rhs) const {
+        if (symbol && symbol == rhs.symbol)
+            return true;
+        return hash == rhs.hash && name == rhs.name;
+    }
+};
+
+}
@@ -0,0 +1,680 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "jsonvalue.h"
+
+namespace youngJSON {
+
+// 64-bit tape entry: tag in the high 8 bits, payload in the low 56.
+//  - tag    : ValueTypeT in bits 0-2, number kind in bits 3-4, TAPE_END for a closing bracket
+//  - number : the next entry holds the value
+//  - string : offset in the string buffer, where a 32-bit length precedes the characters
+//  - { / [  : index after the matching end in the low 32 bits, size in the high 24
+//  - } / ]  : index of the matching start
+// An object lists key, value, key, value, ..., each key being a string entry.
+namespace tape {
+
+const unsigned TAPE_END = 0x20;
+const uint64_t PAYLOAD_MASK = (1ull << 56) - 1;
+const uint64_t MAX_SIZE = (1ull << 24) - 1;    // a larger container is counted when asked
+
+inline uint64_t entry(unsigned tag, uint64_t payload) {
+    return (static_cast<uint64_t>(tag) << 56) | payload;
+}
+
+inline unsigned tag(uint64_t entry) {
+    return static_cast<unsigned>(entry >> 56);
+}
+
+}
+
+
+// Read-only view of one value on a tape, from a TapeDocument or a JsonSnapshot; copying
+// it is free. Skipping a value, container or not, is O(1).
+class TapeValue {
+public:
+    TapeValue(const uint64_t* tape, const char* strings, size_t pos) : mTape(tape), mStrings(strings), mPos(pos) {
+    }
+
+    ValueTypeT type() const {
+        return static_cast<ValueTypeT>(tape::tag(word()) & 0x07);
+    }
+
+    NumberKindT numberKind() const {
+        return static_cast<NumberKindT>((tape::tag(word()) >> 3) & 0x03);
+    }
+
+    bool isNull() const {
+        return type() == vtNull;
+    }
+
+    bool isTrue() const {
+        return type() == vtTrue;
+    }
+
+    bool isFalse() const {
+        return type() == vtFalse;
+    }
+
+    bool isBool() const {
+        return type() == vtTrue || type() == vtFalse;
+    }
+
+    bool isNumber() const {
+        return type() == vtNumber;
+    }
+
+    bool isString() const {
+        return type() == vtString;
+    }
+
+    bool isObject() const {
+        return type() == vtObject;
+    }
+
+    bool isArray() const {
+        return type() == vtArray;
+    }
+
+    bool toBool() const {
+        switch (type()) {
+        case vtTrue:
+            return true;
+        case vtNumber:
+            return toDouble() != 0.0;
+        case vtString:
+            return !toStringView().empty();
+        case vtObject:
+        case vtArray:
+            return size() > 0;
+        default:
+            return false;
+        }
+    }
+
+    int toInt32() const {
+        return static_cast<int>(toInt64());
+    }
+
+    long long toInt64() const {
+        switch (type()) {
+        case vtTrue:
+            return 1ll;
+        case vtNumber:
+            return toNumber().toInt64();
+        case vtString:
+            return std::stoll(toRawString());
+        default:
+            return 0ll;
+        }
+    }
+
+    unsigned int toUInt32() const {
+        return static_cast<unsigned int>(toUInt64());
+    }
+
+    unsigned long long toUInt64() const {
+        switch (type()) {
+        case vtTrue:
+            return 1ull;
+        case vtNumber:
+            return toNumber().toUInt64();
+        case vtString:
+            return std::stoull(toRawString());
+        default:
+            return 0ull;
+        }
+    }
+
+    double toDouble() const {
+        switch (type()) {
+        case vtTrue:
+            return 1.0;
+        case vtNumber:
+            return toNumber().toDouble();
+        case vtString:
+            return std::stod(toRawString());
+        default:
+            return 0.0;
+        }
+    }
+
+    JsonNumber toNumber() const {
+        JsonNumber res;
+        if (type() == vtNumber) {
+            res.kind = numberKind();
+            res.u = mTape[mPos + 1];
+        }
+        return res;
+    }
+
+    std::string_view toStringView() const {
+        if (type() != vtString)
+            return std::string_view();
+        const char* p = mStrings + (word() & tape::PAYLOAD_MASK);
+        uint32_t length;
+        memcpy(&length, p, sizeof(length));
+        return std::string_view(p + sizeof(length), length);
+    }
+
+    std::string toRawString() const {
+        if (type() == vtString) {
+            auto s = toStringView();
+            return std::string(s.data(), s.length());
+        }
+        return toStringIndent(0);
+    }
+
+    std::string toString() const {
+        return toStringIndent(0);
+    }
+
+    std::string toStringIndent(int indentation) const {
+        std::string res;
+        JsonWriter writer(res, 2);
+        writer.setBaseIndent(indentation);
+        write(writer);
+        return res;
+    }
+
+    std::string toCompactString() const {
+        std::string res;
+        JsonWriter writer(res);
+        write(writer);
+        return res;
+    }
+
+    void write(JsonWriter& writer) const;
+
+    int size() const;
+
+    TapeValue get(int index) const {
+        if (type() != vtArray)
+            throw std::invalid_argument("can't be accessed by index");
+        if (index < 0)
+            throw std::out_of_range("index out of range");
+
+        size_t pos = mPos + 1;
+        size_t end = endPos();
+        for (; index > 0 && pos < end; index--)
+            pos = skip(pos);
+        if (pos >= end)
+            throw std::out_of_range("index out of range");
+        return at(pos);
+    }
+
+    TapeValue get(std::string_view name) const {
+        if (type() != vtObject)
+            throw std::invalid_argument("can't be accessed by name");
+
+        size_t end = endPos();
+        for (size_t pos = mPos + 1; pos < end; pos = skip(pos + 1)) {
+            if (at(pos).toStringView() == name)
+                return at(pos + 1);
+        }
+        throw std::invalid_argument("can't find the name");
+    }
+
+    TapeValue operator [](std::string_view name) const {
+        return get(name);
+    }
+
+    TapeValue operator [](int idx) const {
+        return get(idx);
+    }
+
+    // objects : fn(std::string_view name, TapeValue value)
+    // arrays  : fn(int index, TapeValue value)
+    template <typename Function>
+    void forEach(Function fn) const {
+        size_t end = endPos();
+        if constexpr (std::is_invocable<Function, std::string_view, TapeValue>::value) {
+            if (type() != vtObject)
+                return;
+            for (size_t pos = mPos + 1; pos < end; pos = skip(pos + 1))
+                fn(at(pos).toStringView(), at(pos + 1));
+        } else {
+            if (type() != vtArray)
+                return;
+            int i = 0;
+            for (size_t pos = mPos + 1; pos < end; pos = skip(pos))
+                fn(i++, at(pos));
+        }
+    }
+
+    // Walks the children of a container; for an object, key() is the member name.
+    class Iterator {
+    public:
+        Iterator(const TapeValue& container, size_t pos, bool object)
+            : mTape(container.mTape), mStrings(container.mStrings), mPos(pos), mObject(object) {
+        }
+
+        TapeValue operator *() const {
+            return TapeValue(mTape, mStrings, mObject ? mPos + 1 : mPos);
+        }
+
+        std::string_view key() const {
+            return mObject ? TapeValue(mTape, mStrings, mPos).toStringView() : std::string_view();
+        }
+
+        Iterator& operator ++() {
+            mPos = (**this).next();
+            return *this;
+        }
+
+        bool operator ==(const Iterator& rhs) const {
+            return mPos == rhs.mPos;
+        }
+
+        bool operator !=(const Iterator& rhs) const {
+            return mPos != rhs.mPos;
+        }
+
+    private:
+        const uint64_t*     mTape;
+        const char*         mStrings;
+        size_t              mPos;       // at the key of an object member
+        bool                mObject;
+    };
+
+    // empty for a scalar
+    Iterator begin() const {
+        bool container = isObject() || isArray();
+        return Iterator(*this, container ? mPos + 1 : mPos, isObject());
+    }
+
+    Iterator end() const {
+        bool container = isObject() || isArray();
+        return Iterator(*this, container ? endPos() : mPos, isObject());
+    }
+
+    // position of the value that follows this one on the tape
+    size_t next() const {
+        return skip(mPos);
+    }
+
+    size_t position() const {
+        return mPos;
+    }
+
+private:
+    uint64_t word() const {
+        return mTape[mPos];
+    }
+
+    TapeValue at(size_t pos) const {
+        return TapeValue(mTape, mStrings, pos);
+    }
+
+    size_t skip(size_t pos) const {
+        uint64_t w = mTape[pos];
+        switch (tape::tag(w) & 0x07) {
+        case vtNumber:
+            return pos + 2;
+        case vtObject:
+        case vtArray:
+            return static_cast<size_t>(w & 0xffffffffu);
+        default:
+            return pos + 1;
+        }
+    }
+
+    // for a container, the position of its closing entry
+    size_t endPos() const {
+        if (!isObject() && !isArray())
+            return mPos;
+        return static_cast<size_t>(word() & 0xffffffffu) - 1;
+    }
+
+private:
+    const uint64_t*     mTape;
+    const char*         mStrings;
+    size_t              mPos;
+};
+
+
+// A document read into one tape of 64-bit entries and one string buffer. It can't be
+// modified, and dropping it frees two allocations.
+class TapeDocument {
+public:
+    TapeDocument() = default;
+
+    bool empty() const {
+        return mTape.empty();
+    }
+
+    TapeValue root() const {
+        if (mTape.empty())
+            throw std::invalid_argument("empty document");
+        return TapeValue(mTape.data(), mStrings.data(), 0);
+    }
+
+    TapeValue operator [](std::string_view name) const {
+        return root().get(name);
+    }
+
+    TapeValue operator [](int idx) const {
+        return root().get(idx);
+    }
+
+    const std::vector<uint64_t>& tape() const {
+        return mTape;
+    }
+
+    const std::string& strings() const {
+        return mStrings;
+    }
+
+    // keeps the capacity for the next parse
+    void clear() {
+        mTape.clear();
+        mStrings.clear();
+    }
+
+private:
+    friend class TapeBuilder;
+
+    std::vector<uint64_t>   mTape;
+    std::string             mStrings;
+};
+
+
+// Writes the events of a parse to a TapeDocument; containers are patched when they end.
+// With shareKeys, equal member names are stored once in the string buffer. A duplicate
+// name replaces the earlier value in place, as in the DOM.
+class TapeBuilder {
+public:
+    // the vectors a builder works in, which a reader keeps between parses
+    class Buffers {
+        friend class TapeBuilder;
+
+        struct Open {
+            size_t      pos;
+            uint64_t    size;
+            uint64_t    seen;       // a bit of the length and ends of every name
+            bool        collided;   // two names set the same bit
+        };
+
+        // members with the same name: the first gives the position, the last the value
+        struct Member {
+            uint32_t    first;
+            uint32_t    last;
+        };
+
+        std::vector<Open>       open;
+        std::vector<size_t>     keyPositions;
+        std::vector<Member>     members;
+        std::vector<uint32_t>   keySlots;
+        std::vector<uint64_t>   scratch;
+    };
+
+    explicit TapeBuilder(TapeDocument& doc, bool shareKeys = false) : TapeBuilder(doc, mOwnBuffers, shareKeys) {
+    }
+
+    TapeBuilder(TapeDocument& doc, Buffers& buffers, bool shareKeys = false)
+        : mTape(doc.mTape), mStrings(doc.mStrings), mOpen(buffers.open), mKeyPositions(buffers.keyPositions),
+          mMembers(buffers.members), mKeySlots(buffers.keySlots), mScratch(buffers.scratch), mShareKeys(shareKeys) {
+        mOpen.clear();
+    }
+
+    void null() {
+        value();
+        mTape.push_back(tape::entry(vtNull, 0));
+    }
+
+    void boolean(bool value) {
+        this->value();
+        mTape.push_back(tape::entry(value ? vtTrue : vtFalse, 0));
+    }
+
+    void number(const JsonNumber& value, std::string_view lexeme) {
+        this->value();
+        mTape.push_back(tape::entry(vtNumber | (value.kind << 3), 0));
+        mTape.push_back(value.u);
+    }
+
+    void string(std::string_view s) {
+        value();
+        addString(s);
+    }
+
+    void key(std::string_view name) {
+        Open& open = mOpen.back();
+        size_t ends = name.empty() ? 0 : static_cast<unsigned char>(name[0]) + static_cast<unsigned char>(name.back()) * 3;
+        uint64_t bit = 1ull << ((name.length() * 7 + ends) & 63);
+        open.collided |= (open.seen & bit) != 0;
+        open.seen |= bit;
+        if (!mShareKeys) {
+            addString(name);
+            return;
+        }
+        auto it = mKeys.emplace(std::string(name.data(), name.length()), mStrings.size());
+        if (it.second)
+            addString(name);
+        else
+            mTape.push_back(tape::entry(vtString, it.first->second));
+    }
+
+    void startObject() {
+        startContainer(vtObject);
+    }
+
+    void endObject() {
+        removeDuplicateKeys(mOpen.back());
+        endContainer(vtObject);
+    }
+
+    void startArray() {
+        startContainer(vtArray);
+    }
+
+    void endArray() {
+        endContainer(vtArray);
+    }
+
+private:
+    using Open = Buffers::Open;
+    using Member = Buffers::Member;
+
+    // counts the value in its container
+    void value() {
+        if (!mOpen.empty())
+            mOpen.back().size++;
+    }
+
+    void addString(std::string_view s) {
+        uint32_t length = static_cast<uint32_t>(s.length());
+        size_t offset = mStrings.size();
+        mStrings.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        mStrings.append(s.data(), s.length());
+        mStrings.push_back('\0');
+        mTape.push_back(tape::entry(vtString, offset));
+    }
+
+    void startContainer(ValueTypeT type) {
+        value();
+        mOpen.push_back(Open{ mTape.size(), 0, 0, false });
+        mTape.push_back(tape::entry(type, 0));
+    }
+
+    std::string_view keyName(size_t i) const {
+        return TapeValue(mTape.data(), mStrings.data(), mKeyPositions[i]).toStringView();
+    }
+
+    // Names that set different bits differ, so most objects are done without looking at
+    // the names again. The members are rewritten only when a name repeats.
+    void removeDuplicateKeys(Open& open) {
+        if (!open.collided)
+            return;
+        mKeyPositions.clear();
+        for (size_t pos = open.pos + 1; pos < mTape.size(); pos = TapeValue(mTape.data(), mStrings.data(), pos + 1).next())
+            mKeyPositions.push_back(pos);
+        if (hasDuplicateKeys())
+            foldDuplicateKeys(open);
+    }
+
+    // small objects compare the names pairwise, larger ones hash them into mKeySlots
+    bool hasDuplicateKeys() {
+        static const size_t SMALL_OBJECT = 16;
+
+        const size_t count = mKeyPositions.size();
+        if (count <= SMALL_OBJECT) {
+            std::string_view names[SMALL_OBJECT];
+            for (size_t i = 0; i < count; i++) {
+                names[i] = keyName(i);
+                for (size_t j = 0; j < i; j++) {
+                    if (names[j] == names[i])
+                        return true;
+                }
+            }
+            return false;
+        }
+
+        size_t mask = slotMask(count);
+        for (size_t i = 0; i < count; i++) {
+            std::string_view name = keyName(i);
+            size_t h = hashName(name) & mask;
+            while (mKeySlots[h]) {
+                if (keyName(mKeySlots[h] - 1) == name)
+                    return true;
+                h = (h + 1) & mask;
+            }
+            mKeySlots[h] = static_cast<uint32_t>(i + 1);
+        }
+        return false;
+    }
+
+    // rewrites the members with the first key of every name and its last value
+    void foldDuplicateKeys(Open& open) {
+        const size_t count = mKeyPositions.size();
+        mMembers.clear();
+        size_t mask = slotMask(count);
+        for (size_t i = 0; i < count; i++) {
+            std::string_view name = keyName(i);
+            size_t h = hashName(name) & mask;
+            while (mKeySlots[h] && keyName(mMembers[mKeySlots[h] - 1].first) != name)
+                h = (h + 1) & mask;
+            if (!mKeySlots[h]) {
+                mMembers.push_back(Member{ static_cast<uint32_t>(i), 0 });
+                mKeySlots[h] = static_cast<uint32_t>(mMembers.size());
+            }
+            mMembers[mKeySlots[h] - 1].last = static_cast<uint32_t>(i);
+        }
+
+        const size_t first = open.pos + 1;
+        mScratch.assign(mTape.begin() + first, mTape.end());
+        mTape.resize(first);
+        for (auto& it : mMembers) {
+            size_t value = mKeyPositions[it.last] + 1;
+            size_t end = it.last + 1 < count ? mKeyPositions[it.last + 1] : first + mScratch.size();
+            mTape.push_back(mScratch[mKeyPositions[it.first] - first]);
+            copySpan(value - first, end - first, mTape.size() - value);
+        }
+        open.size = mMembers.size();
+    }
+
+    // clears mKeySlots for count names
+    size_t slotMask(size_t count) {
+        size_t mask = 1;
+        while (mask < count * 2)
+            mask <<= 1;
+        mKeySlots.assign(mask, 0);
+        return mask - 1;
+    }
+
+    // appends mScratch[from, to) to the tape, adding delta to the positions it holds
+    void copySpan(size_t from, size_t to, uint64_t delta) {
+        for (size_t i = from; i < to; i++) {
+            uint64_t w = mScratch[i];
+            unsigned tag = tape::tag(w);
+            if (tag & tape::TAPE_END) {
+                w = tape::entry(tag, (w + delta) & tape::PAYLOAD_MASK);
+            } else if ((tag & 0x07) == vtNumber) {
+                mTape.push_back(w);
+                w = mScratch[++i];
+            } else if ((tag & 0x07) == vtObject || (tag & 0x07) == vtArray) {
+                w = (w & ~0xffffffffull) | ((w + delta) & 0xffffffffull);
+            }
+            mTape.push_back(w);
+        }
+    }
+
+    void endContainer(ValueTypeT type) {
+        Open open = mOpen.back();
+        mOpen.pop_back();
+        mTape.push_back(tape::entry(type | tape::TAPE_END, open.pos));
+        uint64_t size = open.size < tape::MAX_SIZE ? open.size : tape::MAX_SIZE;
+        mTape[open.pos] = tape::entry(type, (size << 32) | mTape.size());
+    }
+
+private:
+    std::vector<uint64_t>&  mTape;
+    std::string&            mStrings;
+    Buffers                 mOwnBuffers;
+    std::vector<Open>&      mOpen;
+    std::vector<size_t>&    mKeyPositions;
+    std::vector<Member>&    mMembers;
+    std::vector<uint32_t>&  mKeySlots;
+    std::vector<uint64_t>&  mScratch;
+
+    bool                                        mShareKeys;
+    std::unordered_map<std::string, uint64_t>   mKeys;
+};
+
+
+inline int TapeValue::size() const {
+    if (!isObject() && !isArray())
+        return 0;
+    uint64_t size = (word() & tape::PAYLOAD_MASK) >> 32;
+    if (size < tape::MAX_SIZE)
+        return static_cast<int>(size);
+
+    int count = 0;
+    for (auto it = begin(); it != end(); ++it)
+        count++;
+    return count;
+}
+
+inline void TapeValue::write(JsonWriter& writer) const {
+    switch (type()) {
+    case vtNull:
+        writer.null();
+        break;
+    case vtFalse:
+        writer.boolean(false);
+        break;
+    case vtTrue:
+        writer.boolean(true);
+        break;
+    case vtNumber:
+        writer.number(toNumber());
+        break;
+    case vtString:
+        writer.string(toStringView());
+        break;
+    case vtObject:
+        writer.startObject();
+        for (auto it = begin(); it != end(); ++it) {
+            writer.key(it.key());
+            (*it).write(writer);
+        }
+        writer.endObject();
+        break;
+    case vtArray:
+        writer.startArray();
+        for (auto it = begin(); it != end(); ++it)
+            (*it).write(writer);
+        writer.endArray();
+        break;
+    }
+}
+
+}
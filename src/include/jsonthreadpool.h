@@ -0,0 +1,117 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace youngJSON {
+
+// Fixed set of threads that run one job at a time. The job is run once on every
+// pool thread and once on the calling thread; it is expected to pull its own work
+// items (e.g. from an atomic counter) until none are left.
+class ThreadPool {
+public:
+    // threadCount includes the calling thread; 0 uses every hardware thread
+    explicit ThreadPool(unsigned threadCount = 0)
+        : mJob(nullptr), mGeneration(0), mPending(0), mQuit(false) {
+        if (threadCount == 0)
+            threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0)
+            threadCount = 1;
+
+        for (unsigned i = 1; i < threadCount; i++)
+            mThreads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mQuit = true;
+        }
+        mWake.notify_all();
+        for (auto& t : mThreads)
+            t.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator =(const ThreadPool&) = delete;
+
+    // number of threads that run a job, including the calling thread
+    unsigned size() const {
+        return static_cast<unsigned>(mThreads.size()) + 1;
+    }
+
+    // Runs job(index) with index 0 on the calling thread and 1..size()-1 on the pool threads.
+    // Returns when every call has returned, rethrowing the first exception if any.
+    void run(const std::function<void(unsigned)>& job) {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mJob = &job;
+            mError = nullptr;
+            mPending = mThreads.size();
+            ++mGeneration;
+        }
+        mWake.notify_all();
+
+        std::exception_ptr error;
+        try {
+            job(0);
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        mDone.wait(lock, [this] { return mPending == 0; });
+        mJob = nullptr;
+        if (!error)
+            error = mError;
+        lock.unlock();
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+private:
+    void workerLoop(unsigned index) {
+        size_t seen = 0;
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true) {
+            mWake.wait(lock, [&] { return mQuit || mGeneration != seen; });
+            if (mQuit)
+                return;
+            seen = mGeneration;
+            const std::function<void(unsigned)>* job = mJob;
+            lock.unlock();
+
+            std::exception_ptr error;
+            try {
+                (*job)(index);
+            } catch (...) {
+                error = std::current_exception();
+            }
+
+            lock.lock();
+            if (error && !mError)
+                mError = error;
+            if (--mPending == 0)
+                mDone.notify_all();
+        }
+    }
+
+private:
+    std::vector<std::thread>                mThreads;
+    std::mutex                              mMutex;
+    std::condition_variable                 mWake;
+    std::condition_variable                 mDone;
+
+    const std::function<void(unsigned)>*    mJob;
+    size_t                                  mGeneration;
+    size_t                                  mPending;
+    std::exception_ptr                      mError;
+    bool                                    mQuit;
+};
+
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+namespace youngJSON {
+
+enum ValueTypeT {
+    vtNull,
+    vtFalse,
+    vtTrue,
+    vtNumber,
+    vtString,
+    vtObject,
+    vtArray
+};
+
+}
@@ -1,22 +1,70 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <cstring>
 #include <memory>
+#include <memory_resource>
+#include <stdexcept>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <type_traits>
 #include <functional>
 #include <vector>
 
+#include "jsonarena.h"
+#include "jsonnumber.h"
+#include "jsonshape.h"
+#include "jsonsymbol.h"
+#include "jsontype.h"
+#include "jsonwriter.h"
+
 namespace youngJSON {
 
-enum ValueTypeT {
-    vtNull,
-    vtFalse,
-    vtTrue,
-    vtNumber,
-    vtString,
-    vtObject,
-    vtArray
-};
+namespace hashing {
+
+// A change clears the cached hashes on the path from the value to its root. A value held by
+// more than one container can't tell its paths, so its change bumps this epoch instead,
+// which makes every cached hash of the process stale. It's 64-bit so that it never wraps
+// back to a stale value.
+inline std::atomic<uint64_t>& epoch() {
+    static std::atomic<uint64_t> value(1);
+    return value;
+}
+
+inline uint64_t currentEpoch() {
+    return epoch().load(std::memory_order_acquire);
+}
+
+inline void invalidate() {
+    epoch().fetch_add(1, std::memory_order_acq_rel);
+}
+
+inline uint64_t mix(uint64_t h) {
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    return h ^ (h >> 31);
+}
+
+inline uint64_t combine(uint64_t seed, uint64_t h) {
+    return mix(seed ^ (h + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2)));
+}
+
+// numbers that compare equal hash alike, so integral doubles hash by their integer value
+inline uint64_t number(const JsonNumber& value) {
+    unsigned long long integer;
+    bool negative;
+    if (value.toExactInteger(integer, negative))
+        return combine(vtNumber, integer);
+    uint64_t bits;
+    memcpy(&bits, &value.d, sizeof(bits));
+    return combine(vtNumber, bits);
+}
+
+}
+
 
 class JsonValue {
 public:
@@ -51,14 +99,40 @@ public:
         return toStringIndent(0);
     }
 
+    // valid only for strings, and only while the value is alive and unchanged
+    virtual std::string_view toStringView() const {
+        return std::string_view();
+    }
+
     virtual std::string toString() const {
         return toStringIndent(0);
     }
 
-    virtual std::string toStringIndent(int indentation) const = 0;
+    virtual std::string toStringIndent(int indentation) const {
+        std::string res;
+        JsonWriter writer(res, 2);
+        writer.setBaseIndent(indentation);
+        write(writer);
+        return res;
+    }
 
     virtual std::string toCompactString() const {
-        return toStringIndent(0);
+        std::string res;
+        JsonWriter writer(res);
+        write(writer);
+        return res;
+    }
+
+    virtual void write(JsonWriter& writer) const = 0;
+
+    // Structural hash: equal values have equal hashes, whatever the order of object members.
+    // Containers cache it until a value that has been hashed changes. Stable only within a process.
+    virtual uint64_t hash() const {
+        return hashing::mix(mType);
+    }
+
+    ValueTypeT type() const {
+        return mType;
     }
 
     virtual int size() const {
@@ -130,11 +204,40 @@ public:
     }
 
 protected:
-    JsonValue(ValueTypeT type = vtNull) : mType(type) {
+    JsonValue(ValueTypeT type = vtNull) : mType(type), mParent(nullptr) {
+    }
+
+    JsonValue(const JsonValue& rhs) : mType(rhs.mType), mParent(nullptr) {
+    }
+
+    JsonValue& operator =(const JsonValue& rhs) {
+        changed();
+        mType = rhs.mType;
+        return *this;
+    }
+
+    // Called before every change of the value. Clears the cached hashes up to the first
+    // container that has none, since a container's hash is cached with those below it.
+    void changed();
+
+    // called by a container for every child it takes and drops
+    void adoptChild(JsonValue& child) {
+        child.mParent = child.mParent ? sharedParent() : this;
+    }
+
+    void releaseChild(JsonValue& child) {
+        if (child.mParent == this)
+            child.mParent = nullptr;
+    }
+
+    // the parent of a value in more than one place
+    static JsonValue* sharedParent() {
+        return reinterpret_cast<JsonValue*>(uintptr_t(1));
     }
 
 protected:
     ValueTypeT  mType;
+    JsonValue*  mParent;    // the container that holds this value, or sharedParent()
 };
 
 
@@ -143,8 +246,8 @@ public:
     ValueNull() : JsonValue(vtNull) {
     }
     
-    std::string toStringIndent(int indentation) const override {
-        return "null";
+    void write(JsonWriter& writer) const override {
+        writer.null();
     }
 };
 
@@ -153,8 +256,8 @@ public:
     ValueFalse() : JsonValue(vtFalse) {
     }
 
-    std::string toStringIndent(int indentation) const override {
-        return "false";
+    void write(JsonWriter& writer) const override {
+        writer.boolean(false);
     }
 };
 
@@ -188,8 +291,8 @@ public:
         return 1.0;
     }
 
-    std::string toStringIndent(int indentation) const override {
-        return "true";
+    void write(JsonWriter& writer) const override {
+        writer.boolean(true);
     }
 };
 
@@ -201,7 +304,10 @@ public:
     explicit ValueString(const char* s) : JsonValue(vtString), mValue(s) {
     }
 
-    explicit ValueString(const std::string& s) : JsonValue(vtString), mValue(s) {
+    explicit ValueString(const std::string& s) : JsonValue(vtString), mValue(s.data(), s.length()) {
+    }
+
+    ValueString(const char* s, size_t length, std::pmr::memory_resource* mr) : JsonValue(vtString), mValue(s, length, mr) {
     }
 
     bool toBool() const override {
@@ -209,111 +315,335 @@ public:
     }
 
     int toInt32() const override {
-        return std::stoi(mValue);
+        return std::stoi(toRawString());
     }
 
     long long toInt64() const override {
-        return std::stoll(mValue);
+        return std::stoll(toRawString());
     }
 
     unsigned int toUInt32() const override {
-        return static_cast<int>(std::stoul(mValue));
+        return static_cast<int>(std::stoul(toRawString()));
     }
 
     unsigned long long toUInt64() const override {
-        return std::stoull(mValue);
+        return std::stoull(toRawString());
     }
 
     double toDouble() const override {
-        return std::stod(mValue);
+        return std::stod(toRawString());
     }
 
     std::string toRawString() const override {
+        return std::string(mValue.data(), mValue.length());
+    }
+
+    std::string_view toStringView() const override {
         return mValue;
     }
 
-    std::string toStringIndent(int indentation) const override {
-        return std::string("\"") + mValue + "\"";
+    void write(JsonWriter& writer) const override {
+        writer.string(mValue);
+    }
+
+    uint64_t hash() const override {
+        return hashing::combine(vtString, hashName(mValue));
     }
 
     void setValue(const char* s) {
+        changed();
         mValue = s;
     }
 
     void setValue(const std::string& s) {
-        mValue = s;
+        changed();
+        mValue.assign(s.data(), s.length());
+    }
+
+private:
+    std::pmr::string mValue;
+};
+
+// read-only string that refers to memory owned by someone else (the input buffer or an arena)
+class ValueStringRef : public JsonValue {
+public:
+    ValueStringRef() : JsonValue(vtString) {
+    }
+
+    explicit ValueStringRef(std::string_view s) : JsonValue(vtString), mValue(s) {
+    }
+
+    bool toBool() const override {
+        return !mValue.empty();
+    }
+
+    int toInt32() const override {
+        return std::stoi(toRawString());
+    }
+
+    long long toInt64() const override {
+        return std::stoll(toRawString());
+    }
+
+    unsigned int toUInt32() const override {
+        return static_cast<int>(std::stoul(toRawString()));
+    }
+
+    unsigned long long toUInt64() const override {
+        return std::stoull(toRawString());
+    }
+
+    double toDouble() const override {
+        return std::stod(toRawString());
+    }
+
+    std::string toRawString() const override {
+        return std::string(mValue.data(), mValue.length());
+    }
+
+    std::string_view toStringView() const override {
+        return mValue;
+    }
+
+    void write(JsonWriter& writer) const override {
+        writer.string(mValue);
+    }
+
+    uint64_t hash() const override {
+        return hashing::combine(vtString, hashName(mValue));
     }
 
 private:
-    std::string mValue;
+    std::string_view mValue;
 };
 
 struct ValueNumber : public JsonValue {
-    ValueNumber() : JsonValue(vtNumber) {
+    ValueNumber() : JsonValue(vtNumber), mRaw(nullptr), mRawLength(0), mRawOwner(nullptr) {
     }
 
-    explicit ValueNumber(const char* s) : JsonValue(vtNumber), mValue(s) {
+    explicit ValueNumber(const char* s) : ValueNumber() {
+        setValue(s);
     }
 
-    explicit ValueNumber(const std::string& s) : JsonValue(vtNumber), mValue(s) {
+    explicit ValueNumber(const std::string& s) : ValueNumber() {
+        setValue(s);
     }
 
-    template <typename T>
-    explicit ValueNumber(T value) : JsonValue(vtNumber), mValue(std::to_string(value)) {
+    explicit ValueNumber(const JsonNumber& value) : ValueNumber() {
+        mValue = value;
+    }
+
+    // Keeps the lexeme for lossless output. When mr is null, raw must outlive this value;
+    // otherwise it is copied into memory from mr.
+    ValueNumber(const JsonNumber& value, std::string_view raw, std::pmr::memory_resource* mr) : ValueNumber() {
+        mValue = value;
+        setRaw(raw, mr);
+    }
+
+    template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+    explicit ValueNumber(T value) : ValueNumber() {
+        setValue(value);
+    }
+
+    ValueNumber(const ValueNumber& rhs) : JsonValue(rhs), mValue(rhs.mValue), mRaw(nullptr), mRawLength(0), mRawOwner(nullptr) {
+        if (rhs.mRaw)
+            setRaw(rhs.rawString(), std::pmr::get_default_resource());
+    }
+
+    ValueNumber& operator =(const ValueNumber& rhs) {
+        if (this != &rhs) {
+            changed();
+            mValue = rhs.mValue;
+            setRaw(rhs.rawString(), rhs.mRaw ? std::pmr::get_default_resource() : nullptr);
+        }
+        return *this;
+    }
+
+    ~ValueNumber() {
+        clearRaw();
     }
 
     bool toBool() const override {
-        return toInt64() == 0ull && toDouble() == 0.0;
+        return mValue.toDouble() != 0.0;
     }
 
     int toInt32() const override {
-        return std::stoi(mValue);
+        return static_cast<int>(mValue.toInt64());
     }
 
     long long toInt64() const override {
-        return std::stoll(mValue);
+        return mValue.toInt64();
     }
 
     unsigned int toUInt32() const override {
-        return static_cast<int>(std::stoul(mValue));
+        return static_cast<unsigned int>(mValue.toUInt64());
     }
 
     unsigned long long toUInt64() const override {
-        return std::stoull(mValue);
+        return mValue.toUInt64();
     }
 
     double toDouble() const override {
-        return std::stod(mValue);
+        return mValue.toDouble();
+    }
+
+    void write(JsonWriter& writer) const override {
+        if (mRaw)
+            writer.rawNumber(rawString());
+        else
+            writer.number(mValue);
     }
 
-    std::string toStringIndent(int indentation) const override {
+    uint64_t hash() const override {
+        return hashing::number(mValue);
+    }
+
+    const JsonNumber& value() const {
         return mValue;
     }
 
+    NumberKindT numberKind() const {
+        return mValue.kind;
+    }
+
+    // the lexeme this number was read from, or empty if only the binary value is kept
+    std::string_view rawString() const {
+        return std::string_view(mRaw, mRawLength);
+    }
+
+    bool hasRawString() const {
+        return mRaw != nullptr;
+    }
+
     void setValue(const char* s) {
-        mValue = s;
+        setValue(std::string_view(s));
     }
 
     void setValue(const std::string& s) {
-        mValue = s;
+        setValue(std::string_view(s));
+    }
+
+    void setValue(std::string_view s) {
+        JsonNumber value;
+        const char* end = parseNumber(s.data(), s.data() + s.length(), value);
+        if (!end || end != s.data() + s.length())
+            throw std::invalid_argument("invalid number");
+        changed();
+        mValue = value;
+        setRaw(s, std::pmr::get_default_resource());
+    }
+
+    void setValue(const JsonNumber& value) {
+        changed();
+        mValue = value;
+        clearRaw();
     }
 
     template <typename T>
-    void setValue(T value) {
-        mValue = std::to_string(value);
+    typename std::enable_if<std::is_arithmetic<T>::value>::type setValue(T value) {
+        changed();
+        if constexpr (std::is_floating_point<T>::value) {
+            mValue.kind = nkDouble;
+            mValue.d = static_cast<double>(value);
+        } else if constexpr (std::is_signed<T>::value) {
+            mValue.kind = nkInt64;
+            mValue.i = static_cast<long long>(value);
+        } else {
+            mValue.kind = nkUInt64;
+            mValue.u = static_cast<unsigned long long>(value);
+        }
+        clearRaw();
     }
 
 private:
-    std::string mValue;
+    void setRaw(std::string_view raw, std::pmr::memory_resource* mr) {
+        clearRaw();
+        if (!raw.data())
+            return;
+        if (mr) {
+            char* p = static_cast<char*>(mr->allocate(raw.length() + 1, 1));
+            memcpy(p, raw.data(), raw.length());
+            p[raw.length()] = 0;
+            mRaw = p;
+        } else {
+            mRaw = raw.data();
+        }
+        mRawLength = static_cast<unsigned int>(raw.length());
+        mRawOwner = mr;
+    }
+
+    void clearRaw() {
+        if (mRawOwner)
+            mRawOwner->deallocate(const_cast<char*>(mRaw), mRawLength + 1, 1);
+        mRaw = nullptr;
+        mRawLength = 0;
+        mRawOwner = nullptr;
+    }
+
+private:
+    JsonNumber                  mValue;
+    const char*                 mRaw;
+    unsigned int                mRawLength;
+    std::pmr::memory_resource*  mRawOwner;
 };
 
 
+// a deep copy on the heap, independent of the source's arena, tables and input
+std::shared_ptr<JsonValue> copyValue(const JsonValue& value);
+
+// Nodes living in a JsonArena are never destroyed, so a heap-owned child is kept
+// alive by the arena and the container only holds a non-owning reference to it.
+template <typename Allocator>
+inline std::shared_ptr<JsonValue> adopt(const Allocator& alloc, const std::shared_ptr<JsonValue>& value) {
+    if (value.use_count() == 0)
+        return value;
+    auto arena = dynamic_cast<JsonArena*>(alloc.resource());
+    if (!arena)
+        return value;
+    arena->retain(value);
+    return std::shared_ptr<JsonValue>(std::shared_ptr<JsonValue>(), value.get());
+}
+
+// Member names live in a shape and values in a vector in the same order. Objects created
+// with a JsonShapeTable share one shape per sequence of names; otherwise, or once the table
+// refuses a transition (see JsonShapeTable::MAX_SHARED_SIZE), the object owns a private shape whose
+// names are symbols or copies in memory from the object's resource.
 struct ValueObject : public JsonValue {
-    ValueObject() : JsonValue(vtObject) {
+    ValueObject() : JsonValue(vtObject), mShape(nullptr), mHash(0), mHashEpoch(0) {
+    }
+
+    explicit ValueObject(std::pmr::memory_resource* mr) : JsonValue(vtObject), mShape(nullptr), mValues(mr), mHash(0), mHashEpoch(0) {
+    }
+
+    // the table must outlive this object
+    explicit ValueObject(JsonShapeTable& table) : JsonValue(vtObject), mShape(table.root()), mHash(0), mHashEpoch(0) {
+    }
+
+    ValueObject(JsonShapeTable& table, std::pmr::memory_resource* mr)
+        : JsonValue(vtObject), mShape(table.root()), mValues(mr), mHash(0), mHashEpoch(0) {
+    }
+
+    // Members are deep copies, so a copy of a document's object outlives the document. A copy
+    // of an object with a shape table shares the table, which must outlive the copy as well.
+    ValueObject(const ValueObject& rhs) : JsonValue(rhs), mShape(nullptr), mHash(0), mHashEpoch(0) {
+        assign(rhs);
+    }
+
+    ValueObject& operator =(const ValueObject& rhs) {
+        if (this != &rhs) {
+            changed();
+            clear();
+            assign(rhs);
+        }
+        return *this;
+    }
+
+    ~ValueObject() {
+        clear();
     }
 
     int size() const override {
-        return static_cast<int>(mChildren.size());
+        return static_cast<int>(mValues.size());
     }
 
     const JsonValue& get(int index) const override {
@@ -329,89 +659,299 @@ struct ValueObject : public JsonValue {
     }
 
     JsonValue& get(const std::string& name) override {
-        return *mChildren[name];
+        JsonValue* value = find(std::string_view(name));
+        if (!value)
+            throw std::invalid_argument("can't find the name");
+        return *value;
     }
 
-    bool toBool() const override {
-        return !mChildren.empty();
+    // returns nullptr when there is no such member
+    const JsonValue* find(std::string_view name) const {
+        return findKey(JsonKey(name));
     }
 
-    std::string toStringIndent(int indentation) const override {
-        std::string res;
-        std::string spaces1(indentation, ' ');
-        std::string spaces2(indentation + 2, ' ');
-
-        res += "{\n";
-
-        int cnt = 0;
-        for (auto& it : mChildren) {
-            if (cnt++ > 0)
-                res += ",\n";
-            res += spaces2;
-            res += '\"';
-            res += it.first;
-            res += "\": ";
-            res += it.second->toStringIndent(indentation + 2);
-        }
-        res += "\n";
-        res += spaces1;
-        res += "}";
+    const JsonValue* find(const JsonSymbol* name) const {
+        return findKey(JsonKey(name));
+    }
 
-        return res;
+    const JsonValue* find(const JsonField& field) const {
+        if (!mShape)
+            return nullptr;
+        size_t slot = field.find(*mShape);
+        return slot < mValues.size() ? mValues[slot].get() : nullptr;
     }
 
-    std::string toCompactString() const override {
-        std::string res;
+    JsonValue* find(std::string_view name) {
+        return const_cast<JsonValue*>(static_cast<const ValueObject*>(this)->find(name));
+    }
+
+    JsonValue& operator [](std::string_view name) {
+        JsonValue* value = find(name);
+        if (!value)
+            throw std::invalid_argument("can't find the name");
+        return *value;
+    }
 
-        res += "{";
+    const JsonValue& operator [](std::string_view name) const {
+        return const_cast<ValueObject&>(*this)[name];
+    }
 
-        int cnt = 0;
-        for (auto& it : mChildren) {
-            if (cnt++ > 0)
-                res += ",";
-            res += '\"';
-            res += it.first;
-            res += "\":";
-            res += it.second->toCompactString();
-        }
+    // nullptr for an empty object that doesn't use a shape table
+    const JsonShape* shape() const {
+        return mShape;
+    }
+
+    void reserve(size_t n) {
+        mValues.reserve(n);
+    }
 
-        res += "}";
+    bool toBool() const override {
+        return !mValues.empty();
+    }
 
+    void write(JsonWriter& writer) const override {
+        writer.startObject();
+        for (size_t i = 0; i < mValues.size(); i++) {
+            writer.key(mShape->key(i).name);
+            mValues[i]->write(writer);
+        }
+        writer.endObject();
+    }
+
+    // members are summed, so their order doesn't matter
+    uint64_t hash() const override {
+        uint64_t res;
+        if (cachedHash(res))
+            return res;
+        uint64_t epoch = hashing::currentEpoch();
+        uint64_t sum = 0;
+        for (size_t i = 0; i < mValues.size(); i++)
+            sum += hashing::combine(mShape->key(i).hash, mValues[i]->hash());
+        res = hashing::combine(vtObject, sum);
+        mHash.store(res, std::memory_order_relaxed);
+        mHashEpoch.store(epoch, std::memory_order_release);
         return res;
     }
 
+    // true, with the hash, when it is known without visiting the members
+    bool cachedHash(uint64_t& res) const {
+        if (mHashEpoch.load(std::memory_order_acquire) != hashing::currentEpoch())
+            return false;
+        res = mHash.load(std::memory_order_relaxed);
+        return true;
+    }
+
+    // false when no hash was cached
+    bool forgetHash() {
+        uint64_t epoch = mHashEpoch.load(std::memory_order_relaxed);
+        if (epoch == 0 || epoch != hashing::currentEpoch())
+            return false;
+        mHashEpoch.store(0, std::memory_order_relaxed);
+        return true;
+    }
+
     template <typename Function>
     void forEach(Function fn) const {
-        for (const auto& it : mChildren) {
-            fn(it.first, *it.second);
+        for (size_t i = 0; i < mValues.size(); i++) {
+            fn(mShape->key(i).name, static_cast<const JsonValue&>(*mValues[i]));
         }
     }
 
     template <typename Function>
     void forEach(Function fn) {
-        for (auto& it : mChildren) {
-            fn(it.first, *it.second);
+        for (size_t i = 0; i < mValues.size(); i++) {
+            fn(mShape->key(i).name, *mValues[i]);
         }
     }
 
     JsonValue& add(const std::string& name, std::shared_ptr<JsonValue> value) {
-        mChildren[name] = value;
+        return add(name.data(), name.length(), value);
+    }
+
+    JsonValue& add(const char* name, size_t length, std::shared_ptr<JsonValue> value) {
+        changed();
+        addKey(JsonKey(std::string_view(name, length)), value);
+        return *value;
+    }
+
+    JsonValue& add(std::pmr::string&& name, std::shared_ptr<JsonValue> value) {
+        return add(name.data(), name.length(), value);
+    }
+
+    // the symbol's table must outlive this object
+    JsonValue& add(const JsonSymbol* name, std::shared_ptr<JsonValue> value) {
+        changed();
+        addKey(JsonKey(name), value);
+        return *value;
+    }
+
+    template <typename T>
+    T& add(const std::string& name, std::shared_ptr<T> value) {
+        add(name.data(), name.length(), std::static_pointer_cast<JsonValue>(value));
         return *value;
     }
 
     template <typename T>
     T& add(const std::string& name, const T& value) {
         auto p = std::make_shared<T>(value);
-        mChildren[name] = p;
-        return dynamic_cast<T&>(*p);
+        add(name.data(), name.length(), p);
+        return *p;
+    }
+
+    // returns false when there is no such member
+    bool remove(std::string_view name) {
+        size_t slot = mShape ? mShape->find(JsonKey(name)) : 0;
+        if (slot >= mValues.size())
+            return false;
+        changed();
+
+        // shapes only grow, so the other members are added again
+        struct Member {
+            std::string                 name;
+            const JsonSymbol*           symbol;
+            std::shared_ptr<JsonValue>  value;
+        };
+        std::vector<Member> rest;
+        rest.reserve(mValues.size() - 1);
+        for (size_t i = 0; i < mValues.size(); i++) {
+            const JsonKey& key = mShape->key(i);
+            if (i != slot)
+                rest.push_back(Member{ key.symbol ? std::string() : std::string(key.name), key.symbol, mValues[i] });
+        }
+        clear();
+        for (auto& it : rest)
+            addKey(it.symbol ? JsonKey(it.symbol) : JsonKey(it.name), it.value);
+        return true;
     }
 
 private:
-    std::unordered_map<std::string, std::shared_ptr<JsonValue>> mChildren;
+    friend bool operator ==(const JsonValue& lhs, const JsonValue& rhs);
+
+    const JsonValue* findKey(const JsonKey& key) const {
+        if (!mShape)
+            return nullptr;
+        size_t slot = mShape->find(key);
+        return slot < mValues.size() ? mValues[slot].get() : nullptr;
+    }
+
+    bool isPrivate() const {
+        return mShape && !mShape->table();
+    }
+
+    // names are copied rather than shared with rhs's symbols or private shape
+    void assign(const ValueObject& rhs) {
+        if (!mShape && rhs.mShape && rhs.mShape->table())
+            mShape = rhs.mShape->table()->root();
+        mValues.reserve(rhs.mValues.size());
+        for (size_t i = 0; i < rhs.mValues.size(); i++) {
+            const JsonKey& key = rhs.mShape->key(i);
+            addKey(JsonKey(key.name, key.hash), copyValue(*rhs.mValues[i]));
+        }
+    }
+
+    // a duplicate name replaces the value
+    void addKey(const JsonKey& key, const std::shared_ptr<JsonValue>& value) {
+        if (mShape) {
+            size_t slot = mShape->find(key);
+            if (slot < mValues.size()) {
+                releaseChild(*mValues[slot]);
+                adoptChild(*value);
+                mValues[slot] = adopt(mValues.get_allocator(), value);
+                return;
+            }
+            if (JsonShapeTable* table = mShape->table()) {
+                if (const JsonShape* next = table->transition(mShape, key)) {
+                    mShape = next;
+                    adoptChild(*value);
+                    mValues.push_back(adopt(mValues.get_allocator(), value));
+                    return;
+                }
+                makePrivate();
+            }
+        }
+
+        if (!mShape)
+            mShape = newShape();
+        const_cast<JsonShape*>(mShape)->append(ownKey(key));
+        adoptChild(*value);
+        mValues.push_back(adopt(mValues.get_allocator(), value));
+    }
+
+    // copies the names of a shared shape into a new private one
+    void makePrivate() {
+        JsonShape* shape = newShape();
+        for (size_t i = 0; i < mShape->size(); i++)
+            shape->append(ownKey(mShape->key(i)));
+        mShape = shape;
+    }
+
+    JsonShape* newShape() {
+        std::pmr::memory_resource* mr = mValues.get_allocator().resource();
+        return new (mr->allocate(sizeof(JsonShape), alignof(JsonShape))) JsonShape(mr);
+    }
+
+    // a name that isn't a symbol is copied
+    JsonKey ownKey(const JsonKey& key) {
+        JsonKey owned = key;
+        if (!key.symbol) {
+            std::pmr::memory_resource* mr = mValues.get_allocator().resource();
+            char* p = static_cast<char*>(mr->allocate(key.name.length() + 1, 1));
+            memcpy(p, key.name.data(), key.name.length());
+            owned.name = std::string_view(p, key.name.length());
+        }
+        return owned;
+    }
+
+    void clear() {
+        if (isPrivate()) {
+            std::pmr::memory_resource* mr = mValues.get_allocator().resource();
+            JsonShape* shape = const_cast<JsonShape*>(mShape);
+            for (size_t i = 0; i < shape->size(); i++) {
+                const JsonKey& key = shape->key(i);
+                if (!key.symbol)
+                    mr->deallocate(const_cast<char*>(key.name.data()), key.name.length() + 1, 1);
+            }
+            shape->~JsonShape();
+            mr->deallocate(shape, sizeof(JsonShape), alignof(JsonShape));
+            mShape = nullptr;
+        } else if (mShape) {
+            mShape = mShape->table()->root();
+        }
+        for (auto& it : mValues)
+            releaseChild(*it);
+        mValues.clear();
+    }
+
+private:
+    const JsonShape*                                mShape;
+    std::pmr::vector<std::shared_ptr<JsonValue>>    mValues;
+    mutable std::atomic<uint64_t>                   mHash;
+    mutable std::atomic<uint64_t>                   mHashEpoch;     // when mHash was cached; 0 if it isn't
 };
 
 struct ValueArray : public JsonValue {
-    ValueArray() : JsonValue(vtArray) {
+    ValueArray() : JsonValue(vtArray), mHash(0), mHashEpoch(0) {
+    }
+
+    explicit ValueArray(std::pmr::memory_resource* mr) : JsonValue(vtArray), mChildren(mr), mHash(0), mHashEpoch(0) {
+    }
+
+    // elements are deep copies, like the members of a copied ValueObject
+    ValueArray(const ValueArray& rhs) : JsonValue(rhs), mHash(0), mHashEpoch(0) {
+        assign(rhs);
+    }
+
+    ValueArray& operator =(const ValueArray& rhs) {
+        if (this != &rhs) {
+            JsonValue::operator =(rhs);
+            clear();
+            assign(rhs);
+        }
+        return *this;
+    }
+
+    ~ValueArray() {
+        clear();
     }
 
     int size() const override {
@@ -438,42 +978,41 @@ struct ValueArray : public JsonValue {
         return !mChildren.empty();
     }
 
-    std::string toStringIndent(int indentation) const override {
-        std::string res;
-        std::string spaces1(indentation, ' ');
-        std::string spaces2(indentation + 2, ' ');
-
-        res += "[\n";
-
-        int cnt = 0;
-        for (auto& it : mChildren) {
-            if (cnt++ > 0)
-                res += ",\n";
-            res += spaces2;
-            res += it->toStringIndent(indentation + 2);
-        }
-        res += "\n";
-        res += spaces1;
-        res += "]";
+    void write(JsonWriter& writer) const override {
+        writer.startArray();
+        for (auto& it : mChildren)
+            it->write(writer);
+        writer.endArray();
+    }
 
+    uint64_t hash() const override {
+        uint64_t res;
+        if (cachedHash(res))
+            return res;
+        uint64_t epoch = hashing::currentEpoch();
+        res = hashing::mix(vtArray);
+        for (auto& it : mChildren)
+            res = hashing::combine(res, it->hash());
+        mHash.store(res, std::memory_order_relaxed);
+        mHashEpoch.store(epoch, std::memory_order_release);
         return res;
     }
 
-    std::string toCompactString() const override {
-        std::string res;
-
-        res += "[";
-
-        int cnt = 0;
-        for (auto& it : mChildren) {
-            if (cnt++ > 0)
-                res += ",";
-            res += it->toCompactString();
-        }
-
-        res += "]";
+    // true, with the hash, when it is known without visiting the elements
+    bool cachedHash(uint64_t& res) const {
+        if (mHashEpoch.load(std::memory_order_acquire) != hashing::currentEpoch())
+            return false;
+        res = mHash.load(std::memory_order_relaxed);
+        return true;
+    }
 
-        return res;
+    // false when no hash was cached
+    bool forgetHash() {
+        uint64_t epoch = mHashEpoch.load(std::memory_order_relaxed);
+        if (epoch == 0 || epoch != hashing::currentEpoch())
+            return false;
+        mHashEpoch.store(0, std::memory_order_relaxed);
+        return true;
     }
 
     template <typename Function>
@@ -490,53 +1029,162 @@ struct ValueArray : public JsonValue {
         }
     }
 
+    void reserve(size_t n) {
+        mChildren.reserve(n);
+    }
+
     JsonValue& add(std::shared_ptr<JsonValue> value) {
-        mChildren.push_back(value);
+        changed();
+        adoptChild(*value);
+        mChildren.push_back(adopt(mChildren.get_allocator(), value));
+        return *value;
+    }
+
+    // index may be size() to append
+    JsonValue& insert(int index, std::shared_ptr<JsonValue> value) {
+        if (index < 0 || index > size())
+            throw std::invalid_argument("index out of range");
+        changed();
+        adoptChild(*value);
+        mChildren.insert(mChildren.begin() + index, adopt(mChildren.get_allocator(), value));
+        return *value;
+    }
+
+    JsonValue& set(int index, std::shared_ptr<JsonValue> value) {
+        if (index < 0 || index >= size())
+            throw std::invalid_argument("index out of range");
+        changed();
+        releaseChild(*mChildren[index]);
+        adoptChild(*value);
+        mChildren[index] = adopt(mChildren.get_allocator(), value);
+        return *value;
+    }
+
+    void remove(int index) {
+        if (index < 0 || index >= size())
+            throw std::invalid_argument("index out of range");
+        changed();
+        releaseChild(*mChildren[index]);
+        mChildren.erase(mChildren.begin() + index);
+    }
+
+    template <typename T>
+    T& add(std::shared_ptr<T> value) {
+        add(std::static_pointer_cast<JsonValue>(value));
         return *value;
     }
 
     template <typename T>
     T& add(const T& value) {
         auto p = std::make_shared<T>(value);
-        mChildren.push_back(p);
-        return dynamic_cast<T&>(*p);
+        add(std::static_pointer_cast<JsonValue>(p));
+        return *p;
     }
 
 private:
-    std::vector<std::shared_ptr<JsonValue>> mChildren;
+    friend bool operator ==(const JsonValue& lhs, const JsonValue& rhs);
+
+    void assign(const ValueArray& rhs) {
+        mChildren.reserve(rhs.mChildren.size());
+        for (auto& it : rhs.mChildren) {
+            auto child = copyValue(*it);
+            adoptChild(*child);
+            mChildren.push_back(adopt(mChildren.get_allocator(), child));
+        }
+    }
+
+    void clear() {
+        for (auto& it : mChildren)
+            releaseChild(*it);
+        mChildren.clear();
+    }
+
+    std::pmr::vector<std::shared_ptr<JsonValue>>    mChildren;
+    mutable std::atomic<uint64_t>                   mHash;
+    mutable std::atomic<uint64_t>                   mHashEpoch;     // when mHash was cached; 0 if it isn't
 };
 
+inline std::shared_ptr<JsonValue> copyValue(const JsonValue& value) {
+    switch (value.type()) {
+    case vtNull:
+        return std::make_shared<ValueNull>();
+    case vtFalse:
+        return std::make_shared<ValueFalse>();
+    case vtTrue:
+        return std::make_shared<ValueTrue>();
+    case vtNumber:
+        return std::make_shared<ValueNumber>(static_cast<const ValueNumber&>(value));
+    case vtString:
+    {
+        std::string_view s = value.toStringView();
+        return std::make_shared<ValueString>(s.data(), s.length(), std::pmr::get_default_resource());
+    }
+    case vtObject:
+        return std::make_shared<ValueObject>(static_cast<const ValueObject&>(value));
+    default:
+        return std::make_shared<ValueArray>(static_cast<const ValueArray&>(value));
+    }
+}
+
+inline void JsonValue::changed() {
+    JsonValue* value = (mType == vtObject || mType == vtArray) ? this : mParent;
+    while (value) {
+        if (value == sharedParent()) {
+            hashing::invalidate();
+            return;
+        }
+        bool cached = value->mType == vtObject ? static_cast<ValueObject*>(value)->forgetHash()
+                                               : static_cast<ValueArray*>(value)->forgetHash();
+        if (!cached)
+            return;
+        value = value->mParent;
+    }
+}
+
+// containers with cached hashes that differ are unequal without being visited
 inline bool operator ==(const JsonValue& lhs, const JsonValue& rhs) {
-    if (lhs.isNull())
-        return rhs.isNull();
-    else if (lhs.isTrue())
-        return rhs.isTrue();
-    else if (lhs.isFalse())
-        return rhs.isFalse();
-    else if (lhs.isNumber())
-        return rhs.isNumber() && lhs.toString() == rhs.toString();
-    else if (lhs.isString())
-        return rhs.isString() && lhs.toString() == rhs.toString();
-    else if (lhs.isObject()) {
-        if (rhs.isObject()) {
-            bool ok = true;
-            dynamic_cast<const ValueObject&>(lhs).forEach([&rhs, &ok](const std::string& name, const JsonValue& value) {
-                if (!(value == rhs.get(name)))
-                    ok = false;
-            });
-            return ok;
+    if (&lhs == &rhs)
+        return true;
+
+    switch (lhs.type()) {
+    case vtNumber:
+        return rhs.isNumber() && static_cast<const ValueNumber&>(lhs).value().equals(static_cast<const ValueNumber&>(rhs).value());
+    case vtString:
+        return rhs.isString() && lhs.toStringView() == rhs.toStringView();
+    case vtObject:
+    {
+        if (!rhs.isObject() || lhs.size() != rhs.size())
+            return false;
+        const ValueObject& l = static_cast<const ValueObject&>(lhs);
+        const ValueObject& r = static_cast<const ValueObject&>(rhs);
+        uint64_t lh, rh;
+        if (l.cachedHash(lh) && r.cachedHash(rh) && lh != rh)
+            return false;
+        for (size_t i = 0; i < l.mValues.size(); i++) {
+            const JsonValue* found = r.findKey(l.mShape->key(i));
+            if (!found || !(*l.mValues[i] == *found))
+                return false;
         }
-    } else if (lhs.isArray()) {
-        if (rhs.isArray()) {
-            bool ok = true;
-            dynamic_cast<const ValueArray&>(lhs).forEach([&rhs, &ok](int idx, const JsonValue& value) {
-                if (!(value == rhs.get(idx)))
-                    ok = false;
-            });
-            return ok;
+        return true;
+    }
+    case vtArray:
+    {
+        if (!rhs.isArray() || lhs.size() != rhs.size())
+            return false;
+        const ValueArray& l = static_cast<const ValueArray&>(lhs);
+        const ValueArray& r = static_cast<const ValueArray&>(rhs);
+        uint64_t lh, rh;
+        if (l.cachedHash(lh) && r.cachedHash(rh) && lh != rh)
+            return false;
+        for (size_t i = 0; i < l.mChildren.size(); i++) {
+            if (!(*l.mChildren[i] == *r.mChildren[i]))
+                return false;
         }
+        return true;
+    }
+    default:
+        return lhs.type() == rhs.type();
     }
-    return false;
 }
 
 inline bool operator !=(const JsonValue& lhs, const JsonValue& rhs) {
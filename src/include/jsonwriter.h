@@ -0,0 +1,366 @@
+#pragma once
+
+#include <cerrno>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "jsonnumber.h"
+#include "jsonscan.h"
+#include "jsonstats.h"
+
+namespace youngJSON {
+
+// destination of the chunks a JsonWriter flushes
+class JsonSink {
+public:
+    virtual ~JsonSink() {
+    }
+
+    virtual void write(const char* data, size_t length) = 0;
+
+    virtual void flush() {
+    }
+};
+
+class StreamSink : public JsonSink {
+public:
+    explicit StreamSink(std::ostream& os) : mStream(os) {
+    }
+
+    void write(const char* data, size_t length) override {
+        mStream.write(data, static_cast<std::streamsize>(length));
+    }
+
+    void flush() override {
+        mStream.flush();
+    }
+
+private:
+    std::ostream&   mStream;
+};
+
+// writes to a file descriptor; the descriptor is not closed
+class FileSink : public JsonSink {
+public:
+    explicit FileSink(int fd) : mFd(fd) {
+    }
+
+    void write(const char* data, size_t length) override {
+        while (length > 0) {
+#ifdef _WIN32
+            int n = ::_write(mFd, data, static_cast<unsigned int>(length));
+#else
+            ssize_t n = ::write(mFd, data, length);
+#endif
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                throw std::system_error(errno, std::generic_category(), "write failed");
+            }
+            data += n;
+            length -= static_cast<size_t>(n);
+        }
+    }
+
+private:
+    int mFd;
+};
+
+
+// Appends JSON text to one buffer. Writing into a std::string grows the string itself;
+// writing into a sink reuses a single chunk of bufferSize bytes that is flushed when full.
+// indentWidth 0 writes compact JSON.
+class JsonWriter {
+public:
+    static const size_t DEFAULT_BUFFER_SIZE = 64 * 1024;
+
+    explicit JsonWriter(std::string& out, int indentWidth = 0)
+        : mOut(&out), mSink(nullptr), mBufferSize(0),
+          mIndentWidth(indentWidth), mBaseIndent(0), mAfterKey(false), mTopLevelCount(0) {
+    }
+
+    explicit JsonWriter(JsonSink& sink, int indentWidth = 0, size_t bufferSize = DEFAULT_BUFFER_SIZE)
+        : mOut(&mBuffer), mSink(&sink), mBufferSize(bufferSize),
+          mIndentWidth(indentWidth), mBaseIndent(0), mAfterKey(false), mTopLevelCount(0) {
+        mBuffer.reserve(bufferSize + number::MAX_NUMBER_LENGTH);
+    }
+
+    ~JsonWriter() {
+        try {
+            flush();
+        } catch (...) {
+        }
+    }
+
+    JsonWriter(const JsonWriter&) = delete;
+    JsonWriter& operator =(const JsonWriter&) = delete;
+
+    void setIndentWidth(int width) {
+        mIndentWidth = width;
+    }
+
+    int indentWidth() const {
+        return mIndentWidth;
+    }
+
+    // indentation of the first level, for values written inside other text
+    void setBaseIndent(int indentation) {
+        mBaseIndent = indentation;
+    }
+
+#ifdef YOUNGJSON_STATS
+    // statistics of the last top-level value
+    const JsonStats& stats() const {
+        return mStats;
+    }
+
+    // called after every top-level value with its statistics
+    void setStatsObserver(JsonStatsObserver observer) {
+        mStatsObserver = std::move(observer);
+    }
+#else
+    // all zero, since statistics are compiled out
+    const JsonStats& stats() const {
+        return JsonStats::none();
+    }
+
+    template <typename Observer>
+    void setStatsObserver(Observer&&) {
+        static_assert(sizeof(Observer) == 0, "statistics are compiled out; define YOUNGJSON_STATS");
+    }
+#endif
+
+    void null() {
+        beginValue();
+        countNode(vtNull);
+        mOut->append("null", 4);
+        endValue();
+    }
+
+    void boolean(bool value) {
+        beginValue();
+        countNode(value ? vtTrue : vtFalse);
+        if (value)
+            mOut->append("true", 4);
+        else
+            mOut->append("false", 5);
+        endValue();
+    }
+
+    void number(const JsonNumber& value) {
+        beginValue();
+        countNode(vtNumber);
+        char buf[number::MAX_NUMBER_LENGTH];
+        mOut->append(buf, writeNumber(buf, value) - buf);
+        endValue();
+    }
+
+    // as a JsonReader::parse handler, numbers are copied from the input unchanged
+    void number(const JsonNumber& value, std::string_view lexeme) {
+        rawNumber(lexeme);
+    }
+
+    // a number lexeme that is already valid JSON
+    void rawNumber(std::string_view lexeme) {
+        beginValue();
+        countNode(vtNumber);
+        mOut->append(lexeme.data(), lexeme.length());
+        endValue();
+    }
+
+    void string(std::string_view value) {
+        beginValue();
+        countNode(vtString);
+        appendString(value);
+        endValue();
+    }
+
+    void key(std::string_view name) {
+        Level& level = mStack.back();
+        if (level.count++ > 0)
+            *mOut += ',';
+        newLine(mStack.size());
+        appendString(name);
+        if (mIndentWidth > 0)
+            mOut->append(": ", 2);
+        else
+            *mOut += ':';
+        mAfterKey = true;
+#ifdef YOUNGJSON_STATS
+        mStats.keys++;
+#endif
+    }
+
+    void startObject() {
+        beginValue();
+        *mOut += '{';
+        mStack.push_back(Level{ 0 });
+        countNode(vtObject);
+    }
+
+    void endObject() {
+        endContainer('}');
+    }
+
+    void startArray() {
+        beginValue();
+        *mOut += '[';
+        mStack.push_back(Level{ 0 });
+        countNode(vtArray);
+    }
+
+    void endArray() {
+        endContainer(']');
+    }
+
+    // passes the buffered text to the sink
+    void flush() {
+        if (!mSink)
+            return;
+        if (!mBuffer.empty())
+            flushBuffer();
+        mSink->flush();
+    }
+
+private:
+    struct Level {
+        size_t  count;
+    };
+
+    void beginValue() {
+        if (mAfterKey) {
+            mAfterKey = false;
+            return;
+        }
+        if (mStack.empty()) {
+            // top-level values are separated by new lines
+            if (mTopLevelCount++ > 0)
+                *mOut += '\n';
+#ifdef YOUNGJSON_STATS
+            mStats.clear();
+            mStatsOffset = mFlushed + mOut->length();
+            mStatsStart = JsonStats::now();
+#endif
+            return;
+        }
+        if (mStack.back().count++ > 0)
+            *mOut += ',';
+        newLine(mStack.size());
+    }
+
+    void endValue() {
+#ifdef YOUNGJSON_STATS
+        if (mStack.empty()) {
+            mStats.bytes = mFlushed + mOut->length() - mStatsOffset;
+            mStats.ticks[spWrite] = JsonStats::now() - mStatsStart;
+            if (mStatsObserver)
+                mStatsObserver(mStats);
+        }
+#endif
+        if (mSink && mBuffer.length() >= mBufferSize)
+            flushBuffer();
+    }
+
+    void flushBuffer() {
+        mSink->write(mBuffer.data(), mBuffer.length());
+#ifdef YOUNGJSON_STATS
+        mFlushed += mBuffer.length();
+#endif
+        mBuffer.clear();
+    }
+
+    void countNode(ValueTypeT type) {
+#ifdef YOUNGJSON_STATS
+        mStats.nodes[type]++;
+        if (mStack.size() > mStats.maxDepth)
+            mStats.maxDepth = mStack.size();
+#endif
+    }
+
+    void endContainer(char bracket) {
+        bool empty = (mStack.back().count == 0);
+        mStack.pop_back();
+        if (!empty)
+            newLine(mStack.size());
+        *mOut += bracket;
+        endValue();
+    }
+
+    void newLine(size_t depth) {
+        if (mIndentWidth <= 0)
+            return;
+        *mOut += '\n';
+        mOut->append(mBaseIndent + depth * mIndentWidth, ' ');
+    }
+
+    void appendString(std::string_view s) {
+        static const char hex[] = "0123456789abcdef";
+
+        *mOut += '\"';
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(s.data());
+        const unsigned char* pEnd = p + s.length();
+        while (p < pEnd) {
+            const unsigned char* run = findStringSpecial(p, pEnd);
+            mOut->append(reinterpret_cast<const char*>(p), run - p);
+            if (run == pEnd)
+                break;
+
+            char esc[6] = { '\\', 0, 0, 0, 0, 0 };
+            size_t len = 2;
+            switch (*run) {
+            case '\"': esc[1] = '\"'; break;
+            case '\\': esc[1] = '\\'; break;
+            case '\b': esc[1] = 'b'; break;
+            case '\f': esc[1] = 'f'; break;
+            case '\n': esc[1] = 'n'; break;
+            case '\r': esc[1] = 'r'; break;
+            case '\t': esc[1] = 't'; break;
+            default:
+                esc[1] = 'u';
+                esc[2] = '0';
+                esc[3] = '0';
+                esc[4] = hex[*run >> 4];
+                esc[5] = hex[*run & 0x0F];
+                len = 6;
+                break;
+            }
+            mOut->append(esc, len);
+            p = run + 1;
+#ifdef YOUNGJSON_STATS
+            mStats.escapes++;
+#endif
+        }
+        *mOut += '\"';
+    }
+
+private:
+    std::string*        mOut;
+    std::string         mBuffer;
+    JsonSink*           mSink;
+    size_t              mBufferSize;
+
+    int                 mIndentWidth;
+    int                 mBaseIndent;
+    bool                mAfterKey;
+    size_t              mTopLevelCount;
+    std::vector<Level>  mStack;
+
+#ifdef YOUNGJSON_STATS
+    JsonStats           mStats;
+    JsonStatsObserver   mStatsObserver;
+    size_t              mFlushed = 0;       // bytes passed to the sink
+    size_t              mStatsOffset = 0;
+    uint64_t            mStatsStart = 0;
+#endif
+};
+
+}
@@ -1,7 +1,24 @@
 #include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <thread>
 
+#include "../src/include/jsonbind.h"
+#include "../src/include/jsonlazy.h"
+#include "../src/include/jsonlines.h"
+#include "../src/include/jsonparallel.h"
 #include "../src/include/jsonparser.h"
+#include "../src/include/jsonpatch.h"
+#include "../src/include/jsonpath.h"
+#include "../src/include/jsonpattern.h"
+#include "../src/include/jsonpushparser.h"
+#include "../src/include/jsonschema.h"
+#include "../src/include/jsonsnapshot.h"
 
 using namespace std;
 using namespace youngJSON;
@@ -84,6 +101,1371 @@ const string gTestInput[] = {
 }}"
 };
 
+void testDocument() {
+    JsonReader reader;
+    JsonDocument doc;
+
+    for (auto& s : gTestInput) {
+        auto value = reader.read(s);
+        reader.read(s, doc);
+        assert(*value == doc.root());
+    }
+
+    reader.read(gTestInput[1], doc);
+    assert(doc["widget"]["window"]["width"].toInt64() == 500);
+    assert(doc["widget"]["text"]["data"].toRawString() == "Click Here");
+
+    auto& window = dynamic_cast<ValueObject&>(doc["widget"]["window"]);
+    window.add("visible", ValueTrue());
+    window.add("owner", doc.create<ValueString>("arena", 5));
+    assert(doc["widget"]["window"]["visible"].toBool());
+    assert(doc["widget"]["window"]["owner"].toRawString() == "arena");
+
+    // copies of arena containers are deep, so they outlive the document
+    const string src = R"({"list": [{"name": "a long string that is not inlined"}, [1, 2]], "obj": {"k": [true]}})";
+    auto shapes = make_shared<JsonShapeTable>();
+    ValueArray list;
+    ValueObject obj;
+    {
+        JsonReader shared;
+        shared.setSymbolTable(make_shared<JsonSymbolTable>());
+        shared.setShapeTable(shapes);
+        JsonDocument temp;
+        shared.read(src, temp);
+        list = static_cast<ValueArray&>(temp["list"]);
+        ValueObject copy(static_cast<ValueObject&>(temp["obj"]));
+        obj = copy;
+    }
+    assert(list.toCompactString() == R"([{"name":"a long string that is not inlined"},[1,2]])");
+    assert(obj.toCompactString() == R"({"k":[true]})" && obj.shape()->table() == shapes.get());
+
+    JsonDocument moved(std::move(doc));
+    const JsonDocument& empty = doc;
+    assert(empty.empty() && empty.arena().usedBytes() == 0 && moved.arena().usedBytes() > 0);
+}
+
+void testCompact() {
+    JsonReader reader;
+    CompactDocument doc;
+
+    for (auto& s : gTestInput) {
+        reader.read(s, doc);
+        auto value = reader.read(s);
+        auto value2 = reader.read(doc.root().toCompactString());
+        assert(*value == *value2);
+    }
+
+    reader.read(gTestInput[2], doc);
+    assert(doc["menu"]["items"].size() == 22);
+    assert(doc["menu"]["items"][1]["label"].toRawString() == "Open New");
+    assert(doc["menu"]["items"][2].isNull());
+
+    reader.read(string("[-1, 18446744073709551615, 2.5e3, \"not short enough to be inline\"]"), doc);
+    assert(doc[0].toInt64() == -1);
+    assert(doc[1].toUInt64() == 18446744073709551615ull);
+    assert(doc[2].toDouble() == 2500.0);
+    assert(doc[3].toStringView() == "not short enough to be inline");
+
+    // a moved-from document is empty and can be read into again
+    CompactDocument moved(std::move(doc));
+    assert(moved[3].toStringView() == "not short enough to be inline");
+    assert(static_cast<const CompactDocument&>(doc).arena().usedBytes() == 0);
+    doc.clear();
+    reader.read(string("[true]"), doc);
+    assert(doc[0].isTrue() && moved[1].toUInt64() == 18446744073709551615ull);
+    doc = std::move(moved);
+    assert(doc.root().size() == 4);
+
+    // a duplicate name keeps its first place and its last value, as in the DOM
+    string large = "{";
+    for (int i = 0; i < 40; i++)
+        large += "\"k" + to_string(i % 30) + "\": " + to_string(i) + ", ";
+    large += "\"a long name that is not inlined\": 1, \"a long name that is not inlined\": 2}";
+    for (const string& src : { string(R"({"a": 1, "b": 2, "a": [3], "c": 4, "b": 5})"), large }) {
+        reader.read(src, doc);
+        auto value = reader.read(src);
+        assert(doc.root().size() == value->size());
+        assert(doc.root().toCompactString() == value->toCompactString());
+    }
+    assert(doc["k5"].toInt32() == 35 && doc["a long name that is not inlined"].toInt32() == 2);
+}
+
+void testStructuralIndex() {
+    string s = "{\"list\": [";
+    for (int i = 0; i < 200; i++) {
+        if (i > 0)
+            s += ", ";
+        s += "{\"id\": " + to_string(i) + ", \"text\": \"" + string(i % 7, '\\') + string(i % 7 % 2, '\\') + "\\\" {[,:]}\"}";
+    }
+    s += "], \"end\": true}";
+
+    StructuralIndex scalar;
+    assert(scalar.build((const unsigned char*)s.data(), s.length(), siScalar));
+    for (auto impl : { siSSE2, siAVX2 }) {
+        if (!StructuralIndex::isSupported(impl))
+            continue;
+        StructuralIndex index;
+        assert(index.build((const unsigned char*)s.data(), s.length(), impl));
+        assert(index.size() == scalar.size());
+        assert(memcmp(index.data(), scalar.data(), scalar.size() * sizeof(uint32_t)) == 0);
+    }
+
+    JsonReader reader;
+    JsonReader reader2;
+    reader2.setStructuralIndex(false);
+    auto value = reader.read(s);
+    auto value2 = reader2.read(s);
+    assert(*value == *value2);
+    assert((*value)["list"].size() == 200);
+    assert((*value)["end"].isTrue());
+
+    for (const char* bad : { "[1x]", "{\"a\": \"unclosed}", "[1 2]", "{\"a\"  1}" }) {
+        bool failed = false;
+        try {
+            reader.read(string(bad));
+        } catch (invalid_format_error&) {
+            failed = true;
+        }
+        assert(failed);
+    }
+}
+
+void testString() {
+    JsonReader reader;
+
+    string text(1000, 'x');
+    auto value = reader.read("[\"" + text + "\", \"" + text + "\\n" + text + "\"]");
+    assert((*value)[0].toRawString() == text);
+    assert((*value)[1].toRawString() == text + "\n" + text);
+
+    value = reader.read(string("\"\\ud83d\\ude00 \\u00e9\\t\\\"\\/\""));
+    assert(value->toRawString() == "\xF0\x9F\x98\x80 \xC3\xA9\t\"/");
+
+    value = reader.read(string("\"\\ud83d-\\ude00\""));
+    assert(value->toRawString() == "\xEF\xBF\xBD-\xEF\xBF\xBD");
+
+    for (const char* bad : { "\"tab\tinside\"", "\"\\u12\"", "\"abc\\" }) {
+        bool failed = false;
+        try {
+            reader.read(string(bad));
+        } catch (invalid_format_error&) {
+            failed = true;
+        }
+        assert(failed);
+    }
+}
+
+void testBorrowedStrings() {
+    string src = "{\"name\": \"a string that is long enough not to be inline\", \"escaped\": \"line1\\nline2 is long enough too\"}";
+    auto inSource = [&src](string_view s) {
+        return s.data() >= src.data() && s.data() < src.data() + src.length();
+    };
+
+    JsonReader reader;
+    reader.setStringMode(smBorrow);
+
+    JsonDocument doc;
+    reader.read(src, doc);
+    assert(inSource(doc["name"].toStringView()));
+    assert(!inSource(doc["escaped"].toStringView()));
+    assert(doc["escaped"].toStringView() == "line1\nline2 is long enough too");
+
+    CompactDocument cdoc;
+    reader.read(src, cdoc);
+    assert(inSource(cdoc["name"].toStringView()));
+    assert(cdoc["escaped"].toStringView() == "line1\nline2 is long enough too");
+
+    JsonReader reader2;
+    reader2.readInSitu(&src[0], (int)src.length(), cdoc);
+    assert(inSource(cdoc["name"].toStringView()));
+    assert(inSource(cdoc["escaped"].toStringView()));
+    assert(cdoc["escaped"].toStringView() == "line1\nline2 is long enough too");
+}
+
+void testNumber() {
+    JsonReader reader;
+
+    auto value = reader.read(string("[0, -12, 18446744073709551615, 3.1e3, 0.1, -2.5E-3, 123456789012345678901234567890]"));
+    assert((*value)[0].toInt64() == 0 && !(*value)[0].toBool());
+    assert((*value)[1].toInt64() == -12 && (*value)[1].toBool());
+    assert((*value)[2].toUInt64() == 18446744073709551615ull);
+    assert((*value)[3].toDouble() == 3100.0 && (*value)[3].toInt32() == 3100);
+    assert((*value)[4].toDouble() == 0.1);
+    assert((*value)[5].toDouble() == -2.5e-3);
+    assert((*value)[6].toDouble() == 1.2345678901234568e29);
+    assert(dynamic_cast<const ValueNumber&>((*value)[1]).numberKind() == nkInt64);
+    assert(dynamic_cast<const ValueNumber&>((*value)[2]).numberKind() == nkUInt64);
+    assert(dynamic_cast<const ValueNumber&>((*value)[3]).numberKind() == nkDouble);
+
+    reader.setKeepNumberLexeme(true);
+    value = reader.read(string("[123456789012345678901234567890, 1.50]"));
+    assert((*value)[0].toString() == "123456789012345678901234567890");
+    assert((*value)[1].toString() == "1.50");
+
+    for (const char* bad : { "1-2e+.", "[01]", "[1.]", "[-]", "[.5]", "[1e]", "[+1]" }) {
+        bool failed = false;
+        try {
+            reader.read(string(bad));
+        } catch (invalid_format_error&) {
+            failed = true;
+        }
+        assert(failed);
+    }
+}
+
+void testNumberFormat() {
+    assert(ValueNumber(3.1e3).toString() == "3100.0");
+    assert(ValueNumber(0.1).toString() == "0.1");
+    assert(ValueNumber(-2.5e-3).toString() == "-0.0025");
+    assert(ValueNumber(1e-7).toString() == "1e-7");
+    assert(ValueNumber(1.2345678901234568e29).toString() == "1.2345678901234568e29");
+    assert(ValueNumber(5e-324).toString() == "5e-324");
+    assert(ValueNumber(1.7976931348623157e308).toString() == "1.7976931348623157e308");
+    assert(ValueNumber(-0.0).toString() == "-0.0");
+    assert(ValueNumber(-9223372036854775807ll - 1).toString() == "-9223372036854775808");
+    assert(ValueNumber(18446744073709551615ull).toString() == "18446744073709551615");
+
+    // every written double reads back to the same bits
+    JsonReader reader;
+    unsigned long long bits = 0x123456789abcdefull;
+    for (int i = 0; i < 10000; i++) {
+        bits = bits * 6364136223846793005ull + 1442695040888963407ull;
+        double d;
+        memcpy(&d, &bits, sizeof(d));
+        if (std::isnan(d) || std::isinf(d))
+            continue;
+        double r = reader.read(ValueNumber(d).toString())->toDouble();
+        assert(memcmp(&d, &r, sizeof(d)) == 0);
+    }
+}
+
+void testWriter() {
+    JsonReader reader;
+    auto value = reader.read(string("{\"a\": [1, 2.5, \"x\\\"y\\\\z\\n\\u0001\"], \"b\": {}, \"c\": []}"));
+
+    string out;
+    {
+        JsonWriter writer(out);
+        value->get("a").write(writer);
+    }
+    assert(out == "[1,2.5,\"x\\\"y\\\\z\\n\\u0001\"]");
+    assert(*reader.read(out) == value->get("a"));
+
+    out.clear();
+    {
+        JsonWriter writer(out, 4);
+        writer.startObject();
+        writer.key("k");
+        writer.startArray();
+        writer.number(JsonNumber());
+        writer.null();
+        writer.endArray();
+        writer.key("e");
+        writer.startObject();
+        writer.endObject();
+        writer.endObject();
+    }
+    assert(out == "{\n    \"k\": [\n        0,\n        null\n    ],\n    \"e\": {}\n}");
+
+    // small chunks are flushed to the sink while writing
+    ValueArray arr;
+    for (int i = 0; i < 1000; i++)
+        arr.add(ValueString("item"));
+    ostringstream os;
+    StreamSink sink(os);
+    {
+        JsonWriter writer(sink, 0, 64);
+        arr.write(writer);
+        assert(os.str().length() > 0);
+        writer.flush();
+    }
+    assert(os.str() == arr.toCompactString());
+    assert(reader.read(os.str())->size() == 1000);
+}
+
+struct CountingHandler {
+    int values = 0;
+    int depth = 0;
+    int maxDepth = 0;
+    long long sum = 0;
+    std::string lastKey;
+
+    void null() { values++; }
+    void boolean(bool) { values++; }
+    void number(const JsonNumber& value, string_view) { values++; sum += value.toInt64(); }
+    void string(string_view) { values++; }
+    void key(string_view name) { lastKey.assign(name.data(), name.length()); }
+    void startObject() { maxDepth = max(maxDepth, ++depth); }
+    void endObject() { depth--; }
+    void startArray() { maxDepth = max(maxDepth, ++depth); }
+    void endArray() { depth--; }
+};
+
+// stops at the first key named "stop"
+struct StoppingHandler {
+    int keys = 0;
+
+    bool null() { return true; }
+    bool boolean(bool) { return true; }
+    bool number(const JsonNumber&, string_view) { return true; }
+    bool string(string_view) { return true; }
+    bool key(string_view name) { keys++; return name != "stop"; }
+    bool startObject() { return true; }
+    bool endObject() { return true; }
+    bool startArray() { return true; }
+    bool endArray() { return true; }
+};
+
+void testSax() {
+    JsonReader reader;
+    string src = "{\"a\": [1, 2, {\"b\": 3}], \"c\": \"x\\ty\", \"d\": null, \"e\": true}";
+
+    CountingHandler counter;
+    assert(reader.parse(src, counter));
+    assert(counter.values == 6 && counter.sum == 6 && counter.maxDepth == 3 && counter.depth == 0);
+    assert(counter.lastKey == "e");
+
+    StoppingHandler stopper;
+    assert(!reader.parse(string("{\"a\": 1, \"stop\": [], \"b\": 2}"), stopper));
+    assert(stopper.keys == 2);
+
+    // a writer is a handler : re-serializes without a tree
+    string out;
+    {
+        JsonWriter writer(out);
+        assert(reader.parse(src, writer));
+    }
+    assert(out == "{\"a\":[1,2,{\"b\":3}],\"c\":\"x\\ty\",\"d\":null,\"e\":true}");
+
+    bool failed = false;
+    try {
+        reader.parse(string("[1, 2"), counter);
+    } catch (invalid_format_error&) {
+        failed = true;
+    }
+    assert(failed);
+}
+
+void testPushParser() {
+    JsonReader reader;
+    string src = "{\"name\": \"ab\\\"c\\u00e9\\ud83d\\ude00\\ud800x\", \"list\": [1, -2.5e3, 12345678901234567890, true, false, null, {}, []], "
+                 "\"nested\": {\"k\": [\"\", \"long string without escapes\"]}}";
+    auto expected = reader.read(src);
+
+    // every split point, and one byte at a time
+    for (size_t chunk : { (size_t)1, (size_t)2, (size_t)3, (size_t)7, src.length() }) {
+        shared_ptr<JsonValue> result;
+        auto builder = ValueBuilder([&](shared_ptr<JsonValue> v) { result = v; });
+        JsonPushParser<decltype(builder)> parser(builder);
+        for (size_t i = 0; i < src.length(); i += chunk)
+            assert(parser.feed(src.data() + i, min(chunk, src.length() - i)));
+        parser.finish();
+        assert(parser.done() && result && *result == *expected);
+    }
+
+    // a stream of values with a number split at the end of a chunk
+    vector<long long> values;
+    auto builder = ValueBuilder([&](shared_ptr<JsonValue> v) { values.push_back(v->toInt64()); });
+    JsonPushParser<decltype(builder)> parser(builder);
+    parser.setMultipleValues(true);
+    parser.feed(string("1\n22\n3"));
+    parser.feed(string("33"));
+    assert(values.size() == 2);
+    parser.finish();
+    assert(values.size() == 3 && values[2] == 333 && parser.valueCount() == 3);
+
+    for (const char* bad : { "[1, 2", "[1,]", "{\"a\" 1}", "[tru]", "\"abc", "[1] 2", "[1}" }) {
+        CountingHandler counter;
+        JsonPushParser<CountingHandler> p(counter);
+        bool failed = false;
+        try {
+            p.feed(bad, strlen(bad));
+            p.finish();
+        } catch (invalid_format_error&) {
+            failed = true;
+        }
+        assert(failed);
+    }
+
+    StoppingHandler stopper;
+    JsonPushParser<StoppingHandler> stopping(stopper);
+    assert(!stopping.feed(string("{\"a\": 1, \"st")) || !stopping.feed(string("op\": 2, \"b\": 3}")));
+    assert(stopper.keys == 2);
+}
+
+void testJsonLines() {
+    string src;
+    for (int i = 0; i < 5000; i++) {
+        src += "{\"id\": " + to_string(i) + ", \"text\": \"line\\nbreak {[\\\"]}\"}";
+        src += (i % 3 == 0) ? "\r\n" : "\n";
+        if (i % 100 == 0)
+            src += "  \n";
+    }
+
+    JsonLinesParser parser(4, 1024);
+    size_t expected = 0;
+    size_t n = parser.parse(src.data(), src.length(), [&](size_t index, JsonDocument& doc) {
+        assert(index == expected++);
+        assert(doc["id"].toInt64() == (long long)index);
+        assert(doc["text"].toStringView() == "line\nbreak {[\"]}");
+    });
+    assert(n == 5000 && expected == 5000);
+
+    // compact documents from a stream read in small windows
+    parser.setWindowSize(4096);
+    istringstream is(src);
+    long long sum = 0;
+    n = parser.parse<CompactDocument>(is, [&](size_t index, CompactDocument& doc) {
+        sum += doc["id"].toInt64();
+    });
+    assert(n == 5000 && sum == 4999ll * 5000 / 2);
+
+    // stops when the callback returns false
+    n = parser.parse(src.data(), src.length(), [&](size_t index, JsonDocument&) {
+        return index < 99;
+    });
+    assert(n == 99);
+
+    // records before a bad one are delivered, then its error is thrown
+    string bad = src.substr(0, src.find("\"id\": 3000")) + "{\"id\": }\n" + src;
+    size_t delivered = 0;
+    bool failed = false;
+    try {
+        parser.parse(bad.data(), bad.length(), [&](size_t, JsonDocument&) {
+            delivered++;
+        });
+    } catch (invalid_format_error&) {
+        failed = true;
+    }
+    assert(failed && delivered == 3000);
+}
+
+void testParallelArray() {
+    string items = "[";
+    for (int i = 0; i < 3000; i++) {
+        if (i > 0)
+            items += ", ";
+        items += "{\"id\": " + to_string(i) + ", \"tags\": [\"a,b\", \"]\\\"[\"], \"n\": {\"x\": []}}";
+    }
+    items += "]";
+
+    JsonReader single;
+    auto expected = single.read(items);
+
+    ParallelArrayReader parallel(4);
+    auto value = parallel.read(items);
+    assert(*value == *expected && value->size() == 3000);
+    assert(value->get(2999)["tags"][1].toStringView() == "]\"[");
+
+    JsonDocument doc;
+    parallel.read(" " + items + "\n", doc);
+    assert(doc.root() == *expected);
+
+    // an array inside objects; the rest of the document is kept
+    string src = "{\"meta\": {\"items\": 1}, \"data\": {\"count\": 3000, \"items\": " + items + ", \"z\": null}}";
+    parallel.setArrayPath({ "data", "items" });
+    doc.clear();
+    parallel.read(src, doc);
+    assert(doc.root() == *single.read(src));
+    assert(doc["data"]["items"].size() == 3000 && doc["meta"]["items"].toInt32() == 1);
+
+    parallel.setArrayPath({});
+    assert(parallel.read("[]")->size() == 0);
+    assert(parallel.read(" [ 1 ] ")->get(0).toInt32() == 1);
+
+    const char* bad[] = { "[1,]", "[1,,2]", "[1, 2", "[1} ", "[1] 2", "{}", "[{\"a\": ]" };
+    for (auto s : bad) {
+        bool failed = false;
+        try {
+            parallel.read(s);
+        } catch (invalid_format_error&) {
+            failed = true;
+        }
+        assert(failed);
+    }
+
+    parallel.setArrayPath({ "missing" });
+    bool missing = false;
+    try {
+        parallel.read(src);
+    } catch (invalid_argument&) {
+        missing = true;
+    }
+    assert(missing);
+}
+
+void testReadFile() {
+    string path = (filesystem::temp_directory_path() / "youngjson_test.json").string();
+    string src = "{\"name\": \"a long string that is not inlined\", \"escaped\": \"a\\tb\", \"n\": [1, 2.5]}";
+    {
+        ofstream os(path, ios::binary);
+        os << src;
+    }
+
+    JsonReader reader;
+    auto value = reader.readFile(path);
+    assert(*value == *reader.read(src));
+
+    reader.setStringMode(smBorrow);
+    assert(reader.readFile(path)->get("name").toStringView() == "a long string that is not inlined");
+
+    JsonDocument doc;
+    reader.readFile(path, doc);
+    assert(doc["escaped"].toStringView() == "a\tb");
+
+    CompactDocument compact;
+    reader.readFile(path, compact);
+    assert(compact["name"].toStringView() == "a long string that is not inlined");
+    assert(compact["n"][1].toDouble() == 2.5);
+
+    {
+        ofstream os(path, ios::binary | ios::trunc);
+    }
+    bool failed = false;
+    try {
+        reader.readFile(path, doc);
+    } catch (invalid_format_error&) {
+        failed = true;
+    }
+    assert(failed && doc.empty());
+
+    // sparse, so nothing is written or read
+    filesystem::resize_file(path, static_cast<uintmax_t>(INT_MAX) + 1);
+    failed = false;
+    try {
+        reader.readFile(path, doc);
+    } catch (length_error&) {
+        failed = true;
+    } catch (system_error&) {
+        failed = sizeof(void*) < 8;     // a 32-bit process can't map it at all
+    }
+    assert(failed && doc.empty());
+    filesystem::remove(path);
+
+    failed = false;
+    try {
+        reader.readFile(path);
+    } catch (system_error&) {
+        failed = true;
+    }
+    assert(failed);
+}
+
+void testLazy() {
+    string src = "{\"skip\": [1, {\"a\": \"]}\"}, [[], {}]], \"id\": 12345678901, \"ratio\": -0.5e1 ,"
+                 " \"name\": \"caf\\u00e9\", \"k\\\"ey\": true, \"tags\": [\"x\", null, false], \"empty\": {}}";
+    LazyDocument doc;
+    doc.parse(src);
+
+    assert(doc["id"].toInt64() == 12345678901ll);
+    assert(doc["ratio"].toDouble() == -5.0);
+    assert(doc["name"].toStringView() == "caf\xC3\xA9");
+    assert(doc["k\"ey"].isTrue());
+    assert(doc["tags"].size() == 3 && doc["tags"][0].toRawString() == "x" && doc["tags"][1].isNull());
+    assert(doc["skip"][1]["a"].toStringView() == "]}");
+    assert(doc["skip"].rawJson() == "[1, {\"a\": \"]}\"}, [[], {}]]");
+    assert(doc["empty"].size() == 0 && doc["empty"].toCompactString() == "{}");
+    assert(doc.root().size() == 7);
+    assert(*doc.root().toValue() == *JsonReader().read(src));
+    assert(doc["tags"].toCompactString() == "[\"x\",null,false]");
+
+    int count = 0;
+    doc["tags"].forEach([&](int idx, const LazyValue& value) {
+        count++;
+    });
+    doc.root().forEach([&](string_view name, const LazyValue& value) {
+        if (name == "k\"ey")
+            count += 10;
+    });
+    assert(count == 13);
+
+    // a string with escapes is decoded once, also when threads read it together
+    string_view name = doc["name"].toStringView();
+    vector<thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 1000; i++)
+                assert(doc["name"].toStringView().data() == name.data() && doc["k\"ey"].isTrue());
+        });
+    }
+    for (auto& it : threads)
+        it.join();
+
+    bool missing = false;
+    try {
+        doc["nothing"];
+    } catch (invalid_argument&) {
+        missing = true;
+    }
+    assert(missing);
+
+    // a structural error is found by parse, an error inside a value when it is reached
+    const string bad[] = { "{\"a\": [1}", "[1] 2", "{\"a\": \"b}", "" };
+    for (auto& s : bad) {
+        bool failed = false;
+        try {
+            doc.parse(s);
+        } catch (invalid_format_error&) {
+            failed = true;
+        }
+        assert(failed);
+    }
+    string partial = "[1, tru, 1.2.3]";
+    doc.parse(partial);
+    assert(doc[0].toInt32() == 1);
+    int errors = 0;
+    for (int i = 1; i < 3; i++) {
+        try {
+            doc[i].toDouble();
+        } catch (invalid_format_error&) {
+            errors++;
+        }
+    }
+    assert(errors == 2);
+
+    // a duplicate name finds its last value, as in the DOM
+    string repeated = R"({"a": 1, "b": [2], "a": {"c": 3}})";
+    doc.parse(repeated);
+    assert(doc["a"]["c"].toInt32() == 3 && doc.root().size() == 3);
+}
+
+void testPath() {
+    string src = "{\"data\": [{\"id\": 1, \"tags\": [\"a\", \"b\"]}, {\"id\": 2, \"tags\": []}, {\"name\": 3}, {\"id\": {\"x\": [4]}}],"
+                 " \"a/b\": {\"m~n\": true}, \"meta\": {\"id\": 0}}";
+    JsonReader reader;
+    auto root = reader.read(src);
+
+    assert(JsonPath("").find(*root) == root.get());
+    assert(JsonPath("/data/1/id").find(*root)->toInt32() == 2);
+    assert(JsonPath("/a~1b/m~0n").find(*root)->isTrue());
+    assert(JsonPath("/data/01").find(*root) == nullptr);
+    assert(JsonPath("/data/9/id").find(*root) == nullptr);
+    assert(JsonPath("$.data[*].id").select(*root).size() == 3);
+    assert(JsonPath("$['data'][-1].id.x[0]").find(*root)->toInt32() == 4);
+    assert(JsonPath("$.data[1:].id").select(*root).size() == 2);
+    assert(JsonPath("$.data[::2].id").select(*root).size() == 1);
+    assert(JsonPath("$.data[0].tags[-2:]").select(*root).size() == 2);
+    assert(JsonPath("$.*.id").select(*root).size() == 1);
+
+    const char* bad[] = { "data", "/a~2", "$.", "$[", "$[1:2:0]", "$['a'", "$x", "$[a]" };
+    for (auto s : bad) {
+        bool failed = false;
+        try {
+            JsonPath path(s);
+        } catch (invalid_argument&) {
+            failed = true;
+        }
+        assert(failed);
+    }
+
+    // while parsing, only the matches are built
+    vector<string> found;
+    size_t n = JsonPath("/data/*/id").extract(reader, src, [&](shared_ptr<JsonValue> value) {
+        found.push_back(value->toCompactString());
+    });
+    assert(n == 3 && found[0] == "1" && found[1] == "2" && found[2] == "{\"x\":[4]}");
+
+    n = JsonPath("$.data[1:3].tags").extract(reader, src, [&](shared_ptr<JsonValue> value) {
+        assert(value->isArray() && value->size() == 0);
+    });
+    assert(n == 1);
+
+    n = JsonPath("").extract(reader, src, [&](shared_ptr<JsonValue> value) {
+        assert(*value == *root);
+    });
+    assert(n == 1);
+
+    bool failed = false;
+    try {
+        JsonPath("$.data[-1]").extract(reader, src, [](shared_ptr<JsonValue>) {});
+    } catch (invalid_argument&) {
+        failed = true;
+    }
+    assert(failed);
+}
+
+void testSymbols() {
+    auto table = make_shared<JsonSymbolTable>();
+    JsonReader reader;
+    reader.setSymbolTable(table);
+
+    string src = "{\"identifier_longer_than_inline\": 1, \"b\": [{\"identifier_longer_than_inline\": 2, \"b\": null}], \"e\\u0073c\": 3}";
+    vector<JsonDocument> docs(3);
+    for (auto& doc : docs)
+        reader.read(src, doc);
+    assert(table->size() == 3);
+
+    const JsonSymbol* name = table->find("identifier_longer_than_inline");
+    assert(name && table->intern("identifier_longer_than_inline") == name);
+    assert(table->find("missing") == nullptr);
+
+    auto& obj = dynamic_cast<const ValueObject&>(docs[2].root());
+    assert(obj.find(name)->toInt32() == 1);
+    assert(obj.find("esc")->toInt32() == 3);
+    assert(docs[1]["b"][0]["identifier_longer_than_inline"].toInt32() == 2);
+    assert(docs[0].root() == *JsonReader().read(src));
+
+    // a copy owns its names; interned and copied names compare equal
+    ValueObject copy = obj;
+    copy.add("identifier_longer_than_inline", ValueNumber(5));
+    assert(copy.size() == 3 && copy.find(name)->toInt32() == 5);
+
+    // the documents keep the table alive
+    weak_ptr<JsonSymbolTable> weak = table;
+    reader.setSymbolTable(nullptr);
+    table.reset();
+    assert(!weak.expired() && docs[0]["identifier_longer_than_inline"].toInt32() == 1);
+
+    CompactDocument compact;
+    reader.setSymbolTable(make_shared<JsonSymbolTable>());
+    reader.read(src, compact);
+    assert(compact["identifier_longer_than_inline"].toInt32() == 1);
+    reader.setSymbolTable(nullptr);
+    assert(compact["b"][0]["identifier_longer_than_inline"].toInt32() == 2);
+
+    // past its limits the table refuses names, which are then stored in the objects
+    auto bounded = make_shared<JsonSymbolTable>();
+    reader.setSymbolTable(bounded);
+    string many = "[";
+    for (size_t i = 0; i < JsonSymbolTable::MAX_SYMBOLS; i++)
+        many += "{\"identifier_number_" + to_string(i) + "\": 0},";
+    string longName(JsonSymbolTable::MAX_NAME_LENGTH + 1, 'n');
+    many += "{\"identifier_number_last\": 1, \"" + longName + "\": 2}]";
+    JsonDocument full;
+    reader.read(many, full);
+    assert(bounded->size() == JsonSymbolTable::MAX_SYMBOLS && !bounded->find("identifier_number_last"));
+    assert(bounded->intern("identifier_number_last") == nullptr && bounded->intern(longName) == nullptr);
+    const JsonValue& last = full[static_cast<int>(JsonSymbolTable::MAX_SYMBOLS)];
+    assert(last["identifier_number_last"].toInt32() == 1 && last[longName].toInt32() == 2);
+    reader.read(many, compact);
+    assert(compact[static_cast<int>(JsonSymbolTable::MAX_SYMBOLS)][longName].toInt32() == 2);
+    reader.setSymbolTable(nullptr);
+    assert(full.root().toCompactString() == reader.read(many)->toCompactString());
+}
+
+void testObjectOrder() {
+    // members keep the input order, both below and above the index threshold
+    for (int count : { 5, 100 }) {
+        string src = "{";
+        for (int i = count - 1; i >= 0; i--) {
+            src += "\"k" + to_string(i) + "\":" + to_string(i);
+            src += i > 0 ? "," : "}";
+        }
+
+        JsonReader reader;
+        JsonDocument doc;
+        reader.read(src, doc);
+        assert(doc.root().toCompactString() == src);
+
+        auto& obj = dynamic_cast<ValueObject&>(doc.root());
+        for (int i = 0; i < count; i++)
+            assert(obj["k" + to_string(i)].toInt32() == i);
+        assert(obj.find("k") == nullptr && obj.find(to_string(count)) == nullptr);
+
+        // a duplicate name replaces the value in place
+        obj.add("k0", ValueString("x"));
+        assert(obj.size() == count && obj["k0"].toRawString() == "x");
+        bool missing = false;
+        try {
+            obj["nothing"];
+        } catch (invalid_argument&) {
+            missing = true;
+        }
+        assert(missing && obj.size() == count);
+
+        auto heap = reader.read(src);
+        ValueObject copy = dynamic_cast<ValueObject&>(*heap);
+        assert(copy.toCompactString() == src && copy == *heap);
+    }
+}
+
+void testShapes() {
+    auto table = make_shared<JsonShapeTable>();
+    JsonReader reader;
+    reader.setShapeTable(table);
+
+    string src = "[{\"id\": 1, \"name\": \"a\"}, {\"id\": 2, \"name\": \"b\"}, {\"name\": \"c\", \"id\": 3}, {\"id\": 4, \"name\": \"d\", \"id\": 5}]";
+    JsonDocument doc;
+    reader.read(src, doc);
+    assert(table->size() == 5);
+
+    auto& first = dynamic_cast<const ValueObject&>(doc[0]);
+    auto& second = dynamic_cast<const ValueObject&>(doc[1]);
+    auto& third = dynamic_cast<const ValueObject&>(doc[2]);
+    assert(first.shape() == second.shape() && first.shape() != third.shape());
+    assert(doc[3].size() == 2 && doc[3]["id"].toInt32() == 5);
+    assert(doc.root() == *JsonReader().read(src));
+
+    // the field remembers the slot and still checks the name at it
+    JsonField id("id");
+    int sum = 0;
+    for (int i = 0; i < doc.root().size(); i++)
+        sum += dynamic_cast<const ValueObject&>(doc[i]).find(id)->toInt32();
+    assert(sum == 1 + 2 + 3 + 5);
+    JsonField missing("missing");
+    assert(first.find(missing) == nullptr && ValueObject().find(missing) == nullptr);
+
+    // a copy shares the shape; adding a member moves it to another shape
+    ValueObject copy = second;
+    assert(copy.shape() == second.shape() && copy == second);
+    copy.add("extra", ValueTrue());
+    assert(copy.shape() != second.shape() && copy.shape()->table() == table.get());
+    assert(copy.size() == 3 && copy.find(JsonField("extra"))->toBool());
+
+    // a large object gets a private shape
+    string large = "{";
+    for (size_t i = 0; i < JsonShapeTable::MAX_SHARED_SIZE + 10; i++)
+        large += (i > 0 ? ",\"k" : "\"k") + to_string(i) + "\":" + to_string(i);
+    large += "}";
+    auto value = reader.read(large);
+    auto& obj = dynamic_cast<ValueObject&>(*value);
+    assert(obj.shape()->table() == nullptr && obj.toCompactString() == large);
+    assert(obj["k70"].toInt32() == 70 && obj.find(JsonField("k3"))->toInt32() == 3);
+    ValueObject largeCopy = obj;
+    assert(largeCopy == obj && largeCopy.shape() != obj.shape());
+
+    // records with ever new names stop adding shapes once a shape has too many transitions
+    JsonReader distinct;
+    auto bounded = make_shared<JsonShapeTable>();
+    distinct.setShapeTable(bounded);
+    string records = "[";
+    for (int i = 0; i < 20000; i++)
+        records += (i > 0 ? ",{\"k" : "{\"k") + to_string(i) + "\":" + to_string(i) + "}";
+    records += "]";
+    auto many = distinct.read(records);
+    assert(bounded->size() == JsonShapeTable::MAX_CHILDREN + 1);
+    assert((*many)[5]["k5"].toInt32() == 5 && (*many)[19999]["k19999"].toInt32() == 19999);
+    assert(dynamic_cast<ValueObject&>((*many)[19999]).shape()->table() == nullptr);
+    assert(many->toCompactString() == records);
+
+    // the document keeps the table alive
+    weak_ptr<JsonShapeTable> weak = table;
+    reader.setShapeTable(nullptr);
+    table.reset();
+    value.reset();
+    assert(!weak.expired() && doc[1]["name"].toRawString() == "b");
+
+    // shapes keep their names after the symbol table they were read with is gone
+    auto shapes = make_shared<JsonShapeTable>();
+    {
+        JsonReader interning;
+        interning.setSymbolTable(make_shared<JsonSymbolTable>());
+        interning.setShapeTable(shapes);
+        interning.read(string(R"({"first": 1, "second": 2})"));
+    }
+    JsonReader plain;
+    plain.setShapeTable(shapes);
+    assert(plain.read(string(R"({"first": 3, "second": 4})"))->toCompactString() == R"({"first":3,"second":4})");
+}
+
+void testTape() {
+    JsonReader reader;
+    TapeDocument doc;
+
+    for (auto& s : gTestInput) {
+        reader.read(s, doc);
+        assert(*reader.read(doc.root().toCompactString()) == *reader.read(s));
+    }
+
+    reader.read(gTestInput[2], doc);
+    assert(doc["menu"]["items"].size() == 22);
+    assert(doc["menu"]["items"][1]["label"].toRawString() == "Open New");
+    assert(doc["menu"]["items"][2].isNull());
+
+    reader.read(string("{\"a\": [-1, 18446744073709551615, 2.5e3, \"x\\u0000y\", {}, []], \"b\": {\"c\": [[1], 2]}, \"d\": true}"), doc);
+    assert(doc.tape().size() == 30);
+    auto a = doc["a"];
+    assert(a[0].toInt64() == -1 && a[1].toUInt64() == 18446744073709551615ull);
+    assert(a[2].toDouble() == 2500.0 && a[3].toStringView() == string("x\0y", 3));
+    assert(a[4].isObject() && a[4].size() == 0 && a[5].isArray() && a[5].size() == 0);
+    assert(doc["b"]["c"][1].toInt32() == 2 && doc["d"].isTrue());
+
+    // skipping a container jumps over it
+    assert(a.next() == doc["b"].position() - 1);
+
+    string keys;
+    for (auto it = doc.root().begin(); it != doc.root().end(); ++it)
+        keys += string(it.key()) + ((*it).isObject() ? "{" : "");
+    assert(keys == "ab{d");
+    int count = 0;
+    a.forEach([&](int index, TapeValue value) {
+        count += index;
+    });
+    assert(count == 15);
+
+    bool failed = false;
+    try {
+        a[6];
+    } catch (out_of_range&) {
+        failed = true;
+    }
+    assert(failed);
+
+    failed = false;
+    try {
+        reader.read(string("[1, 2"), doc);
+    } catch (invalid_format_error&) {
+        failed = true;
+    }
+    assert(failed && doc.empty());
+
+    // a duplicate name keeps its first place and its last value, as in the DOM
+    string large = "{";
+    for (int i = 0; i < 40; i++)
+        large += "\"k" + to_string(i % 30) + "\": [" + to_string(i) + ", {\"x\": 0.5}], ";
+    large += "\"k3\": {\"y\": [1, 2], \"y\": {}}, \"z\": [{\"a\": 1, \"a\": 2}]}";
+    for (const string& src : { string(R"({"a": 1, "b": [2, {"c": 3}], "a": [3.5], "c": 4, "b": 5})"), large }) {
+        reader.read(src, doc);
+        auto value = reader.read(src);
+        assert(doc.root().size() == value->size());
+        assert(doc.root().toCompactString() == value->toCompactString());
+
+        // the moved containers still skip to the right place
+        int members = 0;
+        for (auto it = doc.root().begin(); it != doc.root().end(); ++it)
+            members++;
+        assert(members == value->size());
+
+        ostringstream os;
+        JsonSnapshot::write(doc, os);
+        string image = os.str();
+        vector<uint64_t> buffer((image.size() + 7) / 8);
+        memcpy(buffer.data(), image.data(), image.size());
+        JsonSnapshot snapshot;
+        snapshot.attach(buffer.data(), image.size());
+        assert(snapshot.verify() && *reader.read(snapshot.root().toCompactString()) == *value);
+    }
+    assert(doc["k5"][0].toInt32() == 35 && doc["k3"]["y"].isObject() && doc["z"][0]["a"].toInt32() == 2);
+    assert(doc["k9"][1]["x"].toDouble() == 0.5 && doc["z"][0].size() == 1);
+}
+
+void testSnapshot() {
+    JsonReader reader;
+    string path = (filesystem::temp_directory_path() / "youngjson_test.snap").string();
+
+    for (auto& s : gTestInput) {
+        auto value = reader.read(s);
+        JsonSnapshot::save(*value, path);
+        JsonSnapshot snapshot(path);
+        assert(snapshot.verify());
+        assert(*reader.read(snapshot.root().toCompactString()) == *value);
+    }
+
+    // repeated member names are stored once
+    string src = "[{\"name\": \"a\", \"n\": -1}, {\"name\": \"b\", \"n\": 18446744073709551615}, {\"name\": \"c\", \"n\": 2.5, \"x\": [null, true, {}]}]";
+    TapeDocument tape;
+    reader.read(src, tape);
+    ostringstream os;
+    JsonSnapshot::write(*reader.read(src), os);
+    string image = os.str();
+    assert(image.size() == sizeof(SnapshotHeader) + tape.tape().size() * 8 + tape.strings().size() - 2 * (4 + 4 + 1) - 2 * (4 + 1 + 1));
+
+    // an aligned copy of the image is read in place
+    vector<uint64_t> buffer((image.size() + 7) / 8);
+    memcpy(buffer.data(), image.data(), image.size());
+    JsonSnapshot snapshot;
+    snapshot.attach(buffer.data(), image.size());
+    assert(snapshot.verify());
+    assert(snapshot[1]["n"].toUInt64() == 18446744073709551615ull && snapshot[2]["n"].toDouble() == 2.5);
+    assert(snapshot[2]["name"].toStringView() == "c" && snapshot[2]["x"][1].isTrue());
+
+    // a verified image can't make the accessors read out of bounds
+    size_t rejected = 0;
+    for (size_t i = sizeof(SnapshotHeader); i < image.size(); i++) {
+        vector<uint64_t> copy = buffer;
+        reinterpret_cast<char*>(copy.data())[i] ^= 0x40;
+        JsonSnapshot damaged;
+        damaged.attach(copy.data(), image.size());
+        if (!damaged.verify()) {
+            rejected++;
+            continue;
+        }
+        try {
+            damaged.root().toCompactString();
+        } catch (exception&) {
+        }
+    }
+    assert(rejected > 0);
+
+    bool failed = false;
+    try {
+        snapshot.attach(buffer.data(), image.size() - 1);
+    } catch (invalid_format_error&) {
+        failed = true;
+    }
+    assert(failed && snapshot.empty());
+    filesystem::remove(path);
+}
+
+struct BoundItem {
+    std::string                 name;
+    int                         count = 0;
+    double                      price = 0;
+    bool                        active = false;
+    std::optional<std::string>  note;
+    std::vector<int>            tags;
+};
+
+YOUNGJSON_BIND(BoundItem, name, count, price, active, note, tags)
+
+struct BoundOrder {
+    unsigned long long                  id = 0;
+    std::vector<BoundItem>              items;
+    std::map<std::string, std::string>  meta;
+    std::optional<BoundItem>            gift;
+};
+
+YOUNGJSON_BIND(BoundOrder, id, items, meta, gift)
+
+void testBinding() {
+    JsonReader reader;
+    string src = "{\"id\": 18446744073709551615, \"unknown\": [{\"a\": [1, {}]}, null], \"items\": ["
+                 "{\"name\": \"pen\", \"count\": 3, \"price\": 1.5, \"active\": true, \"tags\": [1, 2]},"
+                 "{\"name\": \"ink\\n\", \"count\": -2, \"price\": 4, \"note\": \"blue\", \"tags\": []}],"
+                 "\"meta\": {\"b\": \"2\", \"a\": \"1\"}, \"gift\": null}";
+
+    BoundOrder order;
+    fromJson(reader, src, order);
+    assert(order.id == 18446744073709551615ull && order.items.size() == 2 && !order.gift);
+    assert(order.items[0].name == "pen" && order.items[0].count == 3 && order.items[0].price == 1.5);
+    assert(order.items[0].active && !order.items[0].note && order.items[0].tags == vector<int>({ 1, 2 }));
+    assert(order.items[1].name == "ink\n" && order.items[1].count == -2 && order.items[1].price == 4.0);
+    assert(order.items[1].note == string("blue") && order.meta.size() == 2 && order.meta["a"] == "1");
+
+    // written members follow the declaration; empty optionals are left out
+    string out = toJson(order);
+    assert(out == "{\"id\":18446744073709551615,\"items\":["
+                  "{\"name\":\"pen\",\"count\":3,\"price\":1.5,\"active\":true,\"tags\":[1,2]},"
+                  "{\"name\":\"ink\\n\",\"count\":-2,\"price\":4.0,\"active\":false,\"note\":\"blue\",\"tags\":[]}],"
+                  "\"meta\":{\"a\":\"1\",\"b\":\"2\"}}");
+    BoundOrder again;
+    fromJson(reader, out, again);
+    assert(toJson(again) == out);
+
+    vector<BoundItem> items;
+    fromJson(reader, string("[{\"name\": \"x\", \"count\": 1}, {\"count\": 2}]"), items);
+    assert(items.size() == 2 && items[0].name == "x" && items[1].count == 2);
+
+    map<string, vector<optional<double>>> series;
+    fromJson(reader, string("{\"s\": [1, null, 2.5]}"), series);
+    assert(series["s"].size() == 3 && !series["s"][1] && *series["s"][2] == 2.5);
+
+    for (const char* bad : { "{\"count\": \"3\"}", "{\"count\": 2.5}", "{\"count\": 3000000000}", "{\"tags\": {}}", "[]" }) {
+        bool failed = false;
+        try {
+            BoundItem item;
+            fromJson(reader, string(bad), item);
+        } catch (invalid_format_error&) {
+            failed = true;
+        }
+        assert(failed);
+    }
+}
+
+void testPattern() {
+    auto search = [](const char* pattern, const string& subject) {
+        return JsonPattern(pattern).search(subject);
+    };
+    assert(search("^[A-Z]{2}-[0-9]+$", "AB-12") && !search("^[A-Z]{2}-[0-9]+$", "AB-12x"));
+    assert(search("b+c", "aabbbcc") && !search("^b+c", "aabbbcc"));
+    assert(search("^(cat|dog)s?$", "dogs") && !search("^(cat|dog)s?$", "cow"));
+    assert(search("^a{2,3}$", "aaa") && !search("^a{2,3}$", "aaaa") && search("^a{2,}$", "aaaaa"));
+    assert(search("\\bis\\b", "this is") && !search("\\bis\\b", "this"));
+    assert(search("^[^\\d\\s]+$", "x_y") && !search("^[^\\d\\s]+$", "x 1"));
+    assert(search("^[\\w-]+$", "a-b_c") && search("^x{1,$", "x{1,"));
+    assert(search("^.$", "\xEA\xB0\x80") && search("^[\\uAC00-\\uD7A3]+$", "\xED\x95\x9C\xEA\xB8\x80"));
+    assert(search("^(?:a|)$", "") && search("^(?<year>\\d{4})$", "2024") && !search("^.$", "\n"));
+
+    for (const char* bad : { "(a)\\1", "(?=a)", "(?<!a)b", "a{2,1}", "*", "a**", "[b-a]", "\\q", "x{99999}" }) {
+        bool failed = false;
+        try {
+            JsonPattern invalid(bad);
+        } catch (invalid_argument&) {
+            failed = true;
+        }
+        assert(failed);
+    }
+
+    // no backtracking: time stays linear in the subject
+    string as(100 * 1024, 'a');
+    assert(!search("^(a*)*b$", as) && !search("(a|aa)+$\\b", as + "!") && search("^(a|a?)+$", as));
+}
+
+void testSchema() {
+    JsonReader reader;
+    JsonSchema schema(*reader.read(string(R"({
+        "$schema": "https://json-schema.org/draft/2020-12/schema",
+        "title": "order",
+        "type": "object",
+        "required": ["id", "items"],
+        "properties": {
+            "id": {"type": "integer", "minimum": 1},
+            "status": {"enum": ["open", "closed", null]},
+            "items": {
+                "type": "array", "minItems": 1, "maxItems": 3,
+                "items": {
+                    "type": "object",
+                    "required": ["sku"],
+                    "properties": {
+                        "sku": {"type": "string", "pattern": "^[A-Z]{2}-[0-9]+$"},
+                        "count": {"type": "integer", "exclusiveMinimum": 0, "maximum": 100},
+                        "note": {"type": ["string", "null"], "maxLength": 4}
+                    },
+                    "additionalProperties": false
+                }
+            },
+            "origin": {"const": {"x": 1, "y": [2, 3]}}
+        }
+    })")));
+
+    auto check = [&](const string& src, const string& expected) {
+        string domError, saxError;
+        bool dom = schema.validate(*reader.read(src), &domError);
+        bool sax = schema.validate(reader, src, &saxError);
+        assert(dom == expected.empty() && sax == expected.empty());
+        assert(domError == expected && saxError == expected);
+    };
+
+    check(R"({"id": 1, "items": [{"sku": "AB-12", "count": 5, "note": "\u00e9\u00e9\u00e9"}], "status": null, "origin": {"y": [2, 3.0], "x": 1}})", "");
+    check(R"({"id": 2, "items": [{"sku": "CD-3", "note": null}], "extra": {"anything": [true]}})", "");
+    check(R"({"id": 1.5, "items": []})", "#/id: expected integer");
+    check(R"({"id": 0, "items": [{"sku": "AB-1"}]})", "#/id: below minimum");
+    check(R"({"id": 1, "items": []})", "#/items: too few items");
+    check(R"({"id": 1, "items": [{"sku": "AB-1"}, {"sku": "AB-2"}, {"sku": "AB-3"}, {"sku": "AB-4"}]})", "#/items: too many items");
+    check(R"({"id": 1, "items": [{"sku": "AB-1"}, {"sku": "ab-2"}]})", "#/items/1/sku: doesn't match pattern");
+    check(R"({"id": 1, "items": [{"sku": "AB-1", "count": 0}]})", "#/items/0/count: below minimum");
+    check(R"({"id": 1, "items": [{"sku": "AB-1", "note": "12345"}]})", "#/items/0/note: too long");
+    check(R"({"id": 1, "items": [{"sku": "AB-1", "colour": "red"}]})", "#/items/0/colour: not allowed");
+    check(R"({"id": 1, "items": [{"count": 1}]})", "#/items/0/sku: missing");
+    check(R"({"items": [{"sku": "AB-1"}]})", "#/id: missing");
+    check(R"({"id": 1, "items": [{"sku": "AB-1"}], "status": "lost"})", "#/status: not in enum");
+    check(R"({"id": 1, "items": [{"sku": "AB-1"}], "origin": {"x": 1, "y": [2]}})", "#/origin: not in enum");
+    check(R"([1, 2])", "#: expected object");
+
+    // the parse stops at the first failure, so the rest isn't even checked for syntax
+    string error;
+    assert(!schema.validate(reader, string(R"({"id": "x", ]]])"), &error) && error == "#/id: expected integer");
+
+    // validation fused with building a tree
+    shared_ptr<JsonValue> built;
+    auto store = [&](shared_ptr<JsonValue> value) {
+        built = std::move(value);
+    };
+    ValueBuilder<decltype(store)> builder(store);
+    ValidatingHandler<decltype(builder)> handler(schema, builder);
+    assert(reader.parse(string(R"({"id": 7, "items": [{"sku": "XY-9"}]})"), handler));
+    assert(built && (*built)["items"][0]["sku"].toRawString() == "XY-9");
+
+    // long strings against a pattern mustn't exhaust the stack
+    auto checkLong = [&](const char* src, const string& expected) {
+        JsonSchema longSchema(*reader.read(string(src)));
+        string doc = "\"" + string(200 * 1024, 'a') + "\"";
+        string domError, saxError;
+        bool dom = longSchema.validate(*reader.read(doc), &domError);
+        bool sax = longSchema.validate(reader, doc, &saxError);
+        assert(dom == expected.empty() && sax == expected.empty());
+        assert(domError == expected && saxError == expected);
+    };
+    checkLong(R"({"type": "string", "pattern": "^(a|b)*$"})", "");
+    checkLong(R"({"type": "string", "pattern": "^(a*)*b$"})", "#: doesn't match pattern");
+
+    for (const char* bad : { R"({"type": "text"})", R"({"anyOf": []})", R"({"pattern": "("})",
+                             R"({"pattern": "(a)\\1"})", R"([])" }) {
+        bool failed = false;
+        try {
+            JsonSchema invalid(*reader.read(string(bad)));
+        } catch (invalid_argument&) {
+            failed = true;
+        }
+        assert(failed);
+    }
+}
+
+void testStats() {
+    const string src = R"({"a": [1, 2.5, "x\ny"], "b": {"c": null, "d": true}, "e": false})";
+    JsonReader reader;
+    string out;
+    JsonWriter writer(out);
+#ifdef YOUNGJSON_STATS
+    size_t reports = 0;
+    reader.setStatsObserver([&](const JsonStats& stats) {
+        reports++;
+    });
+    writer.setStatsObserver([&](const JsonStats& stats) {
+        reports++;
+    });
+#endif
+    reader.read(src);
+    reader.read(src)->write(writer);
+
+    const JsonStats& parsed = reader.stats();
+    const JsonStats& written = writer.stats();
+#ifdef YOUNGJSON_STATS
+    assert(reports == 3);
+    for (const JsonStats* stats : { &parsed, &written }) {
+        assert(stats->nodeCount() == 9 && stats->keys == 5 && stats->maxDepth == 2 && stats->escapes == 1);
+        assert(stats->nodes[vtObject] == 2 && stats->nodes[vtArray] == 1 && stats->nodes[vtNumber] == 2);
+        assert(stats->nodes[vtString] == 1 && stats->nodes[vtNull] == 1 && stats->nodes[vtTrue] == 1 && stats->nodes[vtFalse] == 1);
+    }
+    assert(parsed.bytes == src.length() && written.bytes == out.length());
+    assert(parsed.allocations >= 9 && parsed.allocatedBytes >= 9 * sizeof(ValueNull));
+    assert(parsed.ticks[spParse] >= parsed.ticks[spStrings] && written.ticks[spWrite] > 0);
+
+    // the arena document allocates no copies of escape-free strings it borrows
+    const string borrowed = R"(["abc", "def"])";
+    JsonDocument doc;
+    reader.setStringMode(smBorrow);
+    reader.read(borrowed, doc);
+    assert(reader.stats().allocations == 3 && reader.stats().nodeCount() == 3);
+
+    // the threads of a pool report their sum once, on the calling thread
+    std::thread::id caller = std::this_thread::get_id();
+    JsonStats total;
+    reports = 0;
+    auto sum = [&](const JsonStats& stats) {
+        assert(std::this_thread::get_id() == caller);
+        total = stats;
+        reports++;
+    };
+    string lines;
+    for (int i = 0; i < 500; i++)
+        lines += "[1, {\"a\": 2}]\n";
+    JsonLinesParser parser(4, 256);
+    parser.reader().setStatsObserver(sum);
+    parser.parse(lines.data(), lines.length(), [](size_t, JsonDocument&) { return true; });
+    assert(reports == 1 && total.nodeCount() == 2000 && total.keys == 500 && total.bytes == lines.length() - 500);
+
+    string array = "{\"data\": [" + string(R"({"a": [1, 2]}, )") + R"({"b": 3}]})";
+    ParallelArrayReader parallel(4);
+    parallel.setArrayPath({ "data" });
+    parallel.reader().setStatsObserver(sum);
+    reports = 0;
+    parallel.read(array);
+    assert(reports == 1 && total.nodeCount() == 2 + 4 + 2 && total.keys == 3);
+#else
+    // compiled out, the reader and writer carry no statistics
+    assert(parsed.nodeCount() == 0 && parsed.bytes == 0 && written.ticks[spWrite] == 0);
+    assert(sizeof(JsonWriter) < sizeof(JsonStats));
+#endif
+}
+
+void testPatch() {
+    JsonReader reader;
+
+    // member order doesn't change the hash, and equal numbers hash alike
+    auto a = reader.read(string(R"({"x": 1, "y": [true, "s", {"z": null}]})"));
+    auto b = reader.read(string(R"({"y": [true, "s", {"z": null}], "x": 1.0})"));
+    assert(a->hash() == b->hash() && *a == *b);
+    assert((*reader.read(string("[1, 2]"))).hash() != (*reader.read(string("[2, 1]"))).hash());
+
+    // an integer equals a double only if the double is exactly that integer
+    auto n = reader.read(string("[9007199254740993, 9007199254740992.0, 9007199254740992, -1, -1.0, 18446744073709551615, 1e300]"));
+    assert((*n)[0] != (*n)[1] && (*n)[1] == (*n)[2] && (*n)[0] != (*n)[2] && (*n)[1].hash() == (*n)[2].hash());
+    assert((*n)[3] == (*n)[4] && (*n)[3].hash() == (*n)[4].hash() && (*n)[3] != (*n)[5]);
+    assert((*n)[6] == *reader.read(string("1e300")) && (*n)[6] != (*n)[5]);
+    assert(!JsonPatch::diff((*n)[0], (*n)[1]).empty());
+
+    // a change anywhere below a hashed value updates its hash
+    uint64_t before = a->hash();
+    static_cast<ValueObject&>((*a)["y"][2]).add("w", ValueNumber(2));
+    assert(a->hash() != before && *a != *b);
+    static_cast<ValueObject&>((*a)["y"][2]).remove("w");
+    assert(a->hash() == before && *a == *b);
+    static_cast<ValueString&>((*b)["y"][1]).setValue(string("t"));
+    assert(b->hash() != before && *a != *b);
+
+    // a change clears the cached hashes on its own path only
+    ValueArray big;
+    for (int i = 0; i < 1000; i++)
+        big.add(ValueNumber(i));
+    uint64_t cached;
+    big.hash();
+    static_cast<ValueString&>((*b)["y"][1]).setValue(string("u"));
+    assert(big.cachedHash(cached) && !static_cast<const ValueObject&>(*b).cachedHash(cached));
+    static_cast<ValueNumber&>(big[999]).setValue(1000);
+    assert(!big.cachedHash(cached) && big.hash() != before);
+
+    // a value in two places updates both
+    auto shared = make_shared<ValueArray>();
+    ValueArray left, right;
+    left.add(shared);
+    right.add(shared);
+    right.add(ValueNull());
+    uint64_t leftHash = left.hash();
+    right.hash();
+    shared->add(ValueTrue());
+    assert(!left.cachedHash(cached) && !right.cachedHash(cached) && left.hash() != leftHash);
+    right.remove(0);
+    left.hash();
+    static_cast<ValueArray&>(left[0]).add(ValueTrue());
+    assert(!left.cachedHash(cached));
+
+    // RFC 6902 operations
+    auto doc = reader.read(string(R"({"a": {"b": [1, 2, 3]}, "c~d": "e", "f/g": 0})"));
+    JsonPatch patch(*reader.read(string(R"([
+        {"op": "test", "path": "/a/b/0", "value": 1},
+        {"op": "add", "path": "/a/b/1", "value": "x"},
+        {"op": "add", "path": "/a/b/-", "value": {"n": [4]}},
+        {"op": "remove", "path": "/a/b/0"},
+        {"op": "replace", "path": "/c~0d", "value": false},
+        {"op": "move", "from": "/f~1g", "path": "/a/moved"},
+        {"op": "copy", "from": "/a/b/3/n", "path": "/copied"},
+        {"op": "add", "path": "/a/b/3/n/0", "value": 5}
+    ])")));
+    assert(patch.size() == 8);
+    doc = patch.apply(doc);
+    assert(doc->toCompactString() == R"({"a":{"b":["x",2,3,{"n":[5,4]}],"moved":0},"c~d":false,"copied":[4]})");
+
+    auto fails = [&](const string& src, const string& ops) {
+        auto target = reader.read(src);
+        try {
+            JsonPatch(*reader.read(ops)).apply(target);
+        } catch (invalid_argument&) {
+            return true;
+        }
+        return false;
+    };
+    assert(fails(R"({"a": 1})", R"([{"op": "test", "path": "/a", "value": 2}])"));
+    assert(fails(R"({"a": 1})", R"([{"op": "add", "path": "/b/c", "value": 2}])"));
+    assert(fails(R"({"a": 1})", R"([{"op": "replace", "path": "/b", "value": 2}])"));
+    assert(fails(R"([1])", R"([{"op": "add", "path": "/2", "value": 2}])"));
+    assert(fails(R"([1])", R"([{"op": "remove", "path": "/01"}])"));
+    assert(fails(R"({"a": {"b": 1}})", R"([{"op": "move", "from": "/a", "path": "/a/b"}])"));
+    assert(fails(R"({"a": 1})", R"([{"op": "jump", "path": "/a"}])"));
+    assert(fails(R"({"a": 1})", R"([{"op": "add", "path": "a", "value": 1}])"));
+    assert(!fails(R"({"a": 1})", R"([{"op": "replace", "path": "", "value": [1]}])"));
+
+    // a diff applied to the old document gives the new one
+    const char* pairs[][2] = {
+        { R"({"a": 1, "b": [1, 2, 3, 4], "c": {"d": "e"}})", R"({"a": 2, "b": [1, 9, 4], "c": {"d": "e"}, "f": null})" },
+        { R"([1, 2, 3])", R"([0, 1, 2, 3, 4])" },
+        { R"([{"k": 1}, {"k": 2}])", R"([{"k": 2}])" },
+        { R"({"a/b": {"~": 1}})", R"({"a/b": {"~": 2}})" },
+        { R"({"a": 1})", R"([1])" },
+        { R"({"same": [1, {"x": 2}]})", R"({"same": [1, {"x": 2}]})" },
+    };
+    for (auto& pair : pairs) {
+        auto from = reader.read(string(pair[0]));
+        auto to = reader.read(string(pair[1]));
+        JsonPatch diff = JsonPatch::diff(*from, *to);
+        JsonPatch parsed(*reader.read(diff.toString()));
+        assert(*parsed.apply(from) == *to);
+    }
+    assert(JsonPatch::diff(*reader.read(string(pairs[5][0])), *reader.read(string(pairs[5][1]))).empty());
+
+    // unchanged subtrees are skipped, so only the changed leaf is replaced
+    JsonDocument big1, big2;
+    string src = "{\"keep\": [";
+    for (int i = 0; i < 1000; i++)
+        src += (i > 0 ? ", " : "") + to_string(i);
+    src += "], \"v\": 1}";
+    reader.read(src, big1);
+    src.replace(src.find("\"v\": 1"), 6, "\"v\": 2");
+    reader.read(src, big2);
+    JsonPatch small = JsonPatch::diff(big1.root(), big2.root());
+    assert(small.toString() == R"([{"op":"replace","path":"/v","value":2}])");
+}
+
 int main(void) {
     JsonReader reader(etUTF8);
 
@@ -130,5 +1512,31 @@ int main(void) {
     cout << root.toString() << endl;
     cout << root.toCompactString() << endl;
 
+    testDocument();
+    testCompact();
+    testStructuralIndex();
+    testString();
+    testBorrowedStrings();
+    testNumber();
+    testNumberFormat();
+    testWriter();
+    testSax();
+    testPushParser();
+    testJsonLines();
+    testParallelArray();
+    testReadFile();
+    testLazy();
+    testPath();
+    testSymbols();
+    testObjectOrder();
+    testShapes();
+    testTape();
+    testSnapshot();
+    testBinding();
+    testPattern();
+    testSchema();
+    testStats();
+    testPatch();
+
     return 0;
 }
\ No newline at end of file